@@ -0,0 +1,650 @@
+// NOTE(nox): Offline analysis of logic analyzer captures of the serial link, for the long ones that the
+// sigrok decoder in SigrokCobsDecoder takes forever on. The capture is the stream of UART bytes of one
+// direction, either raw or as text with a timestamp per byte:
+//
+//     sigrok-cli -i show.sr -P uart:rx=D0:baudrate=115200 -B uart=rx > show.bin
+//     sigrok-cli -i show.sr -P uart:rx=D0:baudrate=115200 -A uart=rx-data --protocol-decoder-samplenum >show.txt
+//     CaptureAnalyzer --samplerate 24m show.txt
+//
+// Each text line is the time of the byte first and the byte last, in hex ("123456-123789 uart-1: A6",
+// "0.0012345,0x41", ...). The time is in seconds, or in samples when --samplerate is given. Lines that
+// don't look like that (headers, other annotations) are skipped. Raw captures have no times, so there are
+// no gaps or link usage for them.
+//
+// The bytes are framed like the firmware does it (Link.h): a packet starts at a delimiter and is complete
+// once its header and as many bytes as the header says have been decoded. The file is mapped and read once,
+// so big captures go as fast as the disk.
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <common.h>
+#include <protocol.hpp>
+
+typedef enum {
+    Error_BadMagic,     // NOTE(nox): The first byte is not MagicNumber | Command
+    Error_TooLong,      // NOTE(nox): The header says more than MaxPacketSize
+    Error_Truncated,    // NOTE(nox): The next delimiter came before the packet was complete
+    Error_Trailing,     // NOTE(nox): Bytes after a complete packet, before the next delimiter
+    Error_UnknownCommand,
+    ErrorCount
+} decode_error;
+
+static const char *ErrorNames[ErrorCount] = {
+    "bad magic",
+    "too long",
+    "truncated",
+    "trailing bytes",
+    "unknown command",
+};
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Power of 2 histogram, bucket I holds the values with I significant bits
+enum { LogBucketCount = 65 };
+
+typedef struct {
+    u64 Count;
+    u64 Sum;
+    u64 Min;
+    u64 Max;
+    u64 Buckets[LogBucketCount];
+} log_histogram;
+
+static inline void recordValue(log_histogram *Histogram, u64 Value) {
+    u32 Bucket = Value ? 64 - __builtin_clzll(Value) : 0;
+    ++Histogram->Buckets[Bucket];
+    if(Histogram->Count == 0 || Value < Histogram->Min) {
+        Histogram->Min = Value;
+    }
+    if(Value > Histogram->Max) {
+        Histogram->Max = Value;
+    }
+    Histogram->Sum += Value;
+    ++Histogram->Count;
+}
+
+// NOTE(nox): Upper bound of the bucket where the percentile falls, so at most 2x off
+static u64 logPercentile(log_histogram *Histogram, double Percentile) {
+    u64 Wanted = (u64)(Histogram->Count*Percentile + 0.999);
+    u64 Seen = 0;
+    for(u32 I = 0; I < LogBucketCount; ++I) {
+        Seen += Histogram->Buckets[I];
+        if(Seen >= Wanted) {
+            u64 Bound = I ? ((u64)2 << (I-1)) - 1 : 0;
+            return Bound < Histogram->Max ? Bound : Histogram->Max;
+        }
+    }
+    return Histogram->Max;
+}
+
+
+// ------------------------------------------------------------------------------------------
+typedef enum : u8 {
+    Decode_Unframed, // NOTE(nox): Before the first delimiter, the capture may start in the middle of a packet
+    Decode_Packet,
+    Decode_Done,
+    Decode_Skip,     // NOTE(nox): After an error, until the next delimiter
+} decode_state;
+
+typedef struct {
+    u64 Packets;
+    u64 WireBytes;
+    u64 PayloadBytes;
+    u32 MinLength;
+    u32 MaxLength;
+} command_stats;
+
+typedef struct {
+    bool Pong;
+    bool HasTime;
+    u64 ByteNs; // NOTE(nox): Time a byte takes on the wire, start and stop bits included
+
+    decode_state State;
+    u8 Code;
+    u8 Copy;
+    u8 Header[3];
+    u32 Decoded;
+    u32 Length;
+    u32 WireBytes;  // NOTE(nox): Of the current packet, delimiter included
+    u32 ExtraBytes; // NOTE(nox): After the current packet was complete, the final empty group aside
+    bool HadFinalGroup;
+    u64 StartNs;
+    u64 LastByteNs;
+    u64 PrevStartNs;
+    bool HasPrevStart;
+
+    u64 TotalBytes;
+    u64 UnframedBytes;
+    u64 FirstNs;
+    u64 SecondIndex;
+    u64 SecondBytes;
+    u64 BusiestSecondBytes;
+    u64 TimeOffsetNs;
+    u32 TimeJumps;
+
+    u64 Packets;
+    u64 Errors[ErrorCount];
+    command_stats Commands[CommandMask+1];
+    log_histogram Sizes;
+    log_histogram StartGapsUs;
+    log_histogram IdleGapsUs;
+} analyzer;
+
+static void finishPacket(analyzer *A) {
+    u8 Command = A->Header[0] & CommandMask;
+    if(!commandName(Command, A->Pong)) {
+        ++A->Errors[Error_UnknownCommand];
+    }
+
+    command_stats *Stats = A->Commands + Command;
+    if(Stats->Packets == 0 || A->Length < Stats->MinLength) {
+        Stats->MinLength = A->Length;
+    }
+    if(A->Length > Stats->MaxLength) {
+        Stats->MaxLength = A->Length;
+    }
+    ++Stats->Packets;
+    Stats->WireBytes += A->WireBytes;
+    Stats->PayloadBytes += A->Length;
+
+    ++A->Packets;
+    recordValue(&A->Sizes, A->WireBytes);
+    A->State = Decode_Done;
+}
+
+// NOTE(nox): A decoded byte of the current packet
+static inline void emitByte(analyzer *A, u8 Byte) {
+    if(A->Decoded < 3) {
+        A->Header[A->Decoded] = Byte;
+    }
+    ++A->Decoded;
+
+    if(A->Decoded == 1 && (Byte & MagicMask) != MagicNumber) {
+        ++A->Errors[Error_BadMagic];
+        A->State = Decode_Skip;
+    }
+    else if(A->Decoded == 3) {
+        A->Length = A->Header[1] | (A->Header[2] << 8);
+        if(3 + A->Length > MaxPacketSize) {
+            ++A->Errors[Error_TooLong];
+            A->State = Decode_Skip;
+            return;
+        }
+    }
+
+    if(A->Decoded >= 3 && A->Decoded >= 3 + A->Length) {
+        finishPacket(A);
+    }
+}
+
+static void startPacket(analyzer *A, u64 Ns) {
+    if(A->State == Decode_Packet) {
+        ++A->Errors[Error_Truncated];
+    }
+    else if(A->State == Decode_Done && A->ExtraBytes) {
+        ++A->Errors[Error_Trailing];
+    }
+
+    if(A->HasTime) {
+        if(A->HasPrevStart) {
+            recordValue(&A->StartGapsUs, (Ns - A->PrevStartNs) / 1000);
+            u64 BusyUntil = A->LastByteNs + A->ByteNs;
+            recordValue(&A->IdleGapsUs, Ns > BusyUntil ? (Ns - BusyUntil) / 1000 : 0);
+        }
+        A->PrevStartNs = Ns;
+        A->HasPrevStart = true;
+    }
+
+    A->State = Decode_Packet;
+    A->Code = 0xFF;
+    A->Copy = 0;
+    A->Decoded = 0;
+    A->Length = 0;
+    A->WireBytes = 1;
+    A->ExtraBytes = 0;
+    A->HadFinalGroup = false;
+    A->StartNs = Ns;
+}
+
+// NOTE(nox): Same decoding as decodeRx, one byte at a time. The zero of a group is decoded as soon as the
+// group is complete, the header length tells when to stop.
+static inline void feedByte(analyzer *A, u8 Byte, u64 Ns) {
+    if(A->HasTime) {
+        if(A->TotalBytes == 0) {
+            A->FirstNs = Ns;
+        }
+        else if(Ns + A->TimeOffsetNs < A->LastByteNs) {
+            // NOTE(nox): Joined captures start over, the next part goes right after the last byte
+            A->TimeOffsetNs = A->LastByteNs + A->ByteNs - Ns;
+            ++A->TimeJumps;
+        }
+        Ns += A->TimeOffsetNs;
+
+        u64 Second = (Ns - A->FirstNs) / 1000000000;
+        if(Second != A->SecondIndex) {
+            if(A->SecondBytes > A->BusiestSecondBytes) {
+                A->BusiestSecondBytes = A->SecondBytes;
+            }
+            A->SecondIndex = Second;
+            A->SecondBytes = 0;
+        }
+        ++A->SecondBytes;
+    }
+    ++A->TotalBytes;
+
+    if(Byte == 0) {
+        startPacket(A, Ns);
+    }
+    else {
+        switch(A->State) {
+            case Decode_Unframed: {
+                ++A->UnframedBytes;
+            } break;
+
+            case Decode_Packet: {
+                ++A->WireBytes;
+                if(A->Copy == 0) {
+                    A->Code = Byte;
+                    A->Copy = Byte - 1;
+                }
+                else {
+                    --A->Copy;
+                    emitByte(A, Byte);
+                }
+
+                if(A->State == Decode_Packet && A->Copy == 0 && A->Code != 0xFF) {
+                    emitByte(A, 0);
+                }
+            } break;
+
+            case Decode_Done: {
+                // NOTE(nox): When the packet ends with a zero or with a full group, stuffBytes still ends it
+                // with a group, an empty one, which is a lone 1 after the packet is complete
+                if(Byte != 1 || A->HadFinalGroup) {
+                    ++A->ExtraBytes;
+                }
+                else {
+                    ++A->Commands[A->Header[0] & CommandMask].WireBytes;
+                }
+                A->HadFinalGroup = true;
+            } break;
+
+            case Decode_Skip: {} break;
+        }
+    }
+
+    A->LastByteNs = Ns;
+}
+
+static void finishCapture(analyzer *A) {
+    if(A->State == Decode_Packet) {
+        ++A->Errors[Error_Truncated];
+    }
+    if(A->SecondBytes > A->BusiestSecondBytes) {
+        A->BusiestSecondBytes = A->SecondBytes;
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Input
+typedef struct {
+    double NsPerSample; // NOTE(nox): 0 when the times are in seconds
+    bool Decimal;
+    u64 Lines;
+    u64 SkippedLines;
+} text_options;
+
+static inline bool isDigit(u8 Char) {
+    return Char >= '0' && Char <= '9';
+}
+
+static inline bool isSeparator(u8 Char) {
+    return Char == ' ' || Char == '\t' || Char == ',' || Char == ':' || Char == ';' || Char == '\r';
+}
+
+static inline s32 hexValue(u8 Char) {
+    if(isDigit(Char))              return Char - '0';
+    if(Char >= 'a' && Char <= 'f') return Char - 'a' + 10;
+    if(Char >= 'A' && Char <= 'F') return Char - 'A' + 10;
+    return -1;
+}
+
+// NOTE(nox): Returns false for lines that have no time and byte
+static inline bool parseLine(const u8 *At, const u8 *End, text_options *Options, u64 *Ns, u8 *Byte) {
+    while(At < End && (*At == ' ' || *At == '\t')) {
+        ++At;
+    }
+    if(At >= End || !isDigit(*At)) {
+        return false;
+    }
+
+    u64 Whole = 0;
+    for(; At < End && isDigit(*At); ++At) {
+        Whole = Whole*10 + (*At - '0');
+    }
+    u64 FractionNs = 0;
+    if(At < End && *At == '.') {
+        u64 Scale = 100000000;
+        for(++At; At < End && isDigit(*At); ++At) {
+            FractionNs += (*At - '0')*Scale;
+            Scale /= 10;
+        }
+    }
+    if(Options->NsPerSample) {
+        *Ns = (u64)(Whole*Options->NsPerSample);
+    }
+    else {
+        *Ns = Whole*1000000000 + FractionNs;
+    }
+
+    while(End > At && isSeparator(End[-1])) {
+        --End;
+    }
+    const u8 *Token = End;
+    while(Token > At && !isSeparator(Token[-1])) {
+        --Token;
+    }
+    if(Token == At || Token == End) {
+        return false; // NOTE(nox): The time is the only thing on the line
+    }
+
+    u32 Value = 0;
+    if(End - Token > 2 && Token[0] == '0' && (Token[1] == 'x' || Token[1] == 'X')) {
+        Token += 2;
+    }
+    else if(Options->Decimal) {
+        for(; Token < End && isDigit(*Token); ++Token) {
+            Value = Value*10 + (*Token - '0');
+            if(Value > 0xFF) {
+                return false;
+            }
+        }
+        *Byte = (u8)Value;
+        return Token == End;
+    }
+
+    if(End - Token > 2) {
+        return false;
+    }
+    for(; Token < End; ++Token) {
+        s32 Digit = hexValue(*Token);
+        if(Digit < 0) {
+            return false;
+        }
+        Value = Value*16 + Digit;
+    }
+    *Byte = (u8)Value;
+    return true;
+}
+
+static void analyzeText(analyzer *A, const u8 *Data, u64 Size, text_options *Options) {
+    const u8 *End = Data + Size;
+    for(const u8 *At = Data; At < End;) {
+        const u8 *LineEnd = (const u8 *)memchr(At, '\n', End - At);
+        if(!LineEnd) {
+            LineEnd = End;
+        }
+
+        u64 Ns;
+        u8 Byte;
+        ++Options->Lines;
+        if(parseLine(At, LineEnd, Options, &Ns, &Byte)) {
+            feedByte(A, Byte, Ns);
+        }
+        else {
+            ++Options->SkippedLines;
+        }
+        At = LineEnd + 1;
+    }
+}
+
+// NOTE(nox): How many of the next bytes can be counted without looking at them, as long as none is a
+// delimiter. Those are the bytes inside a group of the payload (not the last one, where the group or the
+// packet may end) and everything that is skipped until the next delimiter.
+static inline u64 passThroughBytes(analyzer *A) {
+    switch(A->State) {
+        case Decode_Unframed:
+        case Decode_Skip: {
+            return UINT64_MAX;
+        } break;
+
+        case Decode_Packet: {
+            if(A->Decoded >= 3 && A->Copy > 1) {
+                u32 Needed = 3 + A->Length - A->Decoded;
+                return (A->Copy < Needed ? A->Copy : Needed) - 1;
+            }
+        } break;
+
+        case Decode_Done: {} break;
+    }
+    return 0;
+}
+
+// NOTE(nox): Without times, most bytes only have to be counted. The payload goes through a group at a time
+// and only the bytes where something happens go through feedByte, which is what gets through big captures
+// at the speed of the disk.
+static void analyzeBinary(analyzer *A, const u8 *Data, u64 Size) {
+    for(u64 I = 0; I < Size;) {
+        u64 Count = passThroughBytes(A);
+        if(Count > Size - I) {
+            Count = Size - I;
+        }
+        if(Count) {
+            const u8 *Delimiter = (const u8 *)memchr(Data + I, 0, Count);
+            if(Delimiter) {
+                Count = Delimiter - (Data + I);
+            }
+
+            A->TotalBytes += Count;
+            if(A->State == Decode_Packet) {
+                A->WireBytes += Count;
+                A->Copy -= Count;
+                A->Decoded += Count;
+            }
+            else if(A->State == Decode_Unframed) {
+                A->UnframedBytes += Count;
+            }
+            I += Count;
+        }
+
+        if(I < Size) {
+            feedByte(A, Data[I++], 0);
+        }
+    }
+}
+
+// NOTE(nox): Raw captures are full of delimiters and packet headers, which text never has
+static bool looksLikeText(const u8 *Data, u64 Size) {
+    u64 Count = Size < 4096 ? Size : 4096;
+    for(u64 I = 0; I < Count; ++I) {
+        u8 Char = Data[I];
+        if(Char != '\n' && Char != '\r' && Char != '\t' && (Char < 0x20 || Char > 0x7E)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// ------------------------------------------------------------------------------------------
+static void printHistogram(const char *Name, log_histogram *Histogram, const char *Unit) {
+    if(Histogram->Count == 0) {
+        printf("%-22s none\n", Name);
+        return;
+    }
+
+    printf("%-22s min %llu, p50 %llu, p90 %llu, p99 %llu, max %llu, mean %.1f %s\n", Name,
+           (unsigned long long)Histogram->Min, (unsigned long long)logPercentile(Histogram, 0.5),
+           (unsigned long long)logPercentile(Histogram, 0.9), (unsigned long long)logPercentile(Histogram, 0.99),
+           (unsigned long long)Histogram->Max, (double)Histogram->Sum / Histogram->Count, Unit);
+}
+
+static void printReport(analyzer *A, u32 Baud) {
+    u64 ErrorTotal = 0;
+    for(u32 I = 0; I < ErrorCount; ++I) {
+        ErrorTotal += A->Errors[I];
+    }
+    printf("%llu bytes, %llu packets, %llu errors, %llu bytes before the first delimiter\n",
+           (unsigned long long)A->TotalBytes, (unsigned long long)A->Packets, (unsigned long long)ErrorTotal,
+           (unsigned long long)A->UnframedBytes);
+
+    if(A->HasTime && A->TotalBytes) {
+        u64 DurationNs = A->LastByteNs + A->ByteNs - A->FirstNs;
+        double BusyNs = (double)A->TotalBytes*A->ByteNs;
+        double BusiestNs = (double)A->BusiestSecondBytes*A->ByteNs;
+        printf("%.3f s at %d baud, link used %.1f%% on average and %.1f%% in the busiest second\n",
+               DurationNs / 1e9, Baud, 100.0*BusyNs / DurationNs,
+               100.0*BusiestNs / (DurationNs < 1000000000 ? DurationNs : 1000000000));
+        if(A->TimeJumps) {
+            printf("The times went back %u times, the parts were put one after the other\n", A->TimeJumps);
+        }
+    }
+
+    printf("\n%-20s %10s %12s %8s %8s %8s\n", "Command", "Packets", "Wire bytes", "Min len", "Avg len",
+           "Max len");
+    for(u32 I = 0; I < arrayCount(A->Commands); ++I) {
+        command_stats *Stats = A->Commands + I;
+        if(Stats->Packets == 0) {
+            continue;
+        }
+
+        const char *Name = commandName(I, A->Pong);
+        char Unknown[16];
+        if(!Name) {
+            snprintf(Unknown, sizeof(Unknown), "Unknown %d", I);
+            Name = Unknown;
+        }
+        printf("%-20s %10llu %12llu %8u %8.1f %8u\n", Name, (unsigned long long)Stats->Packets,
+               (unsigned long long)Stats->WireBytes, Stats->MinLength,
+               (double)Stats->PayloadBytes / Stats->Packets, Stats->MaxLength);
+    }
+
+    printf("\n");
+    for(u32 I = 0; I < ErrorCount; ++I) {
+        if(A->Errors[I]) {
+            printf("%-22s %llu\n", ErrorNames[I], (unsigned long long)A->Errors[I]);
+        }
+    }
+    printHistogram("Packet size", &A->Sizes, "bytes");
+    if(A->HasTime) {
+        printHistogram("Start to start", &A->StartGapsUs, "us");
+        printHistogram("Idle before packet", &A->IdleGapsUs, "us");
+    }
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: CaptureAnalyzer [options] <capture>\n"
+            "\n"
+            "Options:\n"
+            "  --format <name>      bin (raw bytes) or text (time and byte per line), guessed by default\n"
+            "  --samplerate <hz>    Text times are sample numbers at this rate (k and m suffixes work)\n"
+            "  --decimal            Text bytes are decimal instead of hex\n"
+            "  --baud <rate>        Link speed, for the usage (default %d)\n"
+            "  --pong               Name the commands as the pong firmware's\n", BaudRate);
+}
+
+int main(int ArgCount, char **Args) {
+    const char *Path = 0;
+    const char *Format = 0;
+    u32 Baud = BaudRate;
+    text_options Text = {};
+    static analyzer Analyzer = {};
+
+    for(int I = 1; I < ArgCount; ++I) {
+        const char *Arg = Args[I];
+        if(strcmp(Arg, "--decimal") == 0) {
+            Text.Decimal = true;
+        }
+        else if(strcmp(Arg, "--pong") == 0) {
+            Analyzer.Pong = true;
+        }
+        else if(Arg[0] == '-' && Arg[1] == '-' && I+1 < ArgCount) {
+            const char *Value = Args[++I];
+            if(strcmp(Arg, "--format") == 0) {
+                Format = Value;
+            }
+            else if(strcmp(Arg, "--samplerate") == 0) {
+                char *Suffix;
+                double Rate = strtod(Value, &Suffix);
+                if(*Suffix == 'k' || *Suffix == 'K') Rate *= 1e3;
+                if(*Suffix == 'm' || *Suffix == 'M') Rate *= 1e6;
+                if(Rate <= 0) {
+                    usage();
+                    return 1;
+                }
+                Text.NsPerSample = 1e9 / Rate;
+            }
+            else if(strcmp(Arg, "--baud") == 0) {
+                Baud = max(atoi(Value), 300);
+            }
+            else {
+                usage();
+                return 1;
+            }
+        }
+        else if(!Path && Arg[0] != '-') {
+            Path = Arg;
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if(!Path) {
+        usage();
+        return 1;
+    }
+
+    int File = open(Path, O_RDONLY);
+    struct stat Stat;
+    if(File < 0 || fstat(File, &Stat) < 0) {
+        fprintf(stderr, "Could not open %s\n", Path);
+        return 1;
+    }
+
+    u64 Size = Stat.st_size;
+    const u8 *Data = 0;
+    if(Size) {
+        Data = (const u8 *)mmap(0, Size, PROT_READ, MAP_PRIVATE, File, 0);
+        if(Data == MAP_FAILED) {
+            fprintf(stderr, "Could not map %s\n", Path);
+            return 1;
+        }
+        madvise((void *)Data, Size, MADV_SEQUENTIAL);
+    }
+
+    bool IsText = Format ? strcmp(Format, "text") == 0 : looksLikeText(Data, Size);
+    Analyzer.HasTime = IsText;
+    Analyzer.ByteNs = 10*1000000000ull / Baud;
+    if(IsText) {
+        analyzeText(&Analyzer, Data, Size, &Text);
+    }
+    else {
+        analyzeBinary(&Analyzer, Data, Size);
+    }
+    finishCapture(&Analyzer);
+
+    if(IsText) {
+        printf("%s: text, %llu lines (%llu skipped)\n", Path, (unsigned long long)Text.Lines,
+               (unsigned long long)Text.SkippedLines);
+    }
+    else {
+        printf("%s: raw bytes, no times\n", Path);
+    }
+    printReport(&Analyzer, Baud);
+
+    if(Size) {
+        munmap((void *)Data, Size);
+    }
+    close(File);
+    return 0;
+}
@@ -0,0 +1,3 @@
+#!/usr/bin/env sh
+mkdir -p build
+c++ -Wall -Wextra -Wno-unused-function -g3 -O2 -I../Shared analyzer.cpp -o build/CaptureAnalyzer
@@ -0,0 +1,1048 @@
+#define xCoord(Idx, GridSize) (Idx % GridSize)
+#define yCoord(Idx, GridSize) (GridSize - (Idx / GridSize) - 1)
+#define frameRepeatCount(FrameMs, Fps) ((FrameMs*Fps)/1000)
+
+enum {
+    DefaultFrameTimeMs = 1000,
+    GridCellCount = GridSize*GridSize,
+    GridWordCount = GridCellCount/64,
+
+    FineBlankWords = (MaxHighResPoints + 63)/64,
+    FineIndexSize = 512, // NOTE(nox): Power of two, a bit more than twice MaxHighResPoints
+};
+
+// NOTE(nox): In DAC steps, with Y going up like on the device
+typedef struct {
+    u16 X, Y;
+} fine_point;
+
+// NOTE(nox): Point state is kept in bitsets (one bit per grid cell, a grid row per word while GridSize
+// is 64) so that clearing, comparing and onion skinning work a word at a time. Order is the dense draw
+// order and OrderIdx is its reverse (cell -> position in Order), only meaningful for active cells.
+//
+// High resolution frames can't have a bit per position (that would be 2MB a frame), so their points are
+// only the list in draw order plus a small hash table from position to index in it, to find duplicates
+// and the point under the mouse. The grid part of such a frame is empty.
+typedef struct {
+    u64 Active[GridWordCount];
+    u64 DisablePathBefore[GridWordCount];
+    u32 ActiveCount;
+    u16 Order[MaxActive];
+    u16 OrderIdx[GridCellCount];
+    s32 NumMilliseconds;
+    s32 TweenMs; // NOTE(nox): Tween to the next frame, 0 for none, see tweenProgress
+    u8 Easing;
+
+    u8 Format; // NOTE(nox): FrameFormat_*
+    u32 FineCount;
+    fine_point Fine[MaxHighResPoints];
+    u64 FineBlank[FineBlankWords];
+    s16 FineIndex[FineIndexSize]; // NOTE(nox): Open addressing, -1 is empty
+} frame;
+
+static inline bool testBit(const u64 *Bits, u32 Idx) {
+    return (Bits[Idx >> 6] >> (Idx & 63)) & 1;
+}
+
+static inline void setBit(u64 *Bits, u32 Idx) {
+    Bits[Idx >> 6] |= (u64)1 << (Idx & 63);
+}
+
+static inline void clearBit(u64 *Bits, u32 Idx) {
+    Bits[Idx >> 6] &= ~((u64)1 << (Idx & 63));
+}
+
+static inline void assignBit(u64 *Bits, u32 Idx, bool Value) {
+    if(Value) {
+        setBit(Bits, Idx);
+    } else {
+        clearBit(Bits, Idx);
+    }
+}
+
+static inline bool isActive(frame *Frame, u32 Cell) {
+    return testBit(Frame->Active, Cell);
+}
+
+static inline bool isPathDisabled(frame *Frame, u32 Cell) {
+    return testBit(Frame->DisablePathBefore, Cell);
+}
+
+static inline u32 framePointCount(frame *Frame) {
+    return Frame->Format == FrameFormat_HighRes ? Frame->FineCount : Frame->ActiveCount;
+}
+
+static void clearFrame(frame *Frame) {
+    memset(Frame->Active, 0, sizeof(Frame->Active));
+    memset(Frame->DisablePathBefore, 0, sizeof(Frame->DisablePathBefore));
+    Frame->ActiveCount = 0;
+
+    memset(Frame->FineBlank, 0, sizeof(Frame->FineBlank));
+    memset(Frame->FineIndex, 0xFF, sizeof(Frame->FineIndex));
+    Frame->FineCount = 0;
+}
+
+static void initFrame(frame *Frame) {
+    clearFrame(Frame);
+    Frame->NumMilliseconds = DefaultFrameTimeMs;
+    Frame->TweenMs = 0;
+    Frame->Easing = Ease_Linear;
+    Frame->Format = FrameFormat_Grid;
+}
+
+static bool addPoint(frame *Frame, u32 Cell, bool DisablePathBefore = false) {
+    if(Cell >= GridCellCount || isActive(Frame, Cell) || Frame->ActiveCount >= MaxActive) {
+        return false;
+    }
+
+    Frame->OrderIdx[Cell] = Frame->ActiveCount;
+    Frame->Order[Frame->ActiveCount++] = Cell;
+    setBit(Frame->Active, Cell);
+    assignBit(Frame->DisablePathBefore, Cell, DisablePathBefore);
+    return true;
+}
+
+static void removePoint(frame *Frame, u32 Cell) {
+    if(!isActive(Frame, Cell)) {
+        return;
+    }
+
+    // NOTE(nox): Only the points drawn after this one need to move
+    for(u32 I = Frame->OrderIdx[Cell] + 1; I < Frame->ActiveCount; ++I) {
+        u16 Moved = Frame->Order[I];
+        Frame->Order[I-1] = Moved;
+        Frame->OrderIdx[Moved] = I-1;
+    }
+    --Frame->ActiveCount;
+    clearBit(Frame->Active, Cell);
+    clearBit(Frame->DisablePathBefore, Cell);
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): High resolution points
+static inline u32 fineSlot(u16 X, u16 Y) {
+    u32 Key = ((u32)X << 12) | Y;
+    return (Key*2654435761u) >> (32 - 9);
+}
+static_assert(FineIndexSize == 1 << 9, "fineSlot keeps 9 bits of the hash");
+
+// NOTE(nox): Returns the index of the point in draw order, or -1
+static s32 findFinePoint(frame *Frame, u16 X, u16 Y) {
+    for(u32 Slot = fineSlot(X, Y);; Slot = (Slot + 1) & (FineIndexSize - 1)) {
+        s32 Idx = Frame->FineIndex[Slot];
+        if(Idx < 0 || (Frame->Fine[Idx].X == X && Frame->Fine[Idx].Y == Y)) {
+            return Idx;
+        }
+    }
+}
+
+static void indexFinePoint(frame *Frame, u32 Idx) {
+    fine_point *Point = Frame->Fine + Idx;
+    u32 Slot = fineSlot(Point->X, Point->Y);
+    while(Frame->FineIndex[Slot] >= 0) {
+        Slot = (Slot + 1) & (FineIndexSize - 1);
+    }
+    Frame->FineIndex[Slot] = Idx;
+}
+
+// NOTE(nox): After the draw order changed. With at most MaxHighResPoints this is cheaper than keeping
+// tombstones around.
+static void reindexFinePoints(frame *Frame) {
+    memset(Frame->FineIndex, 0xFF, sizeof(Frame->FineIndex));
+    for(u32 I = 0; I < Frame->FineCount; ++I) {
+        indexFinePoint(Frame, I);
+    }
+}
+
+static inline bool isFineBlank(frame *Frame, u32 Idx) {
+    return testBit(Frame->FineBlank, Idx);
+}
+
+static bool addFinePoint(frame *Frame, u16 X, u16 Y, bool Blank = false) {
+    if(X > HighResMax || Y > HighResMax || Frame->FineCount >= MaxHighResPoints ||
+       findFinePoint(Frame, X, Y) >= 0)
+    {
+        return false;
+    }
+
+    u32 Idx = Frame->FineCount++;
+    Frame->Fine[Idx] = (fine_point){X, Y};
+    assignBit(Frame->FineBlank, Idx, Blank);
+    indexFinePoint(Frame, Idx);
+    return true;
+}
+
+static void removeFinePoint(frame *Frame, u32 Idx) {
+    if(Idx >= Frame->FineCount) {
+        return;
+    }
+
+    for(u32 I = Idx + 1; I < Frame->FineCount; ++I) {
+        Frame->Fine[I-1] = Frame->Fine[I];
+        assignBit(Frame->FineBlank, I-1, isFineBlank(Frame, I));
+    }
+    --Frame->FineCount;
+    clearBit(Frame->FineBlank, Frame->FineCount);
+    reindexFinePoints(Frame);
+}
+
+// NOTE(nox): Closest point no further than MaxDist, or -1
+static s32 nearestFinePoint(frame *Frame, s32 X, s32 Y, s32 MaxDist) {
+    s32 Best = -1;
+    s32 BestDistSq = MaxDist*MaxDist + 1;
+    for(u32 I = 0; I < Frame->FineCount; ++I) {
+        s32 DeltaX = Frame->Fine[I].X - X;
+        s32 DeltaY = Frame->Fine[I].Y - Y;
+        s32 DistSq = DeltaX*DeltaX + DeltaY*DeltaY;
+        if(DistSq < BestDistSq) {
+            Best = I;
+            BestDistSq = DistSq;
+        }
+    }
+    return Best;
+}
+
+// NOTE(nox): Grid points become the corner of their cell that the device draws them at, so the picture
+// doesn't move. Going back, points that end up in the same cell are merged. Points past the limit of the
+// new format are dropped.
+static void setFrameFormat(frame *Frame, u8 Format) {
+    if(Frame->Format == Format) {
+        return;
+    }
+
+    frame Old;
+    memcpy(&Old, Frame, sizeof(Old));
+    initFrame(Frame);
+    Frame->NumMilliseconds = Old.NumMilliseconds;
+    Frame->TweenMs = Old.TweenMs;
+    Frame->Easing = Old.Easing;
+    Frame->Format = Format;
+
+    if(Format == FrameFormat_HighRes) {
+        for(u32 I = 0; I < Old.ActiveCount; ++I) {
+            u32 Cell = Old.Order[I];
+            addFinePoint(Frame, xCoord(Cell, GridSize) << GridToHighResShift,
+                         yCoord(Cell, GridSize) << GridToHighResShift, isPathDisabled(&Old, Cell));
+        }
+    }
+    else {
+        for(u32 I = 0; I < Old.FineCount; ++I) {
+            u32 X = Old.Fine[I].X >> GridToHighResShift;
+            u32 Row = GridSize-1 - (Old.Fine[I].Y >> GridToHighResShift);
+            addPoint(Frame, Row*GridSize + X, isFineBlank(&Old, I));
+        }
+    }
+}
+
+static bool framesEqual(frame *A, frame *B) {
+    if(A->ActiveCount != B->ActiveCount || A->NumMilliseconds != B->NumMilliseconds ||
+       A->TweenMs != B->TweenMs || A->Easing != B->Easing || A->Format != B->Format ||
+       A->FineCount != B->FineCount)
+    {
+        return false;
+    }
+
+    if(A->Format == FrameFormat_HighRes) {
+        return (memcmp(A->Fine, B->Fine, A->FineCount*sizeof(*A->Fine)) == 0 &&
+                memcmp(A->FineBlank, B->FineBlank, sizeof(A->FineBlank)) == 0);
+    }
+
+    for(u32 I = 0; I < GridWordCount; ++I) {
+        if(A->Active[I] != B->Active[I] || A->DisablePathBefore[I] != B->DisablePathBefore[I]) {
+            return false;
+        }
+    }
+    return memcmp(A->Order, B->Order, A->ActiveCount*sizeof(*A->Order)) == 0;
+}
+
+static void optimizeFinePath(frame *Frame) {
+    for(u32 I = 1; I < Frame->FineCount; ++I) {
+        fine_point *Current = Frame->Fine + I-1;
+        u32 Best = I;
+        s32 BestDistSq = INT32_MAX;
+        for(u32 J = I; J < Frame->FineCount; ++J) {
+            s32 DeltaX = Frame->Fine[J].X - Current->X;
+            s32 DeltaY = Frame->Fine[J].Y - Current->Y;
+            s32 DistSq = DeltaX*DeltaX + DeltaY*DeltaY;
+            if(DistSq < BestDistSq) {
+                Best = J;
+                BestDistSq = DistSq;
+            }
+        }
+
+        fine_point Tmp = Frame->Fine[I];
+        Frame->Fine[I] = Frame->Fine[Best];
+        Frame->Fine[Best] = Tmp;
+    }
+
+    memset(Frame->FineBlank, 0, sizeof(Frame->FineBlank));
+    reindexFinePoints(Frame);
+}
+
+// NOTE(nox): Greedy nearest neighbour, starting from the first point of the current path
+static void optimizePath(frame *Frame) {
+    if(Frame->Format == FrameFormat_HighRes) {
+        optimizeFinePath(Frame);
+        return;
+    }
+
+    if(Frame->ActiveCount == 0) {
+        return;
+    }
+
+    u64 Remaining[GridWordCount];
+    memcpy(Remaining, Frame->Active, sizeof(Remaining));
+
+    u32 Current = Frame->Order[0];
+    clearBit(Remaining, Current);
+    u32 NumVisited = 1;
+
+    while(NumVisited < Frame->ActiveCount) {
+        s32 CurrentX = Current % GridSize;
+        s32 CurrentY = Current / GridSize;
+
+        u32 Best = Current;
+        s32 BestDistSq = INT32_MAX;
+        for(u32 Word = 0; Word < GridWordCount; ++Word) {
+            for(u64 Bits = Remaining[Word]; Bits; Bits &= Bits - 1) {
+                u32 Index = (Word << 6) | __builtin_ctzll(Bits);
+                s32 DeltaX = (s32)(Index % GridSize) - CurrentX;
+                s32 DeltaY = (s32)(Index / GridSize) - CurrentY;
+                s32 DistSq = DeltaX*DeltaX + DeltaY*DeltaY;
+                if(DistSq < BestDistSq) {
+                    Best = Index;
+                    BestDistSq = DistSq;
+                }
+            }
+        }
+
+        Frame->OrderIdx[Best] = NumVisited;
+        Frame->Order[NumVisited++] = Best;
+        clearBit(Remaining, Best);
+        Current = Best;
+    }
+
+    memset(Frame->DisablePathBefore, 0, sizeof(Frame->DisablePathBefore));
+}
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Selections
+//
+// A selection is a bitset over the grid cells, just like Frame->Active. Every bulk operation does a
+// single pass over the draw order plus word-wide passes over the bitsets.
+typedef struct {
+    r32 X, Y;
+} grid_pos;
+
+static inline void clearSelection(u64 *Selection) {
+    memset(Selection, 0, GridWordCount*sizeof(*Selection));
+}
+
+static u32 selectionCount(const u64 *Selection) {
+    u32 Result = 0;
+    for(u32 I = 0; I < GridWordCount; ++I) {
+        Result += __builtin_popcountll(Selection[I]);
+    }
+    return Result;
+}
+
+// NOTE(nox): Corners are in grid coordinates (column, row), inclusive and in any order
+static void selectRect(frame *Frame, s32 X0, s32 Y0, s32 X1, s32 Y1, u64 *Selection) {
+    if(X0 > X1) { s32 Tmp = X0; X0 = X1; X1 = Tmp; }
+    if(Y0 > Y1) { s32 Tmp = Y0; Y0 = Y1; Y1 = Tmp; }
+    X0 = clamp(0, X0, GridSize-1); X1 = clamp(0, X1, GridSize-1);
+    Y0 = clamp(0, Y0, GridSize-1); Y1 = clamp(0, Y1, GridSize-1);
+
+    clearSelection(Selection);
+    for(s32 Y = Y0; Y <= Y1; ++Y) {
+        // NOTE(nox): A row is a contiguous run of bits, so this touches at most a couple of words
+        u32 Start = Y*GridSize + X0, End = Y*GridSize + X1 + 1;
+        while(Start < End) {
+            u32 Word = Start >> 6;
+            u32 Count = min((s32)(End - Start), 64 - (s32)(Start & 63));
+            u64 Mask = (Count == 64) ? ~(u64)0 : (((u64)1 << Count) - 1) << (Start & 63);
+            Selection[Word] |= Mask & Frame->Active[Word];
+            Start += Count;
+        }
+    }
+}
+
+// NOTE(nox): Even-odd rule, cell (X, Y) is tested at the point (X, Y) of the polygon's space
+static void selectLasso(frame *Frame, const grid_pos *Poly, u32 PolyCount, u64 *Selection) {
+    clearSelection(Selection);
+    if(PolyCount < 3) {
+        return;
+    }
+
+    for(u32 I = 0; I < Frame->ActiveCount; ++I) {
+        u32 Cell = Frame->Order[I];
+        r32 X = Cell % GridSize, Y = Cell / GridSize;
+
+        bool Inside = false;
+        for(u32 A = 0, B = PolyCount-1; A < PolyCount; B = A++) {
+            if((Poly[A].Y > Y) != (Poly[B].Y > Y) &&
+               X < (Poly[B].X - Poly[A].X)*(Y - Poly[A].Y)/(Poly[B].Y - Poly[A].Y) + Poly[A].X)
+            {
+                Inside = !Inside;
+            }
+        }
+
+        if(Inside) {
+            setBit(Selection, Cell);
+        }
+    }
+}
+
+static void deleteSelection(frame *Frame, const u64 *Selection) {
+    u32 Write = 0;
+    for(u32 Read = 0; Read < Frame->ActiveCount; ++Read) {
+        u16 Cell = Frame->Order[Read];
+        if(!testBit(Selection, Cell)) {
+            Frame->Order[Write] = Cell;
+            Frame->OrderIdx[Cell] = Write++;
+        }
+    }
+    Frame->ActiveCount = Write;
+
+    for(u32 I = 0; I < GridWordCount; ++I) {
+        Frame->Active[I] &= ~Selection[I];
+        Frame->DisablePathBefore[I] &= ~Selection[I];
+    }
+}
+
+// NOTE(nox): Fails (and changes nothing) if a point would leave the grid or land on a point that is not
+// part of the selection. The selection follows the moved points.
+static bool translateSelection(frame *Frame, u64 *Selection, s32 DeltaX, s32 DeltaY) {
+    for(u32 I = 0; I < Frame->ActiveCount; ++I) {
+        u32 Cell = Frame->Order[I];
+        if(testBit(Selection, Cell)) {
+            s32 X = (s32)(Cell % GridSize) + DeltaX;
+            s32 Y = (s32)(Cell / GridSize) + DeltaY;
+            if(X < 0 || X >= GridSize || Y < 0 || Y >= GridSize) {
+                return false;
+            }
+
+            u32 Target = Y*GridSize + X;
+            if(isActive(Frame, Target) && !testBit(Selection, Target)) {
+                return false;
+            }
+        }
+    }
+
+    u64 OldDisabled[GridWordCount];
+    memcpy(OldDisabled, Frame->DisablePathBefore, sizeof(OldDisabled));
+    for(u32 I = 0; I < GridWordCount; ++I) {
+        Frame->Active[I] &= ~Selection[I];
+        Frame->DisablePathBefore[I] &= ~Selection[I];
+    }
+
+    u64 OldSelection[GridWordCount];
+    memcpy(OldSelection, Selection, sizeof(OldSelection));
+    clearSelection(Selection);
+
+    s32 Delta = DeltaY*GridSize + DeltaX;
+    for(u32 I = 0; I < Frame->ActiveCount; ++I) {
+        u32 Cell = Frame->Order[I];
+        if(testBit(OldSelection, Cell)) {
+            u32 Target = Cell + Delta;
+            Frame->Order[I] = Target;
+            Frame->OrderIdx[Target] = I;
+            setBit(Frame->Active, Target);
+            assignBit(Frame->DisablePathBefore, Target, testBit(OldDisabled, Cell));
+            setBit(Selection, Target);
+        }
+    }
+
+    return true;
+}
+
+// NOTE(nox): Reverses the part of the path between the first and the last selected points. Blanking
+// belongs to the segment that ends at a point, so the flags inside the range are carried along with their
+// segments (the segment entering the range keeps its flag).
+static void reverseSelection(frame *Frame, const u64 *Selection) {
+    s32 First = -1, Last = -1;
+    for(u32 I = 0; I < Frame->ActiveCount; ++I) {
+        if(testBit(Selection, Frame->Order[I])) {
+            if(First < 0) {
+                First = I;
+            }
+            Last = I;
+        }
+    }
+    if(First < 0 || First == Last) {
+        return;
+    }
+
+    bool SegmentDisabled[MaxActive];
+    for(s32 I = First; I <= Last; ++I) {
+        SegmentDisabled[I] = isPathDisabled(Frame, Frame->Order[I]);
+    }
+
+    for(s32 A = First, B = Last; A < B; ++A, --B) {
+        u16 Tmp = Frame->Order[A];
+        Frame->Order[A] = Frame->Order[B];
+        Frame->Order[B] = Tmp;
+    }
+
+    for(s32 I = First; I <= Last; ++I) {
+        u16 Cell = Frame->Order[I];
+        Frame->OrderIdx[Cell] = I;
+        // NOTE(nox): The segment (I-1 -> I) was (First+Last-I -> First+Last-I+1) before reversing
+        bool Disabled = (I == First) ? SegmentDisabled[First] : SegmentDisabled[First + Last - I + 1];
+        assignBit(Frame->DisablePathBefore, Cell, Disabled);
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Frame arena
+//
+// Frames live in fixed-size chunks that are never moved or freed while the arena is alive, so a
+// handle (slot index) and the frame pointer it resolves to stay valid for as long as the frame exists.
+// The animation itself is the Sequence of handles, so inserting, deleting, duplicating or reordering
+// frames only moves 4-byte handles around.
+enum {
+    FramesPerChunk = 32,
+};
+
+typedef u32 frame_handle;
+
+typedef struct {
+    frame **Chunks;
+    u32 ChunkCount;
+
+    frame_handle *FreeSlots;
+    u32 FreeCount;
+
+    frame_handle *Sequence;
+    u32 Count;
+    u32 Capacity;
+} frame_arena;
+
+static inline frame *getFrame(frame_arena *Arena, frame_handle Handle) {
+    assert(Handle < Arena->ChunkCount*FramesPerChunk);
+    return Arena->Chunks[Handle / FramesPerChunk] + (Handle % FramesPerChunk);
+}
+
+static inline frame *frameAt(frame_arena *Arena, u32 Idx) {
+    assert(Idx < Arena->Count);
+    return getFrame(Arena, Arena->Sequence[Idx]);
+}
+
+static frame_handle allocFrameSlot(frame_arena *Arena) {
+    if(Arena->FreeCount == 0) {
+        u32 Chunk = Arena->ChunkCount++;
+        Arena->Chunks = (frame **)realloc(Arena->Chunks, Arena->ChunkCount*sizeof(*Arena->Chunks));
+        Arena->Chunks[Chunk] = (frame *)malloc(FramesPerChunk*sizeof(frame));
+        Arena->FreeSlots = (frame_handle *)realloc(Arena->FreeSlots,
+                                                   Arena->ChunkCount*FramesPerChunk*sizeof(*Arena->FreeSlots));
+        assert(Arena->Chunks && Arena->Chunks[Chunk] && Arena->FreeSlots);
+
+        // NOTE(nox): Pushed in reverse so that slots are handed out in ascending order
+        for(u32 I = FramesPerChunk; I > 0; --I) {
+            Arena->FreeSlots[Arena->FreeCount++] = Chunk*FramesPerChunk + I-1;
+        }
+    }
+
+    return Arena->FreeSlots[--Arena->FreeCount];
+}
+
+// NOTE(nox): Inserts a new frame so that it ends up at sequence position Idx (Idx <= Count)
+static frame *insertFrame(frame_arena *Arena, u32 Idx) {
+    assert(Idx <= Arena->Count);
+
+    if(Arena->Count == Arena->Capacity) {
+        Arena->Capacity = Arena->Capacity ? 2*Arena->Capacity : (u32)FramesPerChunk;
+        Arena->Sequence = (frame_handle *)realloc(Arena->Sequence, Arena->Capacity*sizeof(*Arena->Sequence));
+        assert(Arena->Sequence);
+    }
+
+    frame_handle Handle = allocFrameSlot(Arena);
+    memmove(Arena->Sequence + Idx + 1, Arena->Sequence + Idx, (Arena->Count - Idx)*sizeof(*Arena->Sequence));
+    Arena->Sequence[Idx] = Handle;
+    ++Arena->Count;
+
+    frame *Frame = getFrame(Arena, Handle);
+    initFrame(Frame);
+    return Frame;
+}
+
+static inline frame *appendFrame(frame_arena *Arena) {
+    return insertFrame(Arena, Arena->Count);
+}
+
+// NOTE(nox): The copy is placed right after the original
+static frame *duplicateFrame(frame_arena *Arena, u32 Idx) {
+    frame *Copy = insertFrame(Arena, Idx + 1);
+    memcpy(Copy, frameAt(Arena, Idx), sizeof(*Copy));
+    return Copy;
+}
+
+static void deleteFrame(frame_arena *Arena, u32 Idx) {
+    assert(Idx < Arena->Count);
+    Arena->FreeSlots[Arena->FreeCount++] = Arena->Sequence[Idx];
+    --Arena->Count;
+    memmove(Arena->Sequence + Idx, Arena->Sequence + Idx + 1, (Arena->Count - Idx)*sizeof(*Arena->Sequence));
+}
+
+static void moveFrame(frame_arena *Arena, u32 From, u32 To) {
+    assert(From < Arena->Count && To < Arena->Count);
+    frame_handle Handle = Arena->Sequence[From];
+    if(From < To) {
+        memmove(Arena->Sequence + From, Arena->Sequence + From + 1, (To - From)*sizeof(*Arena->Sequence));
+    } else {
+        memmove(Arena->Sequence + To + 1, Arena->Sequence + To, (From - To)*sizeof(*Arena->Sequence));
+    }
+    Arena->Sequence[To] = Handle;
+}
+
+// NOTE(nox): Drops every frame but keeps the chunks around for reuse
+static void clearArena(frame_arena *Arena) {
+    while(Arena->Count) {
+        deleteFrame(Arena, Arena->Count - 1);
+    }
+}
+
+static void freeArena(frame_arena *Arena) {
+    for(u32 I = 0; I < Arena->ChunkCount; ++I) {
+        free(Arena->Chunks[I]);
+    }
+    free(Arena->Chunks);
+    free(Arena->FreeSlots);
+    free(Arena->Sequence);
+    *Arena = (frame_arena){};
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Files and device output
+static inline u32 calculateFps(u32 PointCount) {
+    // NOTE(nox): Assuming each point takes 100us
+    return 1000/(PointCount/10 + 3);
+}
+
+// NOTE(nox): .anim files
+//
+// Version 1 is the protocol-like format the editor used to write: MagicNumber, a u16 length (so it never
+// grows past MaxPacketSize), a u32 frame count and, per frame, u32 milliseconds, u32 point count and a u32
+// cell index + u8 "disable path before" flag per point. It is only read now.
+//
+// Version 2 (all little endian, offsets from the start of the file):
+//
+//   Header                 anim_file_header
+//   Frame table            FrameCount entries of anim_frame_entry
+//   Frame chunks           One per frame, wherever its table entry says
+//
+// With AnimEncoding_Cell16, a chunk holds PointCount u16 values in draw order: the cell index in the low
+// bits and AnimPointBlank when drawing before moving to the point is disabled. High resolution frames use
+// AnimEncoding_Fine32, with X in the low 12 bits, Y in the next 12 and AnimFineBlank. Frames with a tween
+// to the next one have an anim_tween after their points, counted in Size, which readers that only take
+// PointCount points skip. Since every frame can be found through the table, a frame can be read straight
+// out of a mapping of the file without parsing anything else.
+enum {
+    AnimFileVersion = 2,
+    AnimPointBlank = 1<<15,
+    AnimPointCellMask = AnimPointBlank - 1,
+};
+
+static const u32 AnimFineBlank = 1u<<31;
+
+typedef enum : u8 {
+    AnimEncoding_Cell16,
+    AnimEncoding_Fine32,
+} anim_encoding;
+
+typedef struct {
+    u8 Magic[4]; // NOTE(nox): "ANIM", v1 files start with MagicNumber instead
+    u16 Version;
+    u16 GridSize;
+    u32 FrameCount;
+    u32 FrameTableOffset;
+} anim_file_header;
+
+typedef struct {
+    u32 Offset;
+    u32 Size;
+    u32 NumMilliseconds;
+    u16 PointCount;
+    u8 Encoding;
+    u8 Reserved;
+} anim_frame_entry;
+
+typedef struct {
+    u8 *Data;
+    u64 Size;
+    anim_file_header *Header;
+    anim_frame_entry *FrameTable;
+} anim_file;
+
+typedef struct {
+    u16 TweenMs;
+    u8 Easing;
+    u8 Reserved;
+} anim_tween;
+
+static const u8 AnimFileMagic[4] = {'A', 'N', 'I', 'M'};
+
+static void closeAnimFile(anim_file *File) {
+    if(File->Data) {
+        munmap(File->Data, File->Size);
+    }
+    *File = (anim_file){};
+}
+
+// NOTE(nox): Maps a v2 file and validates its header and frame table; the frames themselves are only
+// checked when they are read.
+static bool openAnimFile(const char *Path, anim_file *File) {
+    *File = (anim_file){};
+
+    int Fd = open(Path, O_RDONLY);
+    if(Fd < 0) {
+        return false;
+    }
+
+    struct stat Stat;
+    if(fstat(Fd, &Stat) == 0 && Stat.st_size >= (off_t)sizeof(anim_file_header)) {
+        void *Data = mmap(0, Stat.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+        if(Data != MAP_FAILED) {
+            File->Data = (u8 *)Data;
+            File->Size = Stat.st_size;
+        }
+    }
+    close(Fd);
+
+    if(!File->Data) {
+        return false;
+    }
+
+    File->Header = (anim_file_header *)File->Data;
+    anim_file_header *Header = File->Header;
+    u64 TableEnd = (u64)Header->FrameTableOffset + (u64)Header->FrameCount*sizeof(anim_frame_entry);
+    if(memcmp(Header->Magic, AnimFileMagic, sizeof(AnimFileMagic)) != 0 || Header->Version != AnimFileVersion ||
+       Header->GridSize != GridSize || (Header->FrameTableOffset % alignof(anim_frame_entry)) != 0 ||
+       TableEnd > File->Size)
+    {
+        closeAnimFile(File);
+        return false;
+    }
+
+    File->FrameTable = (anim_frame_entry *)(File->Data + Header->FrameTableOffset);
+    return true;
+}
+
+// NOTE(nox): Returns the points of a frame inside the mapping (u16 or u32 values, depending on the
+// encoding), or 0 if the frame is malformed
+static const void *animFramePoints(anim_file *File, u32 FrameIdx, anim_frame_entry **Entry) {
+    assert(FrameIdx < File->Header->FrameCount);
+    *Entry = File->FrameTable + FrameIdx;
+
+    anim_frame_entry *E = *Entry;
+    u32 PointSize = E->Encoding == AnimEncoding_Fine32 ? sizeof(u32) : sizeof(u16);
+    u32 MaxPoints = E->Encoding == AnimEncoding_Fine32 ? (u32)MaxHighResPoints : (u32)MaxActive;
+    if(E->Encoding > AnimEncoding_Fine32 || E->PointCount > MaxPoints || (E->Offset % PointSize) != 0 ||
+       E->Size < E->PointCount*PointSize || (u64)E->Offset + E->Size > File->Size)
+    {
+        return 0;
+    }
+    return File->Data + E->Offset;
+}
+
+static bool loadAnimationV2(const char *Path, frame_arena *Arena) {
+    anim_file File;
+    if(!openAnimFile(Path, &File)) {
+        return false;
+    }
+
+    // NOTE(nox): Every frame is checked before the arena is touched, a bad one fails the whole file
+    for(u32 I = 0; I < File.Header->FrameCount; ++I) {
+        anim_frame_entry *Entry;
+        if(!animFramePoints(&File, I, &Entry)) {
+            closeAnimFile(&File);
+            return false;
+        }
+    }
+
+    clearArena(Arena);
+    for(u32 I = 0; I < File.Header->FrameCount; ++I) {
+        anim_frame_entry *Entry;
+        const void *Points = animFramePoints(&File, I, &Entry);
+        frame *Frame = appendFrame(Arena);
+        u32 PointsSize = Entry->PointCount*(Entry->Encoding == AnimEncoding_Fine32 ? sizeof(u32) : sizeof(u16));
+        if(Points && Entry->Size >= PointsSize + sizeof(anim_tween)) {
+            anim_tween Tween;
+            memcpy(&Tween, (const u8 *)Points + PointsSize, sizeof(Tween));
+            Frame->TweenMs = Tween.TweenMs;
+            Frame->Easing = Tween.Easing < EaseCount ? Tween.Easing : (u8)Ease_Linear;
+        }
+        if(Points && Entry->Encoding == AnimEncoding_Fine32) {
+            const u32 *Fine = (const u32 *)Points;
+            Frame->NumMilliseconds = Entry->NumMilliseconds;
+            Frame->Format = FrameFormat_HighRes;
+            for(u32 J = 0; J < Entry->PointCount; ++J) {
+                addFinePoint(Frame, Fine[J] & HighResMax, (Fine[J] >> 12) & HighResMax, Fine[J] & AnimFineBlank);
+            }
+        }
+        else if(Points) {
+            const u16 *Cells = (const u16 *)Points;
+            Frame->NumMilliseconds = Entry->NumMilliseconds;
+            for(u32 J = 0; J < Entry->PointCount; ++J) {
+                addPoint(Frame, Cells[J] & AnimPointCellMask, Cells[J] & AnimPointBlank);
+            }
+        }
+    }
+
+    if(Arena->Count == 0) {
+        appendFrame(Arena);
+    }
+    closeAnimFile(&File);
+    return true;
+}
+
+static bool readFileToBuffer(FILE *File, buff *Buff) {
+    fseek(File, 0, SEEK_END);
+    u64 FileLength = ftell(File);
+    rewind(File);
+
+    if(FileLength > MaxPacketSize) {
+        return false;
+    }
+    Buff->Write = fread(Buff->Data, 1, FileLength, File);
+    return Buff->Write == FileLength;
+}
+
+static bool loadAnimationV1(const char *Path, frame_arena *Arena) {
+    FILE *File = fopen(Path, "rb");
+    if(!File) {
+        return false;
+    }
+
+    buff Buff = {};
+    bool Result = readFileToBuffer(File, &Buff);
+    fclose(File);
+
+    // NOTE(nox): Parse protocol out of file
+    if(!Result || !hasAvailable(&Buff, 1+2+4) || readU8(&Buff) != MagicNumber) {
+        return false;
+    }
+
+    u16 Length = readU16(&Buff);
+    if(!hasAvailable(&Buff, Length)) {
+        return false;
+    }
+
+    // NOTE(nox): Walk the frames once without keeping anything, so a truncated file fails before the arena
+    // is cleared
+    u32 FrameCount = readU32(&Buff);
+    u32 FramesStart = Buff.Read;
+    for(u32 I = 0; I < FrameCount; ++I) {
+        if(!hasAvailable(&Buff, 4+4)) {
+            return false;
+        }
+        Buff.Read += 4;
+        u32 ActiveCount = readU32(&Buff);
+        if(ActiveCount > MaxActive || !hasAvailable(&Buff, ActiveCount*(4+1))) {
+            return false;
+        }
+        Buff.Read += ActiveCount*(4+1);
+    }
+    Buff.Read = FramesStart;
+
+    clearArena(Arena);
+    for(u32 I = 0; I < FrameCount; ++I) {
+        frame *Frame = appendFrame(Arena);
+        Frame->NumMilliseconds = readU32(&Buff);
+        u32 ActiveCount = readU32(&Buff);
+        for(u32 J = 0; J < ActiveCount; ++J) {
+            u32 Index = readU32(&Buff);
+            bool DisablePathBefore = readU8(&Buff);
+            addPoint(Frame, Index, DisablePathBefore);
+        }
+    }
+
+    if(Arena->Count == 0) {
+        appendFrame(Arena);
+    }
+    return true;
+}
+
+// NOTE(nox): On success the arena holds exactly the frames of the file, otherwise it is left untouched
+static bool loadAnimation(const char *Path, frame_arena *Arena) {
+    return loadAnimationV2(Path, Arena) || loadAnimationV1(Path, Arena);
+}
+
+// NOTE(nox): Always writes version 2
+static bool saveAnimation(const char *Path, frame_arena *Arena) {
+    FILE *File = fopen(Path, "wb");
+    if(!File) {
+        return false;
+    }
+
+    anim_file_header Header = {};
+    memcpy(Header.Magic, AnimFileMagic, sizeof(AnimFileMagic));
+    Header.Version = AnimFileVersion;
+    Header.GridSize = GridSize;
+    Header.FrameCount = Arena->Count;
+    Header.FrameTableOffset = sizeof(Header);
+    fwrite(&Header, sizeof(Header), 1, File);
+
+    // NOTE(nox): Fine32 chunks are aligned to 4 bytes, Cell16 ones always end up aligned to 2
+    u32 Offset = Header.FrameTableOffset + Arena->Count*sizeof(anim_frame_entry);
+    for(u32 I = 0; I < Arena->Count; ++I) {
+        frame *Frame = frameAt(Arena, I);
+        anim_frame_entry Entry = {};
+        Entry.NumMilliseconds = Frame->NumMilliseconds;
+        Entry.PointCount = framePointCount(Frame);
+        if(Frame->Format == FrameFormat_HighRes) {
+            Offset = (Offset + 3) & ~3u;
+            Entry.Size = Frame->FineCount*sizeof(u32);
+            Entry.Encoding = AnimEncoding_Fine32;
+        }
+        else {
+            Entry.Size = Frame->ActiveCount*sizeof(u16);
+            Entry.Encoding = AnimEncoding_Cell16;
+        }
+        if(Frame->TweenMs > 0) {
+            Entry.Size += sizeof(anim_tween);
+        }
+        Entry.Offset = Offset;
+        fwrite(&Entry, sizeof(Entry), 1, File);
+        Offset += Entry.Size;
+    }
+
+    for(u32 I = 0; I < Arena->Count; ++I) {
+        frame *Frame = frameAt(Arena, I);
+        if(Frame->Format == FrameFormat_HighRes) {
+            static const u8 Padding[4] = {};
+            fwrite(Padding, 1, (4 - (ftell(File) & 3)) & 3, File);
+
+            u32 Points[MaxHighResPoints];
+            for(u32 J = 0; J < Frame->FineCount; ++J) {
+                fine_point *Point = Frame->Fine + J;
+                Points[J] = Point->X | (Point->Y << 12) | (isFineBlank(Frame, J) ? AnimFineBlank : 0);
+            }
+            fwrite(Points, sizeof(*Points), Frame->FineCount, File);
+        }
+        else {
+            u16 Points[MaxActive];
+            for(u32 J = 0; J < Frame->ActiveCount; ++J) {
+                u16 Cell = Frame->Order[J];
+                Points[J] = Cell | (isPathDisabled(Frame, Cell) ? AnimPointBlank : 0);
+            }
+            fwrite(Points, sizeof(*Points), Frame->ActiveCount, File);
+        }
+
+        if(Frame->TweenMs > 0) {
+            anim_tween Tween = {};
+            Tween.TweenMs = min(Frame->TweenMs, UINT16_MAX);
+            Tween.Easing = Frame->Easing;
+            fwrite(&Tween, sizeof(Tween), 1, File);
+        }
+    }
+
+    bool Result = ferror(File) == 0;
+    fclose(File);
+    return Result;
+}
+
+// NOTE(nox): The payload of Command_UpdateFrameHighRes after the header, see highResFrameSize
+static u32 packFinePoints(frame *Frame, u8 *Packed) {
+    u8 *Blanks = Packed + 3*Frame->FineCount;
+    memset(Blanks, 0, (Frame->FineCount + 7)/8);
+    for(u32 I = 0; I < Frame->FineCount; ++I) {
+        packHighResPoint(Packed, I, Frame->Fine[I].X, Frame->Fine[I].Y);
+        setHighResBlank(Blanks, I, isFineBlank(Frame, I));
+    }
+    return highResFrameSize(Frame->FineCount);
+}
+
+static const char *const EasingNames[] = {"Linear", "Ease in", "Ease out", "Ease in and out"};
+static_assert(arrayCount(EasingNames) == EaseCount, "An easing has no name");
+
+// NOTE(nox): Frames drawn on the way to the next frame, one per refresh, 0 without a tween
+static u32 frameTweenCount(frame *Frame, u32 Fps) {
+    return Frame->TweenMs > 0 ? clamp(1, frameRepeatCount(Frame->TweenMs, Fps), UINT16_MAX) : 0;
+}
+
+static void writeFrame(buff *Buff, frame *Frame, u8 FrameIdx) {
+    u32 Fps = calculateFps(framePointCount(Frame));
+    writeHeader(Buff, Frame->Format == FrameFormat_HighRes ? Command_UpdateFrameHighRes : Command_UpdateFrame);
+    writeU8(Buff, FrameIdx);
+    writeU16(Buff, Fps);
+    writeU16(Buff, frameRepeatCount(Frame->NumMilliseconds, Fps));
+    writeU16(Buff, framePointCount(Frame));
+
+    if(Frame->Format == FrameFormat_HighRes) {
+        Buff->Write += packFinePoints(Frame, Buff->Data + Buff->Write);
+    }
+    else {
+        for(u32 J = 0; J < Frame->ActiveCount; ++J) {
+            u32 ActiveIndex = Frame->Order[J];
+            u8 X = xCoord(ActiveIndex, GridSize) | (isPathDisabled(Frame, ActiveIndex) ? ZDisableBit : 0);
+            u8 Y = yCoord(ActiveIndex, GridSize);
+            writeU8(Buff, X);
+            writeU8(Buff, Y);
+        }
+    }
+
+    u32 TweenCount = frameTweenCount(Frame, Fps);
+    if(TweenCount) {
+        writeU16(Buff, TweenCount);
+        writeU8(Buff, Frame->Easing);
+    }
+}
+
+// NOTE(nox): Count frames starting at First, as the AnimationData.h initializer of one animation
+static void exportCArray(frame_arena *Arena, u32 First, u32 Count, FILE *Out) {
+#define I1 "    "
+#define I2 "      "
+#define I3 "          "
+#define I4 "              "
+#define I5 "                 "
+    fprintf(Out, I1 "{ %d,\n" I2 "{", Count);
+    for(u32 I = 0; I < Count; ++I) {
+        frame *Frame = frameAt(Arena, First + I);
+        u32 Fps = calculateFps(framePointCount(Frame));
+        fprintf(Out, "\n" I3 "{\n" I4 "%d, %d, %d, {", Fps,
+                frameRepeatCount(Frame->NumMilliseconds, Fps), framePointCount(Frame));
+
+        if(Frame->Format == FrameFormat_HighRes) {
+            // NOTE(nox): The packed bytes go in the points, two at a time, see Animations.h
+            u8 Packed[highResFrameSize(MaxHighResPoints) + 1] = {};
+            u32 Size = packFinePoints(Frame, Packed);
+            for(u32 J = 0; J < Size; J += 2) {
+                if((J % 14) == 0) {
+                    fprintf(Out, "\n" I5);
+                }
+                fprintf(Out, " {%d, %d},", Packed[J], Packed[J+1]);
+            }
+            fprintf(Out, "\n" I4 "}, FrameFormat_HighRes");
+        }
+        else {
+            for(u32 J = 0; J < Frame->ActiveCount; ++J) {
+                if((J % 7) == 0) {
+                    fprintf(Out, "\n" I5);
+                }
+                u32 ActiveIndex = Frame->Order[J];
+                u32 X = xCoord(ActiveIndex, GridSize);
+                u32 Y = yCoord(ActiveIndex, GridSize);
+                fprintf(Out, " {%d, %d},", X | (isPathDisabled(Frame, ActiveIndex) ? ZDisableBit : 0), Y);
+            }
+            fprintf(Out, "\n" I4 "}");
+        }
+
+        // NOTE(nox): Format can only be left out when the tween is too
+        u32 TweenCount = frameTweenCount(Frame, Fps);
+        if(TweenCount) {
+            fprintf(Out, "%s, %d, %d", Frame->Format == FrameFormat_HighRes ? "" : ", FrameFormat_Grid",
+                    TweenCount, Frame->Easing);
+        }
+        fprintf(Out, "\n" I3 "},");
+    }
+    fprintf(Out, "\n" I2 "}\n" I1 "},");
+#undef I1
+#undef I2
+#undef I3
+#undef I4
+#undef I5
+}
@@ -0,0 +1,421 @@
+// NOTE(nox): Microbenchmarks of the hot paths of the control application and of the firmware's packet
+// decoding, on synthetic animations like the ones drawn in the editor (1 to 300 points per frame, strokes
+// with a few jumps). Every benchmark prints ns/op, bytes/s (where bytes make sense) and heap allocations
+// per op. With --json there is one JSON object per line instead of the table, which is what should be kept
+// around to compare versions.
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <common.h>
+#include <protocol.hpp>
+
+// NOTE(nox): Only the heap allocations of the code under test are counted, the ones libc makes on its own
+// (e.g. in fopen) are not
+static u64 BenchAllocs;
+
+static void *benchMalloc(size_t Size) {
+    ++BenchAllocs;
+    return malloc(Size);
+}
+
+static void *benchRealloc(void *Ptr, size_t Size) {
+    ++BenchAllocs;
+    return realloc(Ptr, Size);
+}
+
+#define malloc(Size) benchMalloc(Size)
+#define realloc(Ptr, Size) benchRealloc(Ptr, Size)
+#include "animation.cpp"
+#undef realloc
+#undef malloc
+
+// NOTE(nox): The firmware's RX path, built for the host. Only decodeRx and processRx are used, the registers
+// are here so that the rest of Link.h compiles.
+static struct { u32 UTXBF; } U1STAbits;
+static u32 U1TXREG;
+#include "../MCU/src/Link.h"
+
+static u32 HandledPackets;
+static void handlePacket(u8 Command, u16 Length) {
+    HandledPackets += Command + Length;
+}
+
+static volatile u32 BenchSink; // NOTE(nox): Results go here so the work is not optimized away
+
+enum {
+    BenchBatches = 5,
+    BenchMinBatchNs = 20*1000*1000,
+    BenchFrameCount = 64,
+};
+
+typedef struct {
+    const char *Filter;
+    const char *Label;
+    bool Json;
+} bench_options;
+
+typedef struct {
+    u64 Iterations;
+    u64 BytesPerOp;
+    double NsPerOp;
+    double AllocsPerOp;
+} bench_result;
+
+typedef void bench_fn(void *Data, u64 Iterations);
+
+static u64 nowNs() {
+    timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (u64)Time.tv_sec*1000000000ull + Time.tv_nsec;
+}
+
+// NOTE(nox): The iteration count is doubled until a batch takes BenchMinBatchNs, then the fastest of
+// BenchBatches batches is kept, which is the least disturbed by the rest of the machine
+static bench_result runBench(bench_fn *Fn, void *Data, u64 BytesPerOp) {
+    u64 Iterations = 1;
+    for(;;) {
+        u64 Start = nowNs();
+        Fn(Data, Iterations);
+        if(nowNs() - Start >= BenchMinBatchNs || Iterations >= (1ull << 40)) {
+            break;
+        }
+        Iterations *= 2;
+    }
+
+    bench_result Result = {};
+    Result.Iterations = Iterations;
+    Result.BytesPerOp = BytesPerOp;
+    Result.NsPerOp = 1e300;
+    for(u32 I = 0; I < BenchBatches; ++I) {
+        u64 Allocs = BenchAllocs;
+        u64 Start = nowNs();
+        Fn(Data, Iterations);
+        u64 Elapsed = nowNs() - Start;
+        if((double)Elapsed / Iterations < Result.NsPerOp) {
+            Result.NsPerOp = (double)Elapsed / Iterations;
+        }
+        Result.AllocsPerOp = (double)(BenchAllocs - Allocs) / Iterations;
+    }
+    return Result;
+}
+
+static void reportBench(bench_options *Options, const char *Name, bench_fn *Fn, void *Data, u64 BytesPerOp) {
+    if(Options->Filter && !strstr(Name, Options->Filter)) {
+        return;
+    }
+
+    bench_result Result = runBench(Fn, Data, BytesPerOp);
+    double BytesPerSec = BytesPerOp ? BytesPerOp*1e9 / Result.NsPerOp : 0;
+    if(Options->Json) {
+        printf("{\"label\": \"%s\", \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, "
+               "\"bytes_per_op\": %llu, \"bytes_per_s\": %.0f, \"allocs_per_op\": %.3f}\n",
+               Options->Label, Name, (unsigned long long)Result.Iterations, Result.NsPerOp,
+               (unsigned long long)BytesPerOp, BytesPerSec, Result.AllocsPerOp);
+    }
+    else if(BytesPerOp) {
+        printf("%-28s %12.1f ns/op %10.1f MB/s %8.2f allocs/op\n", Name, Result.NsPerOp,
+               BytesPerSec / (1024*1024), Result.AllocsPerOp);
+    }
+    else {
+        printf("%-28s %12.1f ns/op %15s %8.2f allocs/op\n", Name, Result.NsPerOp, "",
+               Result.AllocsPerOp);
+    }
+    fflush(stdout);
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Synthetic animations
+static u32 BenchRandomState = 0x2545F491;
+
+static u32 benchRandom() {
+    // NOTE(nox): xorshift32, the same numbers on every machine so runs can be compared
+    u32 X = BenchRandomState;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    return BenchRandomState = X;
+}
+
+// NOTE(nox): Strokes that wander around the grid a cell or two at a time and jump somewhere else (with the
+// beam off) every few dozen points, which is what hand drawn frames look like
+static void fillFrame(frame *Frame, u32 PointCount) {
+    clearFrame(Frame);
+    s32 X = benchRandom() % GridSize;
+    s32 Y = benchRandom() % GridSize;
+    bool Jump = false;
+    for(u32 Tries = 0; Frame->ActiveCount < PointCount && Tries < 100*PointCount; ++Tries) {
+        if(benchRandom() % 32 == 0) {
+            X = benchRandom() % GridSize;
+            Y = benchRandom() % GridSize;
+            Jump = true;
+        }
+        else {
+            X = clamp(0, X + (s32)(benchRandom() % 5) - 2, GridSize-1);
+            Y = clamp(0, Y + (s32)(benchRandom() % 5) - 2, GridSize-1);
+        }
+
+        if(addPoint(Frame, Y*GridSize + X, Jump)) {
+            Jump = false;
+        }
+    }
+}
+
+static void fillFineFrame(frame *Frame, u32 PointCount) {
+    setFrameFormat(Frame, FrameFormat_HighRes);
+    clearFrame(Frame);
+    s32 X = benchRandom() % (HighResMax+1);
+    s32 Y = benchRandom() % (HighResMax+1);
+    for(u32 Tries = 0; Frame->FineCount < PointCount && Tries < 100*PointCount; ++Tries) {
+        X = clamp(0, X + (s32)(benchRandom() % 257) - 128, (s32)HighResMax);
+        Y = clamp(0, Y + (s32)(benchRandom() % 257) - 128, (s32)HighResMax);
+        addFinePoint(Frame, X, Y);
+    }
+}
+
+// NOTE(nox): Point counts spread over the whole 1-300 range, with more small frames than big ones
+static void fillAnimation(frame_arena *Arena) {
+    clearArena(Arena);
+    for(u32 I = 0; I < BenchFrameCount; ++I) {
+        u32 Unit = benchRandom() % 1000;
+        fillFrame(appendFrame(Arena), 1 + (Unit*Unit*(MaxActive-1)) / (1000*1000));
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Benchmarks
+typedef struct {
+    buff Packet; // NOTE(nox): Not finalized
+    buff Stuffed;
+    u8 Stream[sizeof(Rx.Data)]; // NOTE(nox): Delimiter and stuffed packet, as they come from the UART
+    u32 StreamSize;
+} packet_bench;
+
+static void preparePacket(packet_bench *Bench, frame *Frame) {
+    *Bench = (packet_bench){};
+    writeFrame(&Bench->Packet, Frame, 0);
+
+    buff Packet = Bench->Packet;
+    finalizePacket(&Packet, &Bench->Stuffed);
+    Bench->Stream[0] = 0;
+    memcpy(Bench->Stream + 1, Bench->Stuffed.Data, Bench->Stuffed.Write);
+    Bench->StreamSize = Bench->Stuffed.Write + 1;
+    assert(Bench->StreamSize < sizeof(Rx.Data));
+}
+
+static void benchFinalize(void *Data, u64 Iterations) {
+    packet_bench *Bench = (packet_bench *)Data;
+    buff Stuffed;
+    for(u64 I = 0; I < Iterations; ++I) {
+        finalizePacket(&Bench->Packet, &Stuffed);
+        BenchSink = Stuffed.Write;
+    }
+}
+
+static void benchUnstuff(void *Data, u64 Iterations) {
+    packet_bench *Bench = (packet_bench *)Data;
+    buff Pkt;
+    for(u64 I = 0; I < Iterations; ++I) {
+        u8 Command;
+        u16 Length;
+        unstuffBytes(&Bench->Stuffed, &Pkt);
+        BenchSink = readPacketHeader(&Pkt, &Command, &Length) ? Length : 0;
+    }
+}
+
+// NOTE(nox): Every iteration hands the firmware one complete packet in the RX ring, like after a burst
+static void benchDecodeRx(void *Data, u64 Iterations) {
+    packet_bench *Bench = (packet_bench *)Data;
+    memcpy(Rx.Data, Bench->Stream, Bench->StreamSize);
+    for(u64 I = 0; I < Iterations; ++I) {
+        Rx.Read = 0;
+        Rx.Write = Bench->StreamSize;
+        Rx.NewPacketCount = 1;
+        SkipPacket = true; // NOTE(nox): Done with the previous packet, waiting for a delimiter
+        processRx();
+    }
+    BenchSink = HandledPackets;
+}
+
+// NOTE(nox): What a frame upload does to the buffer, 300 points and the header fields
+static void benchWriteRead(void *Data, u64 Iterations) {
+    (void)Data;
+    buff Buff;
+    for(u64 I = 0; I < Iterations; ++I) {
+        resetBuff(&Buff);
+        writeU32(&Buff, (u32)I);
+        writeU16(&Buff, 1000);
+        for(u32 J = 0; J < MaxActive; ++J) {
+            writeU8(&Buff, (u8)J);
+            writeU8(&Buff, (u8)(J >> 2));
+        }
+
+        u32 Sum = readU32(&Buff) + readU16(&Buff);
+        for(u32 J = 0; J < MaxActive; ++J) {
+            Sum += readU8(&Buff);
+            Sum += readU8(&Buff);
+        }
+        BenchSink = Sum;
+    }
+}
+
+typedef struct {
+    frame Original;
+    frame Work;
+} optimize_bench;
+
+// NOTE(nox): Includes restoring the frame, which is a small memcpy next to the path search
+static void benchOptimize(void *Data, u64 Iterations) {
+    optimize_bench *Bench = (optimize_bench *)Data;
+    for(u64 I = 0; I < Iterations; ++I) {
+        memcpy(&Bench->Work, &Bench->Original, sizeof(Bench->Work));
+        optimizePath(&Bench->Work);
+        BenchSink = framePointCount(&Bench->Work);
+    }
+}
+
+typedef struct {
+    frame_arena *Arena;
+    frame_arena Loaded;
+    const char *Path;
+} file_bench;
+
+static void benchSave(void *Data, u64 Iterations) {
+    file_bench *Bench = (file_bench *)Data;
+    for(u64 I = 0; I < Iterations; ++I) {
+        BenchSink = saveAnimation(Bench->Path, Bench->Arena);
+    }
+}
+
+static void benchLoad(void *Data, u64 Iterations) {
+    file_bench *Bench = (file_bench *)Data;
+    for(u64 I = 0; I < Iterations; ++I) {
+        BenchSink = loadAnimation(Bench->Path, &Bench->Loaded);
+    }
+}
+
+typedef struct {
+    frame_arena *Arena;
+    FILE *Out;
+} export_bench;
+
+static void benchExport(void *Data, u64 Iterations) {
+    export_bench *Bench = (export_bench *)Data;
+    for(u64 I = 0; I < Iterations; ++I) {
+        rewind(Bench->Out);
+        exportCArray(Bench->Arena, 0, min((s32)MaxFrames, (s32)Bench->Arena->Count), Bench->Out);
+    }
+    fflush(Bench->Out);
+}
+
+static u64 fileSize(const char *Path) {
+    struct stat Stat;
+    return stat(Path, &Stat) == 0 ? Stat.st_size : 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: ControlBench [--json] [--label name] [filter]\n"
+            "\n"
+            "Runs the benchmarks whose name contains filter (all of them by default). --json prints one\n"
+            "JSON object per benchmark, tagged with the label, to compare between versions.\n");
+}
+
+int main(int ArgCount, char **Args) {
+    bench_options Options = {};
+    Options.Label = "";
+    for(int I = 1; I < ArgCount; ++I) {
+        if(strcmp(Args[I], "--json") == 0) {
+            Options.Json = true;
+        }
+        else if(strcmp(Args[I], "--label") == 0 && I+1 < ArgCount) {
+            Options.Label = Args[++I];
+        }
+        else if(Args[I][0] != '-' && !Options.Filter) {
+            Options.Filter = Args[I];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    static const u32 PointCounts[] = {1, 16, 64, 150, MaxActive};
+    char Name[64];
+
+    // NOTE(nox): Framing, on UpdateFrame packets of each size
+    for(u32 I = 0; I < arrayCount(PointCounts); ++I) {
+        static frame Frame;
+        static packet_bench Bench;
+        initFrame(&Frame);
+        fillFrame(&Frame, PointCounts[I]);
+        preparePacket(&Bench, &Frame);
+
+        sprintf(Name, "finalize/%d", PointCounts[I]);
+        reportBench(&Options, Name, benchFinalize, &Bench, Bench.Packet.Write);
+        sprintf(Name, "unstuff/%d", PointCounts[I]);
+        reportBench(&Options, Name, benchUnstuff, &Bench, Bench.Stuffed.Write);
+        sprintf(Name, "decode-rx/%d", PointCounts[I]);
+        reportBench(&Options, Name, benchDecodeRx, &Bench, Bench.StreamSize);
+    }
+
+    reportBench(&Options, "write-read/300", benchWriteRead, 0, 2*(4+2 + 2*MaxActive));
+
+    for(u32 I = 0; I < arrayCount(PointCounts); ++I) {
+        static optimize_bench Bench;
+        initFrame(&Bench.Original);
+        fillFrame(&Bench.Original, PointCounts[I]);
+        sprintf(Name, "optimize/%d", PointCounts[I]);
+        reportBench(&Options, Name, benchOptimize, &Bench, 0);
+    }
+    {
+        static optimize_bench Bench;
+        initFrame(&Bench.Original);
+        fillFineFrame(&Bench.Original, MaxHighResPoints);
+        sprintf(Name, "optimize-fine/%d", MaxHighResPoints);
+        reportBench(&Options, Name, benchOptimize, &Bench, 0);
+    }
+
+    frame_arena Arena = {};
+    fillAnimation(&Arena);
+
+    char Path[] = "/tmp/ControlBench-XXXXXX";
+    int Fd = mkstemp(Path);
+    if(Fd < 0) {
+        fprintf(stderr, "Could not create a temporary file\n");
+        return 1;
+    }
+    close(Fd);
+
+    static file_bench FileBench;
+    FileBench.Arena = &Arena;
+    FileBench.Path = Path;
+    saveAnimation(Path, &Arena);
+    sprintf(Name, "anim-save/%d", BenchFrameCount);
+    reportBench(&Options, Name, benchSave, &FileBench, fileSize(Path));
+    sprintf(Name, "anim-load/%d", BenchFrameCount);
+    reportBench(&Options, Name, benchLoad, &FileBench, fileSize(Path));
+    unlink(Path);
+
+    export_bench ExportBench = {&Arena, tmpfile()};
+    benchExport(&ExportBench, 1);
+    u64 ExportSize = ftell(ExportBench.Out);
+    sprintf(Name, "export-c/%d", MaxFrames);
+    reportBench(&Options, Name, benchExport, &ExportBench, ExportSize);
+    fclose(ExportBench.Out);
+
+    freeArena(&FileBench.Loaded);
+    freeArena(&Arena);
+    return 0;
+}
@@ -10,3 +10,5 @@ then
     c++ -O2 -I../External/ ../External/imgui/imgui_impl_opengl3.cpp -c -o build/imgui_impl_opengl3.o
 fi
 c++ -g3 -lGL -lX11 -ldl -lpthread -I../External/ -I../Shared main.cpp build/*.o -o build/ControlApp
+c++ -g3 -O2 -lpthread -I../Shared cli.cpp -o build/ControlCli
+c++ -g3 -O2 -I../Shared bench.cpp -o build/ControlBench
@@ -0,0 +1,504 @@
+// NOTE(nox): Headless front-end for the control application. It shares the animation and serial code
+// with the GUI but never touches GLFW or OpenGL, so it runs fine over SSH on machines without a display.
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <common.h>
+#include <protocol.hpp>
+#include <trace.hpp>
+#include <serial.hpp>
+#include <latency.hpp>
+#include <glyphs.hpp>
+#include "animation.cpp"
+#include "serial.cpp"
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: ControlCli <command> [arguments] [--first N] [--trace <file>]\n"
+            "\n"
+            "Commands:\n"
+            "  info <in.anim>                  Print frame and point counts\n"
+            "  optimize <in.anim> <out.anim>   Optimize the path of every frame\n"
+            "  export-c <in.anim> [out.h]      Write the C array used by AnimationData.h\n"
+            "  export-bin <in.anim> <out.bin>  Write the encoded upload stream\n"
+            "  upload <in.anim> <tty> [slot]   Upload to the given animation slot (default 0) and play it,\n"
+            "                                  with --preload without changing what plays\n"
+            "  play <tty> <slot>               Play the given animation slot, ending any playlist\n"
+            "  playlist <tty> [slot[:loops[:tween]] ...]\n"
+            "                                  Set the playlist, each slot plays loops times (0 is until\n"
+            "                                  the playlist changes, default 1) and with :tween is tweened\n"
+            "                                  into instead of cut to. Prints the playlist state.\n"
+            "  power <on|off> <tty>            Power the outputs on or off\n"
+            "  intensity <tty> <level>         Set the bright level of the analog Z output, 0 to %d\n"
+            "  ping <tty> [count]              Measure the link latency (default 100 pings)\n"
+            "  text <tty> <slot> <x> <y> <scale> [text]\n"
+            "                                  Draw text on the device, no text clears the slot. All slots\n"
+            "                                  share a budget of %d points, a slot gets what the others leave\n"
+            "  clock <tty> [seconds]           Show a clock with the ScenePlayer firmware (default 10 s)\n"
+            "  curve <tty> <lissajous|rose> <freq x> <freq y> [phase] [amp x] [amp y]\n"
+            "                                  Set the curve of the Curves firmware. Frequencies in Hz,\n"
+            "                                  phase in degrees, amplitudes in DAC steps (default 2047).\n"
+            "                                  A circle is lissajous F F 90.\n"
+            "\n"
+            "--first N selects the first frame (1-based) of the window of at most %d frames\n"
+            "that is exported or uploaded.\n"
+            "--trace <file> records the packets sent to and received from the device, for TraceReplay.\n"
+            "The device has %d animation slots.\n",
+            HighResMax, MaxTextPoints, MaxFrames, AnimSlotCount);
+}
+
+// NOTE(nox): Window of frames that fits on the device, same as the GUI's "first frame sent to device"
+static void deviceWindow(frame_arena *Arena, u32 FirstFrame, u32 *First, u32 *Count) {
+    *First = clamp(1, (s32)FirstFrame, (s32)Arena->Count) - 1;
+    *Count = min((s32)(Arena->Count - *First), MaxFrames);
+}
+
+static int openTty(const char *Path) {
+    int Tty = serialConnect(Path);
+    if(Tty < 0) {
+        fprintf(stderr, "Could not open %s as a serial port\n", Path);
+    }
+    return Tty;
+}
+
+// NOTE(nox): Tty is non-blocking, so wait for everything to actually leave before closing it
+static void closeTty(int Tty) {
+    tcdrain(Tty);
+    close(Tty);
+}
+
+// NOTE(nox): slot[:loops[:tween]], see usage
+static bool parsePlaylistEntry(const char *Arg, playlist_entry *Entry) {
+    char *End;
+    long Slot = strtol(Arg, &End, 10);
+    long Loops = 1;
+    if(End != Arg && *End == ':') {
+        Loops = strtol(End + 1, &End, 10);
+    }
+    Entry->Transition = Transition_Cut;
+    if(strcmp(End, ":tween") == 0) {
+        Entry->Transition = Transition_Tween;
+    }
+    else if(*End) {
+        return false;
+    }
+
+    Entry->Slot = Slot;
+    Entry->Loops = Loops;
+    return End != Arg && Slot >= 0 && Slot < AnimSlotCount && Loops >= 0 && Loops <= 0xFFFF;
+}
+
+int main(int ArgCount, char **Args) {
+    u32 FirstFrame = 1;
+    bool Preload = false;
+    char *Positional[2 + MaxPlaylistEntries] = {};
+    u32 PositionalCount = 0;
+    for(int I = 1; I < ArgCount; ++I) {
+        if(strcmp(Args[I], "--first") == 0 && I+1 < ArgCount) {
+            FirstFrame = atoi(Args[++I]);
+        }
+        else if(strcmp(Args[I], "--preload") == 0) {
+            Preload = true;
+        }
+        else if(strcmp(Args[I], "--trace") == 0 && I+1 < ArgCount) {
+            ++I; // NOTE(nox): See startTraceFromArgs
+        }
+        else if(PositionalCount < arrayCount(Positional)) {
+            Positional[PositionalCount++] = Args[I];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if(PositionalCount < 2) {
+        usage();
+        return 1;
+    }
+
+    startTraceFromArgs(ArgCount, Args, 0);
+    char *Command = Positional[0];
+    frame_arena Arena = {};
+    int Result = 0;
+
+    if(strcmp(Command, "power") == 0 && PositionalCount == 3) {
+        int Tty = openTty(Positional[2]);
+        if(Tty < 0) {
+            return 1;
+        }
+
+        buff Buff = {};
+        if(strcmp(Positional[1], "on") == 0) {
+            writePowerOn(&Buff);
+        } else {
+            writePowerOff(&Buff);
+        }
+        sendBuffer(&Buff, Tty);
+        closeTty(Tty);
+        return 0;
+    }
+
+    if(strcmp(Command, "intensity") == 0 && PositionalCount == 3) {
+        int Tty = openTty(Positional[1]);
+        if(Tty < 0) {
+            return 1;
+        }
+
+        buff Buff = {};
+        writeSetIntensity(&Buff, clamp(0, atoi(Positional[2]), HighResMax));
+        sendBuffer(&Buff, Tty);
+        closeTty(Tty);
+        return 0;
+    }
+
+    if(strcmp(Command, "play") == 0 && PositionalCount == 3) {
+        u32 Slot = atoi(Positional[2]);
+        if(Slot >= AnimSlotCount) {
+            fprintf(stderr, "The device has %d slots\n", AnimSlotCount);
+            return 1;
+        }
+
+        int Tty = openTty(Positional[1]);
+        if(Tty < 0) {
+            return 1;
+        }
+
+        buff Buff = {};
+        writeSelectSlot(&Buff, Slot);
+        sendBuffer(&Buff, Tty);
+        closeTty(Tty);
+        return 0;
+    }
+
+    if(strcmp(Command, "playlist") == 0) {
+        playlist_entry Entries[MaxPlaylistEntries];
+        u32 EntryCount = PositionalCount - 2;
+        for(u32 I = 0; I < EntryCount; ++I) {
+            if(!parsePlaylistEntry(Positional[2 + I], Entries + I)) {
+                fprintf(stderr, "Bad playlist entry %s\n", Positional[2 + I]);
+                return 1;
+            }
+        }
+
+        static serial_ctx Serial = {};
+        Serial.Tty = openTty(Positional[1]);
+        if(Serial.Tty < 0) {
+            return 1;
+        }
+
+        // NOTE(nox): Without entries only the state is printed, an empty playlist would not stop one anyway
+        buff Buff = {};
+        if(EntryCount) {
+            writeSetPlaylist(&Buff, Entries, EntryCount);
+            sendBuffer(&Buff, Serial.Tty);
+            resetBuff(&Buff);
+        }
+        writeQueryPlaylist(&Buff);
+        sendBuffer(&Buff, Serial.Tty);
+        u64 End = getTimeUs() + 500*1000;
+        for(u64 Now = getTimeUs(); Serial.PlaylistStatusCount == 0 && Now < End; Now = getTimeUs()) {
+            serialPoll(&Serial, max((End - Now + 999)/1000, 1));
+        }
+        closeTty(Serial.Tty);
+
+        if(Serial.PlaylistStatusCount == 0) {
+            fprintf(stderr, "The device did not answer, is it running the AnimPlayer firmware?\n");
+            return 1;
+        }
+        playlist_status *Status = &Serial.PlaylistStatus;
+        printf("Playing slot %d, uploads go to slot %d\n", Status->PlayingSlot, Status->UploadSlot);
+        if(Status->Pending) {
+            printf("Playlist of %d entries, starts when the current pass ends\n", Status->EntryCount);
+        }
+        else if(Status->EntryCount) {
+            printf("Playlist entry %d of %d, %d passes done\n", Status->Entry + 1, Status->EntryCount,
+                   Status->PassesDone);
+        }
+        else {
+            printf("No playlist\n");
+        }
+        return 0;
+    }
+
+    if(strcmp(Command, "ping") == 0) {
+        static serial_ctx Serial = {};
+        Serial.Tty = openTty(Positional[1]);
+        if(Serial.Tty < 0) {
+            return 1;
+        }
+
+        u32 Count = PositionalCount >= 3 ? max(atoi(Positional[2]), 1) : 100;
+        Serial.ProbeLatency = true;
+        resetLatencyProbe(&Serial.Probe);
+        for(u32 I = 0; I < Count; ++I) {
+            sendPing(&Serial.Probe, Serial.Tty);
+            serialWait(&Serial, PingIntervalMs);
+        }
+        // NOTE(nox): Echoes of the last pings may still be on their way
+        serialWait(&Serial, 500);
+        closeTty(Serial.Tty);
+
+        latency_probe *Probe = &Serial.Probe;
+        printf("%d pings, %d echoes\n", Probe->Sent, Probe->Received);
+        if(Probe->Received == 0) {
+            fprintf(stderr, "The device did not answer\n");
+            return 1;
+        }
+
+        histogram *Histograms[] = {&Probe->RoundTrip, &Probe->Device, &Probe->ToBeam};
+        const char *Names[] = {"round trip", "on device", "decode to beam"};
+        for(u32 I = 0; I < arrayCount(Histograms); ++I) {
+            histogram *Histogram = Histograms[I];
+            printf("%-15s p50 %6d us, p90 %6d us, p99 %6d us, max %6d us (%d samples)\n", Names[I],
+                   histogramPercentile(Histogram, 0.5f), histogramPercentile(Histogram, 0.9f),
+                   histogramPercentile(Histogram, 0.99f), Histogram->MaxUs, Histogram->Count);
+        }
+        printf("host -> device  p50 %6d us, p99 %6d us (estimate)\n",
+               estimatedOneWayUs(Probe, 0.5f), estimatedOneWayUs(Probe, 0.99f));
+        return 0;
+    }
+
+    if(strcmp(Command, "text") == 0 && PositionalCount >= 6) {
+        int Tty = openTty(Positional[1]);
+        if(Tty < 0) {
+            return 1;
+        }
+
+        const char *Text = PositionalCount == 7 ? Positional[6] : "";
+        u8 X = atoi(Positional[3]), Y = atoi(Positional[4]), Scale = atoi(Positional[5]);
+        buff Buff = {};
+        writeDrawText(&Buff, atoi(Positional[2]), X, Y, Scale, Text);
+        sendBuffer(&Buff, Tty);
+        closeTty(Tty);
+        // NOTE(nox): What the other slots hold isn't known here, this is with them empty
+        if(!textFitsSlot(Text, X, Y, Scale, 0)) {
+            fprintf(stderr, "The text does not fit in the text budget (%d characters or %d points), it was cut short\n",
+                    MaxTextLength, MaxTextPoints);
+        }
+        return 0;
+    }
+
+    if(strcmp(Command, "clock") == 0) {
+        static serial_ctx Serial = {};
+        Serial.Tty = openTty(Positional[1]);
+        if(Serial.Tty < 0) {
+            return 1;
+        }
+
+        // NOTE(nox): At 30 fps the scene has a budget of 300 points, the face, the hands and the time take
+        // about 200
+        enum { ClockFps = 30, UpdatesPerSecond = 10, Center = GridSize/2 - 1, Radius = 30 };
+        u32 Seconds = PositionalCount >= 3 ? max(atoi(Positional[2]), 1) : 10;
+        u32 LastMinute = ~0u;
+        u32 Reported = 0;
+        for(u32 Tick = 0; Tick < Seconds*UpdatesPerSecond; ++Tick) {
+            time_t Now = time(0);
+            tm Local;
+            localtime_r(&Now, &Local);
+
+            buff Buff = {};
+            if((u32)Local.tm_min != LastMinute) {
+                char Text[8];
+                snprintf(Text, sizeof(Text), "%02d:%02d", Local.tm_hour, Local.tm_min);
+                writeDrawText(&Buff, 0, Center - 9, Center - 16, 1, Text);
+                sendBuffer(&Buff, Serial.Tty);
+                resetBuff(&Buff);
+                LastMinute = Local.tm_min;
+            }
+
+            // NOTE(nox): Ask for the status once a second, the device answers on its own if anything is wrong
+            writeScene(&Buff, Tick, ClockFps, (Tick % UpdatesPerSecond) == 0 ? SceneFlag_Status : 0);
+            writeSceneCircle(&Buff, true, Center, Center, Radius);
+            r32 Angles[] = {(Local.tm_hour % 12 + Local.tm_min / 60.0f) / 12.0f,
+                            (Local.tm_min + Local.tm_sec / 60.0f) / 60.0f,
+                            Local.tm_sec / 60.0f};
+            r32 Lengths[] = {0.5f, 0.8f, 0.9f};
+            for(u32 I = 0; I < arrayCount(Angles); ++I) {
+                r32 Angle = 2*M_PI*Angles[I];
+                u8 Hand[] = {Center, Center,
+                             (u8)lroundf(Center + Lengths[I]*Radius*sinf(Angle)),
+                             (u8)lroundf(Center + Lengths[I]*Radius*cosf(Angle))};
+                writeScenePoints(&Buff, ScenePrim_Polyline, true, Hand, 2);
+            }
+            writeSceneText(&Buff, true, 0);
+            sendBuffer(&Buff, Serial.Tty);
+
+            serialWait(&Serial, 1000 / UpdatesPerSecond);
+            scene_status *Status = &Serial.SceneStatus;
+            if(Serial.SceneStatusCount != Reported && Status->Status) {
+                fprintf(stderr, "Scene %d:%s%s%s %d of %d points\n", Status->Seq,
+                        (Status->Status & SceneStatus_OverBudget) ? " over budget," : "",
+                        (Status->Status & SceneStatus_Malformed) ? " malformed," : "",
+                        (Status->Status & SceneStatus_TextTruncated) ? " text cut short," : "",
+                        Status->PointCount, Status->Budget);
+            }
+            Reported = Serial.SceneStatusCount;
+        }
+
+        closeTty(Serial.Tty);
+        if(Serial.SceneStatusCount == 0) {
+            fprintf(stderr, "The device did not answer, is it running the ScenePlayer firmware?\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    if(strcmp(Command, "curve") == 0 && PositionalCount >= 5) {
+        int Tty = openTty(Positional[1]);
+        if(Tty < 0) {
+            return 1;
+        }
+
+        curve_params Curve = {};
+        Curve.Type = strcmp(Positional[2], "rose") == 0 ? Curve_Rose : Curve_Lissajous;
+        Curve.PointRate = CurveDefaultPointRate;
+        Curve.FreqX = lround(atof(Positional[3])*1000);
+        Curve.FreqY = lround(atof(Positional[4])*1000);
+        Curve.Phase = PositionalCount >= 6 ? (u16)lround(fmod(atof(Positional[5]), 360) / 360 * 65536) : 0;
+        Curve.AmpX = PositionalCount >= 7 ? atoi(Positional[6]) : CurveDacMax/2;
+        Curve.AmpY = PositionalCount >= 8 ? atoi(Positional[7]) : Curve.AmpX;
+        Curve.CenterX = Curve.CenterY = (CurveDacMax + 1)/2;
+
+        buff Buff = {};
+        writeCurve(&Buff, &Curve);
+        sendBuffer(&Buff, Tty);
+        closeTty(Tty);
+        return 0;
+    }
+
+    if(!loadAnimation(Positional[1], &Arena)) {
+        fprintf(stderr, "Could not load %s\n", Positional[1]);
+        return 1;
+    }
+
+    u32 First, Count;
+    deviceWindow(&Arena, FirstFrame, &First, &Count);
+
+    if(strcmp(Command, "info") == 0) {
+        u32 TotalMs = 0;
+        printf("%s: %d frames\n", Positional[1], Arena.Count);
+        for(u32 I = 0; I < Arena.Count; ++I) {
+            frame *Frame = frameAt(&Arena, I);
+            printf("  frame %3d: %3d points%s, %5d ms, %3d fps", I+1, framePointCount(Frame),
+                   Frame->Format == FrameFormat_HighRes ? " (12-bit)" : "",
+                   Frame->NumMilliseconds, calculateFps(framePointCount(Frame)));
+            if(Frame->TweenMs > 0) {
+                printf(", %d ms tween (%s)", Frame->TweenMs, EasingNames[Frame->Easing]);
+            }
+            printf("\n");
+            TotalMs += Frame->NumMilliseconds + Frame->TweenMs;
+        }
+        printf("Total duration: %d ms\n", TotalMs);
+    }
+    else if(strcmp(Command, "optimize") == 0 && PositionalCount == 3) {
+        for(u32 I = 0; I < Arena.Count; ++I) {
+            optimizePath(frameAt(&Arena, I));
+        }
+        if(!saveAnimation(Positional[2], &Arena)) {
+            fprintf(stderr, "Could not save %s\n", Positional[2]);
+            Result = 1;
+        }
+    }
+    else if(strcmp(Command, "export-c") == 0) {
+        FILE *Out = PositionalCount == 3 ? fopen(Positional[2], "w") : stdout;
+        if(Out) {
+            exportCArray(&Arena, First, Count, Out);
+            fprintf(Out, "\n");
+            if(Out != stdout) {
+                fclose(Out);
+            }
+        }
+        else {
+            fprintf(stderr, "Could not open %s\n", Positional[2]);
+            Result = 1;
+        }
+    }
+    else if(strcmp(Command, "export-bin") == 0 && PositionalCount == 3) {
+        int Out = open(Positional[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(Out >= 0) {
+            uploadAnimation(&Arena, First, Count, Out);
+            close(Out);
+        }
+        else {
+            fprintf(stderr, "Could not open %s\n", Positional[2]);
+            Result = 1;
+        }
+    }
+    else if(strcmp(Command, "upload") == 0 && PositionalCount >= 3) {
+        static serial_ctx Serial = {};
+        Serial.Tty = openTty(Positional[2]);
+        if(Serial.Tty >= 0) {
+            Serial.SelectedAnimation = PositionalCount == 4 ? clamp(0, atoi(Positional[3]), AnimSlotCount-1) : 0;
+            buff Buff = {};
+            if(Preload) {
+                writeUploadSlot(&Buff, Serial.SelectedAnimation);
+            }
+            else {
+                writeSelectSlot(&Buff, Serial.SelectedAnimation);
+            }
+            sendBuffer(&Buff, Serial.Tty);
+
+            // NOTE(nox): Give the device a moment to tell what it holds, so unchanged frames are skipped
+            queryDeviceSlots(&Serial);
+            waitForSlot(&Serial, Serial.SelectedAnimation, 500);
+
+            u64 StartUs = getTimeUs();
+            u32 Sent = syncAnimation(&Serial, &Arena, First, Count);
+
+            // NOTE(nox): The device answers the query after it has handled everything sent before it, so
+            // the answer tells when the upload got through and whether it got through whole
+            device_slot *Slot = Serial.Slots + Serial.SelectedAnimation;
+            device_slot Expected = *Slot;
+            resetBuff(&Buff);
+            writeQueryFrameHashes(&Buff, Serial.SelectedAnimation);
+            sendBuffer(&Buff, Serial.Tty);
+            Slot->QueryPending = true;
+            bool Answered = waitForSlot(&Serial, Serial.SelectedAnimation, 5000);
+            u64 ElapsedUs = getTimeUs() - StartUs;
+            closeTty(Serial.Tty);
+
+            printf("Uploaded frames %d to %d (%d packets, %d bytes)\n", First+1, First+Count, Sent,
+                   (u32)Serial.SentBytes);
+            if(!Answered) {
+                printf("The device did not confirm the upload\n");
+            }
+            else if(Slot->FrameCount != Expected.FrameCount ||
+                    memcmp(Slot->FrameHashes, Expected.FrameHashes, Count*sizeof(u32)) != 0)
+            {
+                fprintf(stderr, "The device holds something else, packets were lost on the way\n");
+                Result = 1;
+            }
+            else if(Serial.SentBytes == 0) {
+                printf("Confirmed by the device, it already held these frames\n");
+            }
+            else {
+                if(ElapsedUs == 0) {
+                    ElapsedUs = 1;
+                }
+                printf("Confirmed by the device after %d ms (%d bytes/s)\n", (u32)(ElapsedUs / 1000),
+                       (u32)(Serial.SentBytes*1000000 / ElapsedUs));
+            }
+        }
+        else {
+            Result = 1;
+        }
+    }
+    else {
+        usage();
+        Result = 1;
+    }
+
+    freeArena(&Arena);
+    return Result;
+}
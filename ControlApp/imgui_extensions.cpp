@@ -1,7 +1,18 @@
 #include <imgui/imgui_internal.h>
 
 namespace ImGui {
-    static bool GridSquare(bool Selected, bool PreviousSelected, bool *Hovered) {
+    static inline ImRect gridCellRect(ImVec2 Min, ImVec2 Pitch, s32 Size, s32 Idx) {
+        ImVec2 CellMin(Min.x + (Idx % Size)*Pitch.x, Min.y + (Idx / Size)*Pitch.y);
+        return ImRect(CellMin, ImVec2(CellMin.x + Pitch.x, CellMin.y + Pitch.y));
+    }
+
+    // NOTE(nox): The whole grid is a single item. Cell positions are derived from the origin and the pitch
+    // (cell size + item spacing), so nothing has to be stored per cell and only the set bits are drawn.
+    static bool Grid(const u64 *Selected, const u64 *PreviousSelected, s32 Size,
+                     ImVec2 *Origin, ImVec2 *Pitch, s32 *Hovered)
+    {
+        *Hovered = -1;
+
         ImGuiWindow* Window = GetCurrentWindow();
         if(Window->SkipItems) {
             return false;
@@ -10,11 +21,13 @@ namespace ImGui {
         ImGuiContext& G = *GImGui;
         const ImGuiStyle& Style = G.Style;
 
-        ImGuiID Id = Window->GetID("");
-        ImVec2 Size(5, 10);
-        ImVec2 Pos = Window->DC.CursorPos;
-        Pos.y += Window->DC.CurrentLineTextBaseOffset;
-        ImRect Bb(Pos, ImVec2(Pos.x + Size.x, Pos.y + Size.y));
+        ImGuiID Id = Window->GetID("Grid");
+        ImVec2 CellSize(5, 10);
+        *Pitch = ImVec2(CellSize.x + Style.ItemSpacing.x, CellSize.y + Style.ItemSpacing.y);
+        *Origin = Window->DC.CursorPos;
+        Origin->y += Window->DC.CurrentLineTextBaseOffset;
+        ImRect Bb(*Origin, ImVec2(Origin->x + Size*Pitch->x - Style.ItemSpacing.x,
+                                  Origin->y + Size*Pitch->y - Style.ItemSpacing.y));
         ItemSize(Bb);
 
         float SpacingL = (float)(int)(Style.ItemSpacing.x * 0.5f);
@@ -32,14 +45,15 @@ namespace ImGui {
         bool Ignored1, Ignored2;
         ButtonBehavior(Bb, Id, &Ignored1, &Ignored2, 0);
 
-        *Hovered = IsItemHovered(ImGuiHoveredFlags_AllowWhenBlockedByActiveItem);
-        bool Pressed = *Hovered && IsMouseDown(0);
-        if(Pressed || *Hovered) {
-            if (!G.NavDisableMouseHover && G.NavWindow == Window && G.NavLayer == Window->DC.NavLayerCurrent) {
-                G.NavDisableHighlight = true;
-                SetNavID(Id, Window->DC.NavLayerCurrent);
+        if(IsItemHovered(ImGuiHoveredFlags_AllowWhenBlockedByActiveItem)) {
+            s32 X = (s32)((G.IO.MousePos.x - Bb.Min.x) / Pitch->x);
+            s32 Y = (s32)((G.IO.MousePos.y - Bb.Min.y) / Pitch->y);
+            if(X >= 0 && X < Size && Y >= 0 && Y < Size) {
+                *Hovered = Y*Size + X;
             }
         }
+
+        bool Pressed = *Hovered >= 0 && IsMouseDown(0);
         if(Pressed) {
             SetActiveID(Id, Window);
             SetFocusID(Id, Window);
@@ -48,16 +62,54 @@ namespace ImGui {
         }
 
         // Render
-        if(*Hovered || Selected) {
-            const ImU32 Col = GetColorU32(Pressed ? ImGuiCol_HeaderActive : *Hovered ? ImGuiCol_HeaderHovered : ImGuiCol_Header);
-            RenderFrame(Bb.Min, Bb.Max, Col, false, 0.0f);
-            RenderNavHighlight(Bb, Id, ImGuiNavHighlightFlags_TypeThin | ImGuiNavHighlightFlags_NoRounding);
-        } else if(PreviousSelected) {
-            const ImU32 Col = GetColorU32(IM_COL32(52, 80, 99, 70));
-            RenderFrame(Bb.Min, Bb.Max, Col, false, 0.0f);
-            RenderNavHighlight(Bb, Id, ImGuiNavHighlightFlags_TypeThin | ImGuiNavHighlightFlags_NoRounding);
+        const ImU32 Col = GetColorU32(ImGuiCol_Header);
+        const ImU32 PreviousCol = GetColorU32(IM_COL32(52, 80, 99, 70));
+        for(s32 Word = 0; Word < (Size*Size)/64; ++Word) {
+            for(u64 Bits = Selected[Word]; Bits; Bits &= Bits - 1) {
+                s32 Idx = (Word << 6) | __builtin_ctzll(Bits);
+                ImRect Cell = gridCellRect(Bb.Min, *Pitch, Size, Idx);
+                RenderFrame(Cell.Min, Cell.Max, Col, false, 0.0f);
+            }
+            if(PreviousSelected) {
+                for(u64 Bits = PreviousSelected[Word] & ~Selected[Word]; Bits; Bits &= Bits - 1) {
+                    s32 Idx = (Word << 6) | __builtin_ctzll(Bits);
+                    ImRect Cell = gridCellRect(Bb.Min, *Pitch, Size, Idx);
+                    RenderFrame(Cell.Min, Cell.Max, PreviousCol, false, 0.0f);
+                }
+            }
+        }
+
+        if(*Hovered >= 0) {
+            const ImU32 HoveredCol = GetColorU32(Pressed ? ImGuiCol_HeaderActive : ImGuiCol_HeaderHovered);
+            ImRect Cell = gridCellRect(Bb.Min, *Pitch, Size, *Hovered);
+            RenderFrame(Cell.Min, Cell.Max, HoveredCol, false, 0.0f);
         }
 
         return Pressed;
     }
+
+    // NOTE(nox): Draws a Size x Size bitmap, Scale pixels per bit, with the same colors as the grid
+    static void Thumbnail(const u64 *Bits, s32 Size, r32 Scale) {
+        ImGuiWindow* Window = GetCurrentWindow();
+        if(Window->SkipItems) {
+            return;
+        }
+
+        ImRect Bb(Window->DC.CursorPos, ImVec2(Window->DC.CursorPos.x + Size*Scale,
+                                               Window->DC.CursorPos.y + Size*Scale));
+        ItemSize(Bb);
+        if(!ItemAdd(Bb, 0)) {
+            return;
+        }
+
+        Window->DrawList->AddRectFilled(Bb.Min, Bb.Max, GetColorU32(ImGuiCol_FrameBg));
+        const ImU32 Col = GetColorU32(ImGuiCol_Header);
+        for(s32 Word = 0; Word < (Size*Size)/64; ++Word) {
+            for(u64 Set = Bits[Word]; Set; Set &= Set - 1) {
+                s32 Idx = (Word << 6) | __builtin_ctzll(Set);
+                ImRect Cell = gridCellRect(Bb.Min, ImVec2(Scale, Scale), Size, Idx);
+                Window->DrawList->AddRectFilled(Cell.Min, Cell.Max, Col);
+            }
+        }
+    }
 }
@@ -0,0 +1,229 @@
+// NOTE(nox): Animation library
+//
+// Everything the Load dialog shows about a file lives in a sidecar index next to the animations
+// (LibraryIndexName), so browsing never needs to load them. On refresh only the directory is listed and
+// every file is stat'ed; files whose mtime and size match the index keep their entry and only new or
+// changed ones are loaded again. The index is rewritten when anything changed.
+enum {
+    LibraryIndexVersion = 1,
+    LibraryNameMaxLength = 128,
+    ThumbSize = 16,
+    ThumbShift = 2, // NOTE(nox): GridSize >> ThumbShift == ThumbSize
+    ThumbWordCount = ThumbSize*ThumbSize/64,
+};
+
+static const char LibraryIndexName[] = ".index";
+static const u8 LibraryIndexMagic[4] = {'A', 'I', 'D', 'X'};
+
+typedef struct {
+    char Name[LibraryNameMaxLength];
+    u64 MTime; // NOTE(nox): In nanoseconds, saving twice in the same second is common
+    u64 FileSize;
+    u64 Hash;
+    u32 FrameCount;
+    u32 PointCount;
+    u32 MaxPointCount;
+    u32 DurationMs;
+    u64 Thumb[ThumbWordCount]; // NOTE(nox): First frame, one bit per ThumbSize x ThumbSize cell, top row first
+} library_entry;
+
+typedef struct {
+    u8 Magic[4];
+    u32 Version;
+    u32 EntrySize;
+    u32 Count;
+} library_index_header;
+
+typedef struct {
+    library_entry *Entries; // NOTE(nox): Sorted by name
+    u32 Count;
+    u32 Capacity;
+} library;
+
+static int compareLibraryEntries(const void *A, const void *B) {
+    return strcmp(((library_entry *)A)->Name, ((library_entry *)B)->Name);
+}
+
+static library_entry *findLibraryEntry(library *Library, const char *Name) {
+    if(Library->Count == 0) {
+        return 0;
+    }
+
+    library_entry Key;
+    strncpy(Key.Name, Name, sizeof(Key.Name));
+    return (library_entry *)bsearch(&Key, Library->Entries, Library->Count, sizeof(library_entry),
+                                    compareLibraryEntries);
+}
+
+static library_entry *pushLibraryEntry(library *Library) {
+    if(Library->Count == Library->Capacity) {
+        Library->Capacity = Library->Capacity ? 2*Library->Capacity : 64;
+        Library->Entries = (library_entry *)realloc(Library->Entries, Library->Capacity*sizeof(library_entry));
+        assert(Library->Entries);
+    }
+    library_entry *Entry = Library->Entries + Library->Count++;
+    *Entry = (library_entry){};
+    return Entry;
+}
+
+static void freeLibrary(library *Library) {
+    free(Library->Entries);
+    *Library = (library){};
+}
+
+// NOTE(nox): FNV-1a over the file contents
+static u64 hashFile(const char *Path) {
+    u64 Hash = 0xcbf29ce484222325;
+    FILE *File = fopen(Path, "rb");
+    if(File) {
+        u8 Chunk[4096];
+        size_t Read;
+        while((Read = fread(Chunk, 1, sizeof(Chunk), File))) {
+            for(size_t I = 0; I < Read; ++I) {
+                Hash = (Hash ^ Chunk[I]) * 0x100000001b3;
+            }
+        }
+        fclose(File);
+    }
+    return Hash;
+}
+
+static void makeThumbnail(frame *Frame, u64 *Thumb) {
+    memset(Thumb, 0, ThumbWordCount*sizeof(u64));
+    for(u32 I = 0; I < Frame->FineCount; ++I) {
+        u32 X = Frame->Fine[I].X >> GridToHighResShift >> ThumbShift;
+        u32 Y = (GridSize-1 - (Frame->Fine[I].Y >> GridToHighResShift)) >> ThumbShift;
+        setBit(Thumb, Y*ThumbSize + X);
+    }
+    for(u32 I = 0; I < Frame->ActiveCount; ++I) {
+        u32 Cell = Frame->Order[I];
+        u32 X = xCoord(Cell, GridSize) >> ThumbShift;
+        u32 Y = (Cell / GridSize) >> ThumbShift;
+        setBit(Thumb, Y*ThumbSize + X);
+    }
+}
+
+static bool fillLibraryEntry(const char *Path, library_entry *Entry, frame_arena *Scratch) {
+    if(!loadAnimation(Path, Scratch)) {
+        return false;
+    }
+
+    Entry->Hash = hashFile(Path);
+    Entry->FrameCount = Scratch->Count;
+    for(u32 I = 0; I < Scratch->Count; ++I) {
+        frame *Frame = frameAt(Scratch, I);
+        Entry->PointCount += framePointCount(Frame);
+        Entry->MaxPointCount = max(Entry->MaxPointCount, framePointCount(Frame));
+        Entry->DurationMs += Frame->NumMilliseconds + Frame->TweenMs;
+    }
+    makeThumbnail(frameAt(Scratch, 0), Entry->Thumb);
+    return true;
+}
+
+static void readLibraryIndex(const char *IndexPath, library *Library) {
+    Library->Count = 0;
+
+    FILE *File = fopen(IndexPath, "rb");
+    if(!File) {
+        return;
+    }
+
+    library_index_header Header;
+    if(fread(&Header, sizeof(Header), 1, File) == 1 &&
+       memcmp(Header.Magic, LibraryIndexMagic, sizeof(LibraryIndexMagic)) == 0 &&
+       Header.Version == LibraryIndexVersion && Header.EntrySize == sizeof(library_entry))
+    {
+        for(u32 I = 0; I < Header.Count; ++I) {
+            library_entry *Entry = pushLibraryEntry(Library);
+            if(fread(Entry, sizeof(*Entry), 1, File) != 1) {
+                --Library->Count;
+                break;
+            }
+            Entry->Name[LibraryNameMaxLength-1] = 0;
+        }
+        qsort(Library->Entries, Library->Count, sizeof(library_entry), compareLibraryEntries);
+    }
+    fclose(File);
+}
+
+static void writeLibraryIndex(const char *IndexPath, library *Library) {
+    FILE *File = fopen(IndexPath, "wb");
+    if(!File) {
+        return;
+    }
+
+    library_index_header Header = {};
+    memcpy(Header.Magic, LibraryIndexMagic, sizeof(LibraryIndexMagic));
+    Header.Version = LibraryIndexVersion;
+    Header.EntrySize = sizeof(library_entry);
+    Header.Count = Library->Count;
+    fwrite(&Header, sizeof(Header), 1, File);
+    fwrite(Library->Entries, sizeof(library_entry), Library->Count, File);
+    fclose(File);
+}
+
+// NOTE(nox): Brings the library up to date with the directory. The index on disk is only read the first
+// time, after that the entries in memory are what gets compared against.
+static bool refreshLibrary(library *Library, const char *DirPath) {
+    char Path[1024];
+    snprintf(Path, sizeof(Path), "%s/%s", DirPath, LibraryIndexName);
+    if(Library->Count == 0) {
+        readLibraryIndex(Path, Library);
+    }
+
+    DIR *Dir = opendir(DirPath);
+    if(!Dir) {
+        return false;
+    }
+
+    library Fresh = {};
+    frame_arena Scratch = {};
+    bool Changed = false;
+
+    dirent *Entry;
+    while((Entry = readdir(Dir))) {
+        u32 NameLength = strlen(Entry->d_name);
+        if(NameLength >= LibraryNameMaxLength || NameLength <= 5 ||
+           strcmp(Entry->d_name + NameLength - 5, ".anim") != 0)
+        {
+            continue;
+        }
+
+        snprintf(Path, sizeof(Path), "%s/%s", DirPath, Entry->d_name);
+        struct stat Stat;
+        if(stat(Path, &Stat) != 0 || !S_ISREG(Stat.st_mode)) {
+            continue;
+        }
+
+        u64 MTime = (u64)Stat.st_mtim.tv_sec*1000000000 + Stat.st_mtim.tv_nsec;
+        library_entry *Old = findLibraryEntry(Library, Entry->d_name);
+        library_entry *New = pushLibraryEntry(&Fresh);
+        if(Old && Old->MTime == MTime && Old->FileSize == (u64)Stat.st_size) {
+            *New = *Old;
+            continue;
+        }
+
+        strcpy(New->Name, Entry->d_name);
+        New->MTime = MTime;
+        New->FileSize = Stat.st_size;
+        if(!fillLibraryEntry(Path, New, &Scratch)) {
+            --Fresh.Count;
+            continue;
+        }
+        Changed = true;
+    }
+    closedir(Dir);
+    freeArena(&Scratch);
+
+    // NOTE(nox): Removed files also change the index
+    Changed = Changed || Fresh.Count != Library->Count;
+    qsort(Fresh.Entries, Fresh.Count, sizeof(library_entry), compareLibraryEntries);
+    freeLibrary(Library);
+    *Library = Fresh;
+
+    if(Changed) {
+        snprintf(Path, sizeof(Path), "%s/%s", DirPath, LibraryIndexName);
+        writeLibraryIndex(Path, Library);
+    }
+    return true;
+}
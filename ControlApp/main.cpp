@@ -10,138 +10,42 @@
 #include <termios.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <common.h>
 #include <protocol.hpp>
+#include <trace.hpp>
+#include <serial.hpp>
+#include <latency.hpp>
+#include <glyphs.hpp>
 #include "imgui_extensions.cpp"
+#include "animation.cpp"
+#include "library.cpp"
+#include "serial.cpp"
 
-#define xCoord(Idx, GridSize) (Idx % GridSize)
-#define yCoord(Idx, GridSize) (GridSize - (Idx / GridSize) - 1)
-#define frameRepeatCount(FrameMs, Fps) ((FrameMs*Fps)/1000)
-
-enum {
-    DefaultFrameTimeMs = 1000,
-};
-
-typedef struct {
-    bool Active;
-    bool DisablePathBefore;
-} point;
-
-typedef struct {
-    u32 ActiveCount;
-    u32 Order[MaxActive];
-    point Points[GridSize*GridSize];
-    ImVec2 Pos[GridSize*GridSize];
-    s32 NumMilliseconds;
-} frame;
-
-typedef struct {
-    int Tty;
-    int SelectedAnimation;
-} serial_ctx;
+typedef enum {
+    Tool_Draw,
+    Tool_RectSelect,
+    Tool_LassoSelect,
+} tool;
 
 static void glfwErrorCallback(int Error, const char* Description) {
     fprintf(stderr, "GLFW Error %d: %s\n", Error, Description);
 }
 
-static int serialConnect() {
-    int Tty = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY | O_NONBLOCK);
-
-    if(!isatty(Tty)) {
-        goto connectionError;
-    }
-
-    termios Config;
-    if(tcgetattr(Tty, &Config) < 0) {
-        goto connectionError;
-    }
-
-
-    Config.c_iflag &= ~(INPCK); // NOTE(nox): Disable input parity check
-    Config.c_iflag &= ~(IXON | IXOFF | IXANY); // NOTE(nox): Disable software flow control
-    Config.c_iflag &= ~(IGNBRK | BRKINT | ISTRIP | INLCR | IGNCR | ICRNL); // NOTE(nox): Disable any special handling of received bytes
-
-    Config.c_oflag  = ~(OPOST | ONLCR); // NOTE(nox): Disable output processing
-
-    Config.c_cflag &= ~(PARENB | CRTSCTS);  // NOTE(nox): Disable parity generation and RTS/CTS flow control
-    Config.c_cflag &= ~CSTOPB; // NOTE(nox): Only 1 stop bit
-    Config.c_cflag &= ~CSIZE;
-    Config.c_cflag |=  CS8; // NOTE(nos): Set 8 bits as communication unit
-    Config.c_cflag |=  (CREAD | CLOCAL); // NOTE(nox): Enable receiver and ignore modem lines
-
-    Config.c_lflag &= ~(ICANON | ECHO | ISIG); // NOTE(nox): Disable canonical mode, echos and don't generate signals
-
-    // NOTE(nox): Non blocking, return immediately what is available (ignored due to O_NONBLOCK)
-    Config.c_cc[VMIN]  = 0;
-    Config.c_cc[VTIME] = 0;
-
-    if(cfsetispeed(&Config, B115200) < 0 || cfsetospeed(&Config, B115200) < 0) {
-        goto connectionError;
-    }
-    if(tcsetattr(Tty, TCSAFLUSH, &Config) < 0) {
-        goto connectionError;
-    }
-
-    return Tty;
-
-  connectionError:
-    close(Tty);
-    return -1;
-}
-
-static inline void serialDisconnect(serial_ctx *Ctx) {
-    close(Ctx->Tty);
-    Ctx->Tty = -1;
-    Ctx->SelectedAnimation = 0;
-}
-
-static void sendBuffer(buff *Buffer, int SerialTTY) {
-    assert(SerialTTY >= 0);
-
-    buff Encoded = {};
-    finalizePacket(Buffer, &Encoded);
-    u8 Delimiter = 0;
-    write(SerialTTY, &Delimiter, 1);
-    write(SerialTTY, Encoded.Data, Encoded.Write);
-}
-
-static inline u32 calculateFps(u32 PointCount) {
-    // NOTE(nox): Assuming each point takes 100us
-    return 1000/(PointCount/10 + 3);
-}
-
-static void readFileToBuffer(FILE *File, buff *Buff) {
-    fseek(File, 0, SEEK_END);
-    u64 FileLength = ftell(File);
-    rewind(File);
-
-    assert(FileLength <= MaxPacketSize);
-    fread(Buff->Data, FileLength, 1, File);
-    Buff->Write = FileLength;
-}
-
-static void writeBufferToFile(buff *Buff, FILE *File) {
-    fwrite(Buff->Data, Buff->Write, 1, File);
-}
-
-static void reset(frame *Frames, s32 *FrameCount, s32 *SelectedFrame, s32 *LastSelected) {
-    for(int I = 0; I < MaxFrames; ++I) {
-        frame *Frame = Frames + I;
-        Frame->ActiveCount = 0;
-        for(int I = 0; I < GridSize*GridSize; ++I) {
-            point *Point = Frame->Points + I;
-            Point->Active = false;
-            Point->DisablePathBefore = false;
-        }
-        Frame->NumMilliseconds = DefaultFrameTimeMs;
-    }
-    *FrameCount = 1;
+static void reset(frame_arena *Frames, s32 *SelectedFrame, s32 *LastSelected) {
+    clearArena(Frames);
+    appendFrame(Frames);
     *SelectedFrame = 1;
     *LastSelected = -1;
 }
 
-int main(int, char**) {
+int main(int ArgCount, char **Args) {
+    const char *DevicePath = serialDevicePath(ArgCount, Args);
+    startTraceFromArgs(ArgCount, Args, 0);
     glfwSetErrorCallback(glfwErrorCallback);
     if(!glfwInit()) {
         return 1;
@@ -176,22 +80,44 @@ int main(int, char**) {
     ImGui_ImplOpenGL3_Init(glsl_version);
 
 
-    serial_ctx Serial = {-1, 0};
+    serial_ctx Serial = {};
+    Serial.Tty = -1;
+    resetLatencyProbe(&Serial.Probe);
+    u32 LastUploadPackets = 0;
 
-    s32 FrameCount = 1;
+    // NOTE(nox): Text drawn by the device on top of the animation
+    s32 TextSlot = 0;
+    s32 TextPos[2] = {2, 2};
+    s32 TextScale = 1;
+    char Text[MaxTextLength+1] = {};
+
+    // NOTE(nox): Playlist being edited, sent to the device as a whole
+    playlist_entry Playlist[MaxPlaylistEntries] = {};
+    s32 PlaylistCount = 0;
+    u32 TextSlotPoints[MaxTextSlots] = {}; // NOTE(nox): What each slot takes of the device's text budget
+
+    // NOTE(nox): The editor can hold any number of frames, the device only gets a window of MaxFrames
+    // of them, starting at UploadFirstFrame.
     s32 SelectedFrame = 1;
-    frame Frames[MaxFrames] = {0};
-    for(int I = 0; I < MaxFrames; ++I) {
-        Frames[I].NumMilliseconds = DefaultFrameTimeMs;
-    }
+    s32 UploadFirstFrame = 1;
+    frame_arena Frames = {};
+    appendFrame(&Frames);
     bool OnionSkinning = false;
     bool ShowPath = true;
     s32 LastSelected = -1;
 
-    enum { MaxFiles = 30, FileNameMaxLength = 100 };
-    u32 NumFiles;
-    char Files[MaxFiles][FileNameMaxLength];
-    s32 SelectedFile;
+    int Tool = Tool_Draw;
+    u64 Selection[GridWordCount] = {};
+    bool Dragging = false;
+    grid_pos DragStart = {};
+    enum { MaxLassoPoints = 512 };
+    grid_pos Lasso[MaxLassoPoints];
+    u32 LassoCount = 0;
+    bool FineStroke = false; // NOTE(nox): Adding points to a high resolution frame by dragging
+
+    enum { FileNameMaxLength = LibraryNameMaxLength };
+    library Library = {};
+    s32 SelectedFile = 0;
 
     while(!glfwWindowShouldClose(window)) {
         glfwPollEvents();
@@ -208,16 +134,15 @@ int main(int, char**) {
             }
         }
 
-        // NOTE(nox): Debug messages from the PIC32
-        int N;
-        char Buff[200];
-        if(Serial.Tty >= 0 && (N = read(Serial.Tty, Buff, sizeof(Buff)))) {
-            printf("%.*s", N, Buff);
-            fflush(stdout);
+        // NOTE(nox): Answers and debug messages from the PIC32
+        if(Serial.Tty >= 0) {
+            serialPoll(&Serial, 0);
+            serialProbe(&Serial);
         }
 
-        frame *Frame = Frames + SelectedFrame - 1;
-        frame *PrevFrame = SelectedFrame > 1 ? Frames + SelectedFrame - 2 : 0;
+        s32 FrameCount = Frames.Count;
+        frame *Frame = frameAt(&Frames, SelectedFrame - 1);
+        frame *PrevFrame = SelectedFrame > 1 ? frameAt(&Frames, SelectedFrame - 2) : 0;
 
         s32 ToHighlight = LastSelected;
 
@@ -226,58 +151,177 @@ int main(int, char**) {
         // NOTE(nox): Grid
         ImGui::Begin("Grid", 0, ImGuiWindowFlags_HorizontalScrollbar | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
         ImDrawList* DrawList = ImGui::GetWindowDrawList();
-        for(int I = 0; I < GridSize*GridSize; I++) {
-            ImGui::PushID(I);
-            point *Point = Frame->Points + I;
-            Frame->Pos[I] = ImGui::GetCursorScreenPos();
-            bool Hovered;
-            if(ImGui::GridSquare(Point->Active, (OnionSkinning && PrevFrame) ? PrevFrame->Points[I].Active : 0,
-                                 &Hovered))
-            {
-                LastSelected = I;
-                if(!Point->Active && Frame->ActiveCount < MaxActive) {
-                    Frame->Order[Frame->ActiveCount++] = I;
-                    Point->Active = true;
+        ImVec2 GridOrigin, GridPitch;
+        s32 Hovered;
+        bool GridPressed = ImGui::Grid(Frame->Active, (OnionSkinning && PrevFrame) ? PrevFrame->Active : 0,
+                                       GridSize, &GridOrigin, &GridPitch, &Hovered);
+
+        if(Hovered >= 0 && isActive(Frame, Hovered)) {
+            ToHighlight = Hovered;
+        }
+
+#define cellPos(Idx) ImVec2(GridOrigin.x + ((Idx) % GridSize)*GridPitch.x, GridOrigin.y + ((Idx) / GridSize)*GridPitch.y)
+#define gridToScreen(Pos) ImVec2(GridOrigin.x + (Pos).X*GridPitch.x + 2, GridOrigin.y + (Pos).Y*GridPitch.y + 4)
+        // NOTE(nox): Mouse position in grid space, where cell centers sit on integer coordinates
+        grid_pos MouseGrid = {(io.MousePos.x - GridOrigin.x - 2) / GridPitch.x,
+                              (io.MousePos.y - GridOrigin.y - 4) / GridPitch.y};
+
+#define fineToScreen(Point) ImVec2(GridOrigin.x + ((Point).X / (r32)(1 << GridToHighResShift))*GridPitch.x + 2, \
+                                   GridOrigin.y + (GridSize-1 - (Point).Y / (r32)(1 << GridToHighResShift))*GridPitch.y + 4)
+        bool HighRes = Frame->Format == FrameFormat_HighRes;
+
+        if(HighRes) {
+            // NOTE(nox): A click on a point selects it, anywhere else the draw tool adds one and dragging
+            // keeps adding them a grid cell apart. The selection tools only work on grid frames.
+            enum { FinePickDist = 1 << (GridToHighResShift - 1), FineStrokeStep = 1 << GridToHighResShift };
+            s32 FineX = clamp(0, (s32)roundf(MouseGrid.X*(1 << GridToHighResShift)), HighResMax);
+            s32 FineY = clamp(0, (s32)roundf((GridSize-1 - MouseGrid.Y)*(1 << GridToHighResShift)), HighResMax);
+
+            if(GridPressed && ImGui::IsMouseClicked(0)) {
+                s32 Nearest = nearestFinePoint(Frame, FineX, FineY, FinePickDist);
+                if(Nearest >= 0) {
+                    LastSelected = Nearest;
+                }
+                else if(Tool == Tool_Draw && addFinePoint(Frame, FineX, FineY)) {
+                    LastSelected = Frame->FineCount - 1;
+                    FineStroke = true;
+                }
+            }
+            else if(FineStroke && GridPressed && Frame->FineCount) {
+                fine_point *Last = Frame->Fine + Frame->FineCount - 1;
+                s32 DeltaX = FineX - Last->X;
+                s32 DeltaY = FineY - Last->Y;
+                if(DeltaX*DeltaX + DeltaY*DeltaY >= FineStrokeStep*FineStrokeStep &&
+                   addFinePoint(Frame, FineX, FineY))
+                {
+                    LastSelected = Frame->FineCount - 1;
                 }
             }
 
-            if(Hovered && Point->Active) {
-                ToHighlight = I;
+            if(!ImGui::IsMouseDown(0)) {
+                FineStroke = false;
+            }
+        }
+        else if(Tool == Tool_Draw) {
+            if(GridPressed) {
+                LastSelected = Hovered;
+                addPoint(Frame, Hovered);
+            }
+        }
+        else {
+            if(GridPressed && !Dragging && ImGui::IsMouseClicked(0)) {
+                Dragging = true;
+                DragStart = MouseGrid;
+                LassoCount = 0;
             }
 
-            if((I % GridSize) < GridSize-1) {
-                ImGui::SameLine();
+            if(Dragging) {
+                if(Tool == Tool_LassoSelect && LassoCount < MaxLassoPoints &&
+                   (LassoCount == 0 || fabsf(Lasso[LassoCount-1].X - MouseGrid.X) >= 0.5f ||
+                    fabsf(Lasso[LassoCount-1].Y - MouseGrid.Y) >= 0.5f))
+                {
+                    Lasso[LassoCount++] = MouseGrid;
+                }
+
+                ImU32 Col = IM_COL32(255, 255, 0, 255);
+                if(Tool == Tool_RectSelect) {
+                    DrawList->AddRect(gridToScreen(DragStart), gridToScreen(MouseGrid), Col);
+                }
+                else {
+                    for(u32 I = 1; I < LassoCount; ++I) {
+                        DrawList->AddLine(gridToScreen(Lasso[I-1]), gridToScreen(Lasso[I]), Col);
+                    }
+                }
+
+                if(!ImGui::IsMouseDown(0)) {
+                    Dragging = false;
+                    if(Tool == Tool_RectSelect) {
+                        selectRect(Frame, roundf(DragStart.X), roundf(DragStart.Y),
+                                   roundf(MouseGrid.X), roundf(MouseGrid.Y), Selection);
+                    }
+                    else {
+                        selectLasso(Frame, Lasso, LassoCount, Selection);
+                    }
+                    LastSelected = -1;
+                }
             }
-            ImGui::PopID();
         }
 
+        for(u32 Word = 0; Word < GridWordCount; ++Word) {
+            for(u64 Bits = Selection[Word]; Bits; Bits &= Bits - 1) {
+                ImVec2 Pos = cellPos((Word << 6) | __builtin_ctzll(Bits));
+                DrawList->AddRect(ImVec2(Pos.x - 1, Pos.y - 1), ImVec2(Pos.x + 6, Pos.y + 11), IM_COL32(255, 255, 0, 255));
+            }
+        }
+        for(u32 I = 0; I < Frame->FineCount; ++I) {
+            ImVec2 Pos = fineToScreen(Frame->Fine[I]);
+            ImU32 Col = (s32)I == LastSelected ? IM_COL32(255, 255, 0, 255) : IM_COL32(0, 255, 0, 255);
+            DrawList->AddCircleFilled(Pos, 2.5f, Col);
+        }
         if(ShowPath) {
+            for(u32 I = 1; I < Frame->FineCount; ++I) {
+                u8 Alpha = isFineBlank(Frame, I) ? 50 : 255;
+                ImU32 Col = (s32)I == LastSelected ? IM_COL32(255, 255, 255, Alpha) : IM_COL32(255, 0, 0, Alpha);
+                DrawList->AddLine(fineToScreen(Frame->Fine[I-1]), fineToScreen(Frame->Fine[I]), Col);
+            }
             for(u32 I = 1; I < Frame->ActiveCount; ++I) {
-                ImVec2 Pos1 = Frame->Pos[Frame->Order[I-1]];
-                ImVec2 Pos2 = Frame->Pos[Frame->Order[I]];
-                u8 Alpha = Frame->Points[Frame->Order[I]].DisablePathBefore ? 50 : 255;
+                ImVec2 Pos1 = cellPos(Frame->Order[I-1]);
+                ImVec2 Pos2 = cellPos(Frame->Order[I]);
+                u8 Alpha = isPathDisabled(Frame, Frame->Order[I]) ? 50 : 255;
                 ImU32 Col = Frame->Order[I] == ToHighlight ? IM_COL32(255, 255, 255, Alpha) : IM_COL32(255, 0, 0, Alpha);
                 DrawList->AddLine(ImVec2(Pos1.x + 2, Pos1.y + 4), ImVec2(Pos2.x + 2, Pos2.y + 4), Col);
             }
         }
+#undef fineToScreen
+#undef gridToScreen
+#undef cellPos
         ImGui::End();
 
 
         // ------------------------------------------------------------------------------------------
         // NOTE(nox): Animation settings
         ImGui::Begin("Animation settings", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
-        ImGui::SliderInt("Frame count", &FrameCount, 1, MaxFrames);
-        FrameCount = clamp(1, FrameCount, MaxFrames);
-
         s32 OldSelectedFrame = SelectedFrame;
         ImGui::SliderInt("Selected frame", &SelectedFrame, 1, FrameCount);
-        SelectedFrame = clamp(1, SelectedFrame, FrameCount);
+
+        if(ImGui::Button("New frame")) {
+            insertFrame(&Frames, SelectedFrame++);
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Duplicate frame")) {
+            duplicateFrame(&Frames, SelectedFrame++ - 1);
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Delete frame") && Frames.Count > 1) {
+            deleteFrame(&Frames, SelectedFrame - 1);
+        }
+
+        if(ImGui::ArrowButton("Earlier", ImGuiDir_Left) && SelectedFrame > 1) {
+            moveFrame(&Frames, SelectedFrame - 1, SelectedFrame - 2);
+            --SelectedFrame;
+        }
+        ImGui::SameLine();
+        if(ImGui::ArrowButton("Later", ImGuiDir_Right) && SelectedFrame < (s32)Frames.Count) {
+            moveFrame(&Frames, SelectedFrame - 1, SelectedFrame);
+            ++SelectedFrame;
+        }
+        ImGui::SameLine();
+        ImGui::Text("Move frame");
+
+        SelectedFrame = clamp(1, SelectedFrame, Frames.Count);
         if(OldSelectedFrame != SelectedFrame) {
             LastSelected = -1;
+            clearSelection(Selection);
         }
 
+        ImGui::SliderInt("First frame sent to device", &UploadFirstFrame, 1, Frames.Count);
+        UploadFirstFrame = clamp(1, UploadFirstFrame, Frames.Count);
+        s32 UploadCount = min((s32)Frames.Count - (UploadFirstFrame - 1), MaxFrames);
+        ImGui::Text("Device gets frames %d to %d", UploadFirstFrame, UploadFirstFrame + UploadCount - 1);
+
         if(ImGui::Button("Completely clear animation")) {
-            reset(Frames, &FrameCount, &SelectedFrame, &LastSelected);
+            reset(&Frames, &SelectedFrame, &LastSelected);
+            clearSelection(Selection);
         }
 
         // NOTE(nox): This part is really messy and assumes everything is going to work without error
@@ -289,22 +333,9 @@ int main(int, char**) {
         ImGui::SameLine();
 
         if(ImGui::Button("Load")) {
-            DIR *Dir = opendir("../animations");
-            if(Dir) {
-                NumFiles = 0;
-                SelectedFile = 0;
-                dirent *Entry;
-                while(Entry = readdir(Dir)) {
-                    u32 NameLength = strlen(Entry->d_name);
-                    if(NameLength <= FileNameMaxLength && NameLength > 5 &&
-                       strcmp(Entry->d_name + NameLength - 5, ".anim") == 0)
-                    {
-                        strncpy(Files[NumFiles++], Entry->d_name, FileNameMaxLength);
-                    }
-                }
-                if(NumFiles) {
-                    ImGui::OpenPopup("Load");
-                }
+            if(refreshLibrary(&Library, "../animations") && Library.Count) {
+                SelectedFile = clamp(0, SelectedFile, (s32)Library.Count - 1);
+                ImGui::OpenPopup("Load");
             }
         }
 
@@ -317,28 +348,7 @@ int main(int, char**) {
             if(ImGui::Button("Save")) {
                 char FilePath[FileNameMaxLength+50];
                 sprintf(FilePath, "../animations/%s.anim", Name);
-                FILE *File = fopen(FilePath, "wb");
-                if(File) {
-                    buff Buff = {};
-
-                    // NOTE(nox): Write protocol to file
-                    writeU8(&Buff, MagicNumber);
-                    writeU16(&Buff, 0); // NOTE(nox): Placeholder for length
-                    writeU32(&Buff, FrameCount);
-                    for(u32 I = 0; I < FrameCount; ++I) {
-                        frame *Frame = Frames + I;
-                        writeU32(&Buff, Frame->NumMilliseconds);
-                        writeU32(&Buff, Frame->ActiveCount);
-                        for(u32 J = 0; J < Frame->ActiveCount; ++J) {
-                            u32 Index = Frame->Order[J];
-                            writeU32(&Buff, Index);
-                            writeU8(&Buff, Frame->Points[Index].DisablePathBefore);
-                        }
-                    }
-                    *((u16 *)(Buff.Data + 1)) = Buff.Write-3;
-
-                    writeBufferToFile(&Buff, File);
-                    fclose(File);
+                if(saveAnimation(FilePath, &Frames)) {
                     ImGui::CloseCurrentPopup();
                 }
             }
@@ -350,45 +360,42 @@ int main(int, char**) {
         }
 
         if(ImGui::BeginPopupModal("Load", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize)) {
-            char *Entries[MaxFiles];
-            for(u32 I = 0; I < NumFiles; ++I) {
-                Entries[I] = Files[I];
+            // NOTE(nox): Only the visible rows are submitted, everything shown comes from the library index
+            ImGui::Text("Which animation?");
+            ImGui::BeginChild("Animations", ImVec2(500, 400), true);
+            r32 RowHeight = ThumbSize*2 + ImGui::GetStyle().ItemSpacing.y;
+            ImGuiListClipper Clipper(Library.Count, RowHeight);
+            while(Clipper.Step()) {
+                for(s32 I = Clipper.DisplayStart; I < Clipper.DisplayEnd; ++I) {
+                    library_entry *Entry = Library.Entries + I;
+                    ImGui::PushID(I);
+                    ImVec2 RowStart = ImGui::GetCursorScreenPos();
+                    if(ImGui::Selectable("", SelectedFile == I, 0, ImVec2(0, ThumbSize*2))) {
+                        SelectedFile = I;
+                    }
+                    ImGui::SetCursorScreenPos(RowStart);
+                    ImGui::Thumbnail(Entry->Thumb, ThumbSize, 2);
+                    ImGui::SameLine();
+                    ImGui::BeginGroup();
+                    ImGui::Text("%s", Entry->Name);
+                    ImGui::TextDisabled("%d frames, %d points (max %d), %.1f s", Entry->FrameCount,
+                                        Entry->PointCount, Entry->MaxPointCount, Entry->DurationMs/1000.0f);
+                    ImGui::EndGroup();
+                    ImGui::SetCursorScreenPos(ImVec2(RowStart.x, RowStart.y + RowHeight));
+                    ImGui::PopID();
+                }
             }
-            ImGui::ListBox("Which animation?", &SelectedFile, Entries, NumFiles);
+            ImGui::EndChild();
 
             ImGui::Separator();
 
             if(ImGui::Button("Load")) {
                 char FilePath[FileNameMaxLength+50];
-                sprintf(FilePath, "../animations/%s", Entries[SelectedFile]);
-                FILE *File = fopen(FilePath, "rb");
-                if(File) {
-                    buff Buff = {};
-                    readFileToBuffer(File, &Buff);
-
-                    // NOTE(nox): Parse protocol out of file
-                    u8 MagicTest = readU8(&Buff);
-                    if(MagicTest == MagicNumber) {
-                        u16 Length = readU16(&Buff);
-                        if(hasAvailable(&Buff, Length)) {
-                            reset(Frames, &FrameCount, &SelectedFrame, &LastSelected);
-                            FrameCount = readU32(&Buff);
-                            for(u32 I = 0; I < FrameCount; ++I) {
-                                frame *Frame = Frames + I;
-                                Frame->NumMilliseconds = readU32(&Buff);
-                                Frame->ActiveCount = readU32(&Buff);
-                                for(u32 J = 0; J < Frame->ActiveCount; ++J) {
-                                    u32 Index = readU32(&Buff);
-                                    point *Point = Frame->Points + Index;
-                                    Point->Active = true;
-                                    Point->DisablePathBefore = readU8(&Buff);
-                                    Frame->Order[J] = Index;
-                                }
-                            }
-                        }
-                    }
-
-                    fclose(File);
+                sprintf(FilePath, "../animations/%s", Library.Entries[SelectedFile].Name);
+                if(loadAnimation(FilePath, &Frames)) {
+                    SelectedFrame = 1;
+                    LastSelected = -1;
+                    clearSelection(Selection);
                     ImGui::CloseCurrentPopup();
                 }
             }
@@ -400,61 +407,51 @@ int main(int, char**) {
         }
         ImGui::End();
 
+        // NOTE(nox): The frame list may have changed above
+        FrameCount = Frames.Count;
+        SelectedFrame = clamp(1, SelectedFrame, FrameCount);
+        UploadFirstFrame = clamp(1, UploadFirstFrame, FrameCount);
+        UploadCount = min(FrameCount - (UploadFirstFrame - 1), MaxFrames);
+        Frame = frameAt(&Frames, SelectedFrame - 1);
+
 
         // ------------------------------------------------------------------------------------------
         // NOTE(nox): Frame settings
         ImGui::Begin("Frame settings", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Text("Selected frame: %d out of %d", SelectedFrame, FrameCount);
-        ImGui::Text("Number of points: %d out of %d", Frame->ActiveCount, MaxActive);
+        bool FrameHighRes = Frame->Format == FrameFormat_HighRes;
+        ImGui::Text("Number of points: %d out of %d", framePointCount(Frame),
+                    FrameHighRes ? (s32)MaxHighResPoints : (s32)MaxActive);
+        if(ImGui::Checkbox("High resolution (12-bit points)", &FrameHighRes)) {
+            setFrameFormat(Frame, FrameHighRes ? FrameFormat_HighRes : FrameFormat_Grid);
+            clearSelection(Selection);
+            LastSelected = -1;
+        }
 
         ImGui::SliderInt("Time (ms)", &Frame->NumMilliseconds, MinFrameTimeMs, 2000);
         Frame->NumMilliseconds = max(MinFrameTimeMs, Frame->NumMilliseconds);
 
+        // NOTE(nox): The device moves the points towards the next frame, see tweenProgress
+        ImGui::SliderInt("Tween to next (ms)", &Frame->TweenMs, 0, 2000);
+        Frame->TweenMs = max(0, Frame->TweenMs);
+        int Easing = Frame->Easing;
+        if(ImGui::Combo("Easing", &Easing, EasingNames, EaseCount)) {
+            Frame->Easing = Easing;
+        }
+        frame *NextFrame = frameAt(&Frames, SelectedFrame % FrameCount);
+        if(Frame->TweenMs > 0 && framePointCount(NextFrame) != framePointCount(Frame)) {
+            ImGui::Text("The next frame has %d points, the tween needs %d", framePointCount(NextFrame),
+                        framePointCount(Frame));
+        }
+
         if(ImGui::Button("Clear frame")) {
-            Frame->ActiveCount = 0;
-            for(int I = 0; I < GridSize*GridSize; ++I) {
-                point *Point = Frame->Points + I;
-                Point->Active = false;
-                Point->DisablePathBefore = false;
-            }
+            clearFrame(Frame);
+            clearSelection(Selection);
             LastSelected = -1;
         }
         ImGui::SameLine();
-        if(ImGui::Button("\"Optimize\" path") && Frame->ActiveCount > 0) {
-            u32 NumVisited = 0;
-            bool Visited[GridSize*GridSize] = {0};
-
-            u32 Current = Frame->Order[0];
-            Visited[Current] = true;
-            ++NumVisited;
-
-            while(NumVisited < Frame->ActiveCount) {
-                u32 CurrentX = Current % GridSize;
-                u32 CurrentY = Current / GridSize;
-
-                u32 Best;
-                float BestDist = FLT_MAX;
-                for(u32 Index = 0; Index < GridSize*GridSize; ++Index) {
-                    if(Frame->Points[Index].Active && !Visited[Index]) {
-                        s32 DeltaX = (Index % GridSize) - CurrentX;
-                        s32 DeltaY = (Index / GridSize) - CurrentY;
-                        float Dist = sqrt(DeltaX*DeltaX + DeltaY*DeltaY);
-                        if(Dist < BestDist) {
-                            Best = Index;
-                            BestDist = Dist;
-                        }
-                    }
-                }
-
-                Frame->Order[NumVisited++] = Best;
-                Visited[Best] = true;
-                Current = Best;
-            }
-
-            for(u32 I = 0; I < Frame->ActiveCount; ++I) {
-                Frame->Points[Frame->Order[I]].DisablePathBefore = false;
-            }
-
+        if(ImGui::Button("\"Optimize\" path") && framePointCount(Frame) > 0) {
+            optimizePath(Frame);
             ShowPath = true;
         }
         ImGui::End();
@@ -463,26 +460,62 @@ int main(int, char**) {
         // ------------------------------------------------------------------------------------------
         // NOTE(nox): Point settings
         ImGui::Begin("Point settings", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
-        if(LastSelected >= 0) {
-            point *Point = &Frame->Points[LastSelected];
+        if(LastSelected >= 0 && Frame->Format == FrameFormat_HighRes && LastSelected < (s32)Frame->FineCount) {
+            fine_point *Point = Frame->Fine + LastSelected;
+            ImGui::Text("Point %d at (%d, %d)", LastSelected, Point->X, Point->Y);
+            bool Blank = isFineBlank(Frame, LastSelected);
+            if(ImGui::Checkbox("Disable drawing before moving to this point", &Blank)) {
+                assignBit(Frame->FineBlank, LastSelected, Blank);
+            }
+            if(ImGui::Button("Delete point")) {
+                removeFinePoint(Frame, LastSelected);
+                LastSelected = -1;
+            }
+        } else if(LastSelected >= 0 && Frame->Format == FrameFormat_Grid) {
             ImGui::Text("Point %d", LastSelected);
-            ImGui::Checkbox("Disable drawing before moving to this point", &Point->DisablePathBefore);
+            bool DisablePathBefore = isPathDisabled(Frame, LastSelected);
+            if(ImGui::Checkbox("Disable drawing before moving to this point", &DisablePathBefore)) {
+                assignBit(Frame->DisablePathBefore, LastSelected, DisablePathBefore);
+            }
             if(ImGui::Button("Delete point")) {
-                u32 OrderIdx;
-                for(OrderIdx = 0; OrderIdx < Frame->ActiveCount; ++OrderIdx) {
-                    if(Frame->Order[OrderIdx] == LastSelected) {
-                        break;
-                    }
-                }
-                memcpy(Frame->Order + OrderIdx, Frame->Order + OrderIdx + 1,
-                       sizeof(*Frame->Order)*(MaxActive-1-OrderIdx));
-                --Frame->ActiveCount;
-                *Point = (point){0};
+                removePoint(Frame, LastSelected);
                 LastSelected = -1;
             }
         } else {
             ImGui::Text("No point is selected!");
         }
+
+        ImGui::Separator();
+
+        u32 SelectedCount = selectionCount(Selection);
+        if(SelectedCount) {
+            ImGui::Text("%d points in the selection", SelectedCount);
+            if(ImGui::Button("Delete selection")) {
+                deleteSelection(Frame, Selection);
+                clearSelection(Selection);
+                LastSelected = -1;
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Reverse sub-path")) {
+                reverseSelection(Frame, Selection);
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Deselect")) {
+                clearSelection(Selection);
+            }
+
+            if(ImGui::ArrowButton("Left", ImGuiDir_Left))   translateSelection(Frame, Selection, -1,  0);
+            ImGui::SameLine();
+            if(ImGui::ArrowButton("Up", ImGuiDir_Up))       translateSelection(Frame, Selection,  0, -1);
+            ImGui::SameLine();
+            if(ImGui::ArrowButton("Down", ImGuiDir_Down))   translateSelection(Frame, Selection,  0,  1);
+            ImGui::SameLine();
+            if(ImGui::ArrowButton("Right", ImGuiDir_Right)) translateSelection(Frame, Selection,  1,  0);
+            ImGui::SameLine();
+            ImGui::Text("Move selection");
+        } else {
+            ImGui::Text("Nothing is selected!");
+        }
         ImGui::End();
 
 
@@ -491,8 +524,13 @@ int main(int, char**) {
         ImGui::Begin("Control", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
         if(Serial.Tty < 0) {
             if(ImGui::Button("Connect")) {
-                Serial.Tty = serialConnect();
+                Serial.Tty = serialConnect(DevicePath);
+                if(Serial.Tty >= 0) {
+                    queryDeviceSlots(&Serial);
+                }
             }
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s", DevicePath);
         }
         else {
             if(ImGui::Button("Disconnect")) {
@@ -511,41 +549,51 @@ int main(int, char**) {
                 sendBuffer(&Buff, Serial.Tty);
             }
 
-            int OldAnim = Serial.SelectedAnimation;
-            ImGui::RadioButton("Animation 1", &Serial.SelectedAnimation, 0); ImGui::SameLine();
-            ImGui::RadioButton("Animation 2", &Serial.SelectedAnimation, 1);
-            if(Serial.SelectedAnimation != OldAnim) {
-                buff Buff = {};
-                writeSelectAnim(&Buff, Serial.SelectedAnimation);
-                sendBuffer(&Buff, Serial.Tty);
-            }
-
-            if(ImGui::Button("Upload animation")) {
-                for(u8 I = 0; I < FrameCount; ++I) {
-                    frame *Frame = Frames + I;
-                    u32 Fps = calculateFps(Frame->ActiveCount);
+            // NOTE(nox): Playing a slot also sends the uploads there and ends the playlist, like on the device.
+            // Uploading to another slot leaves what plays alone, so the next piece can be loaded during a show.
+            ImGui::Text("Play");
+            for(s32 I = 0; I < AnimSlotCount; ++I) {
+                char Label[16];
+                snprintf(Label, sizeof(Label), "%d##Play", I+1);
+                ImGui::SameLine();
+                if(ImGui::RadioButton(Label, Serial.PlayingSlot == I) && Serial.PlayingSlot != I) {
                     buff Buff = {};
-                    writeHeader(&Buff, Command_UpdateFrame);
-                    writeU8(&Buff, I);
-                    writeU16(&Buff, Fps);
-                    writeU16(&Buff, frameRepeatCount(Frame->NumMilliseconds, Fps));
-                    writeU16(&Buff, Frame->ActiveCount);
-
-                    for(int J = 0; J < Frame->ActiveCount; ++J) {
-                        int ActiveIndex = Frame->Order[J];
-                        point *Point = Frame->Points + ActiveIndex;
-                        int X = xCoord(ActiveIndex, GridSize) | (Point->DisablePathBefore ? ZDisableBit : 0);
-                        int Y = yCoord(ActiveIndex, GridSize);
-                        writeU8(&Buff, X);
-                        writeU8(&Buff, Y);
-                    }
-
+                    writeSelectSlot(&Buff, I);
                     sendBuffer(&Buff, Serial.Tty);
+                    Serial.PlayingSlot = Serial.SelectedAnimation = I;
                 }
+            }
+            ImGui::Text("Upload to");
+            for(s32 I = 0; I < AnimSlotCount; ++I) {
+                char Label[16];
+                snprintf(Label, sizeof(Label), "%d##Upload", I+1);
+                ImGui::SameLine();
+                ImGui::RadioButton(Label, &Serial.SelectedAnimation, I);
+            }
 
+            device_slot *Slot = Serial.Slots + Serial.SelectedAnimation;
+            bool Upload = ImGui::Button("Upload animation");
+            ImGui::SameLine();
+            if(ImGui::Button("Upload everything")) {
+                Slot->Known = false;
+                Upload = true;
+            }
+            if(Upload) {
                 buff Buff = {};
-                writeUpdateFrameCount(&Buff, FrameCount);
+                writeUploadSlot(&Buff, Serial.SelectedAnimation);
                 sendBuffer(&Buff, Serial.Tty);
+                LastUploadPackets = syncAnimation(&Serial, &Frames, UploadFirstFrame - 1, UploadCount);
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Check device")) {
+                queryDeviceSlots(&Serial);
+            }
+            if(Slot->Known) {
+                ImGui::Text("Device holds %d frames, last upload took %d packets", Slot->FrameCount,
+                            LastUploadPackets);
+            }
+            else {
+                ImGui::Text("Device contents unknown, the next upload sends everything");
             }
 
             ImGui::SameLine();
@@ -590,6 +638,7 @@ int main(int, char**) {
                 buff FrameCountBuff = {};
                 writeUpdateFrameCount(&FrameCountBuff, FrameCount);
                 sendBuffer(&FrameCountBuff, Serial.Tty);
+                Slot->Known = false;
             }
 
             if(ImGui::Button("Set to 0 after drawing")) {
@@ -615,37 +664,110 @@ int main(int, char**) {
                 writeInfoLedOff(&Buff);
                 sendBuffer(&Buff, Serial.Tty);
             }
+
+            ImGui::Separator();
+            ImGui::InputText("Text", Text, sizeof(Text));
+            ImGui::SliderInt("Text slot", &TextSlot, 0, MaxTextSlots-1);
+            ImGui::SliderInt2("Text position", TextPos, 0, GridSize-1);
+            ImGui::SliderInt("Text scale", &TextScale, 1, MaxTextScale);
+            u32 OtherPoints = 0;
+            for(u32 Slot = 0; Slot < MaxTextSlots; ++Slot) {
+                OtherPoints += (s32)Slot == TextSlot ? 0 : TextSlotPoints[Slot];
+            }
+            u32 PointCount;
+            if(!textFitsSlot(Text, TextPos[0], TextPos[1], TextScale, OtherPoints, &PointCount)) {
+                ImGui::Text("Over the text budget of %d points with the other slots, the device cuts the text short",
+                            MaxTextPoints);
+            }
+            if(ImGui::Button("Show text")) {
+                buff Buff = {};
+                writeDrawText(&Buff, TextSlot, TextPos[0], TextPos[1], TextScale, Text);
+                sendBuffer(&Buff, Serial.Tty);
+                TextSlotPoints[TextSlot] = PointCount;
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Clear text")) {
+                buff Buff = {};
+                writeDrawText(&Buff, TextSlot, 0, 0, 1, "");
+                sendBuffer(&Buff, Serial.Tty);
+                TextSlotPoints[TextSlot] = 0;
+            }
+
+            ImGui::Separator();
+            ImGui::Text("Playlist");
+            for(s32 I = 0; I < PlaylistCount; ++I) {
+                playlist_entry *Entry = Playlist + I;
+                ImGui::PushID(I);
+                s32 EntrySlot = Entry->Slot + 1;
+                s32 Loops = Entry->Loops;
+                bool Tween = Entry->Transition == Transition_Tween;
+                ImGui::PushItemWidth(80);
+                ImGui::SliderInt("Slot", &EntrySlot, 1, AnimSlotCount); ImGui::SameLine();
+                ImGui::InputInt("Loops (0 is forever)", &Loops); ImGui::SameLine();
+                ImGui::PopItemWidth();
+                ImGui::Checkbox("Tween into", &Tween);
+                Entry->Slot = clamp(1, EntrySlot, AnimSlotCount) - 1;
+                Entry->Loops = clamp(0, Loops, 0xFFFF);
+                Entry->Transition = Tween ? Transition_Tween : Transition_Cut;
+                ImGui::PopID();
+            }
+            if(PlaylistCount < MaxPlaylistEntries && ImGui::Button("Add entry")) {
+                Playlist[PlaylistCount++] = (playlist_entry){(u8)Serial.SelectedAnimation, Transition_Cut, 1};
+            }
+            ImGui::SameLine();
+            if(PlaylistCount > 0 && ImGui::Button("Remove entry")) {
+                --PlaylistCount;
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Send playlist")) {
+                buff Buff = {};
+                writeSetPlaylist(&Buff, Playlist, PlaylistCount);
+                writeQueryPlaylist(&Buff);
+                sendBuffer(&Buff, Serial.Tty);
+            }
+            ImGui::SameLine();
+            if(ImGui::Button("Check playlist")) {
+                buff Buff = {};
+                writeQueryPlaylist(&Buff);
+                sendBuffer(&Buff, Serial.Tty);
+            }
+            if(Serial.PlaylistStatusCount) {
+                playlist_status *Status = &Serial.PlaylistStatus;
+                Serial.PlayingSlot = Status->PlayingSlot;
+                if(Status->Pending) {
+                    ImGui::Text("%d entries, start when the current pass ends", Status->EntryCount);
+                }
+                else if(Status->EntryCount) {
+                    ImGui::Text("Slot %d playing, entry %d of %d, %d passes done", Status->PlayingSlot + 1,
+                                Status->Entry + 1, Status->EntryCount, Status->PassesDone);
+                }
+                else {
+                    ImGui::Text("Slot %d playing, no playlist", Status->PlayingSlot + 1);
+                }
+            }
+
+            ImGui::Separator();
+            ImGui::Checkbox("Probe latency", &Serial.ProbeLatency);
+            if(Serial.ProbeLatency) {
+                drawLatencyPanel(&Serial.Probe);
+                if(ImGui::Button("Reset latency")) {
+                    resetLatencyProbe(&Serial.Probe);
+                }
+            }
         }
 
         ImGui::Separator();
 
         if(ImGui::Button("Copy C array to clipboard!")) {
-#define I1 "    "
-#define I2 "      "
-#define I3 "          "
-#define I4 "              "
-#define I5 "                 "
-            ImGui::LogToClipboard();
-            ImGui::LogText(I1 "{ %d,\n" I2 "{", FrameCount);
-            for(int I = 0; I < FrameCount; ++I) {
-                frame *Frame = Frames + I;
-                u32 Fps = calculateFps(Frame->ActiveCount);
-                ImGui::LogText("\n" I3 "{\n" I4 "%d, %d, %d, {", Fps,
-                               frameRepeatCount(Frame->NumMilliseconds, Fps), Frame->ActiveCount);
-                for(int J = 0; J < Frame->ActiveCount; ++J) {
-                    if((J % 7) == 0) {
-                        ImGui::LogText("\n" I5);
-                    }
-                    int ActiveIndex = Frame->Order[J];
-                    point *Point = Frame->Points + ActiveIndex;
-                    int X = xCoord(ActiveIndex, GridSize);
-                    int Y = yCoord(ActiveIndex, GridSize);
-                    ImGui::LogText(" {%d, %d},", X | (Point->DisablePathBefore ? ZDisableBit : 0), Y);
-                }
-                ImGui::LogText("\n" I4 "}\n" I3 "},");
+            char *Text = 0;
+            size_t TextSize = 0;
+            FILE *Out = open_memstream(&Text, &TextSize);
+            if(Out) {
+                exportCArray(&Frames, UploadFirstFrame - 1, UploadCount, Out);
+                fclose(Out);
+                ImGui::SetClipboardText(Text);
+                free(Text);
             }
-            ImGui::LogText("\n" I2 "}\n" I1 "},");
-            ImGui::LogFinish();
         }
         ImGui::End();
 
@@ -654,6 +776,9 @@ int main(int, char**) {
         ImGui::Begin("Drawing utilities", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Checkbox("Onion skinning", &OnionSkinning);
         ImGui::Checkbox("Show path", &ShowPath);
+        ImGui::RadioButton("Draw", &Tool, Tool_Draw); ImGui::SameLine();
+        ImGui::RadioButton("Rectangle select", &Tool, Tool_RectSelect); ImGui::SameLine();
+        ImGui::RadioButton("Lasso select", &Tool, Tool_LassoSelect);
         ImGui::End();
 
         ImGui::Render();
@@ -669,6 +794,9 @@ int main(int, char**) {
         glfwSwapBuffers(window);
     }
 
+    freeArena(&Frames);
+    freeLibrary(&Library);
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
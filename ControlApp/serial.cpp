@@ -0,0 +1,177 @@
+// NOTE(nox): What the host believes an animation slot of the device holds. Until Known is set (by an upload
+// or by the answer to a query) everything is sent. QueryPending makes an answer that arrives after an
+// upload be ignored, as the device answered with what it had before the upload.
+typedef struct {
+    bool Known;
+    bool QueryPending;
+    u8 FrameCount;
+    u32 FrameHashes[MaxFrames];
+} device_slot;
+
+typedef struct {
+    int Tty;
+    int SelectedAnimation; // NOTE(nox): The slot the uploads go to, also when it doesn't play
+    int PlayingSlot;
+    device_slot Slots[AnimSlotCount];
+
+    packet_reader Reader;
+    u64 SentBytes; // NOTE(nox): Frame data on the wire, counted by syncAnimation
+
+    bool ProbeLatency;
+    u64 LastPingUs;
+    latency_probe Probe;
+
+    u32 SceneStatusCount;
+    scene_status SceneStatus; // NOTE(nox): The last one the ScenePlayer firmware sent
+
+    u32 PlaylistStatusCount;
+    playlist_status PlaylistStatus; // NOTE(nox): The last answer to Command_QueryPlaylist
+} serial_ctx;
+
+static inline void serialDisconnect(serial_ctx *Ctx) {
+    close(Ctx->Tty);
+    Ctx->Tty = -1;
+    Ctx->SelectedAnimation = 0;
+    Ctx->PlayingSlot = 0;
+    memset(Ctx->Slots, 0, sizeof(Ctx->Slots));
+    resetPacketReader(&Ctx->Reader);
+}
+
+// NOTE(nox): Sends Count frames starting at First and then the new frame count. Fd may also be a regular
+// file, in which case it ends up with the exact byte stream the device would receive.
+static void uploadAnimation(frame_arena *Arena, u32 First, u32 Count, int Fd) {
+    for(u32 I = 0; I < Count; ++I) {
+        buff Buff = {};
+        writeFrame(&Buff, frameAt(Arena, First + I), I);
+        sendBuffer(&Buff, Fd);
+    }
+
+    buff Buff = {};
+    writeUpdateFrameCount(&Buff, Count);
+    sendBuffer(&Buff, Fd);
+}
+
+static inline u32 hashFramePacket(buff *Buff) {
+    enum { HashStart = 1+2+1 }; // NOTE(nox): Header and frame index
+    bool HighRes = (Buff->Data[0] & CommandMask) == Command_UpdateFrameHighRes;
+    return hashBytes(frameHashSeed(HighRes ? FrameFormat_HighRes : FrameFormat_Grid),
+                     Buff->Data + HashStart, Buff->Write - HashStart);
+}
+
+// NOTE(nox): Like uploadAnimation, but only sends the frames whose hash differs from what the selected slot
+// is known to hold, and the frame count only if it changed. Returns the number of packets sent.
+static u32 syncAnimation(serial_ctx *Ctx, frame_arena *Arena, u32 First, u32 Count) {
+    device_slot *Slot = Ctx->Slots + Ctx->SelectedAnimation;
+    u32 Sent = 0;
+
+    for(u32 I = 0; I < Count; ++I) {
+        buff Buff = {};
+        writeFrame(&Buff, frameAt(Arena, First + I), I);
+        u32 Hash = hashFramePacket(&Buff);
+        if(!Slot->Known || Slot->FrameHashes[I] != Hash) {
+            Ctx->SentBytes += sendBuffer(&Buff, Ctx->Tty);
+            Slot->FrameHashes[I] = Hash;
+            ++Sent;
+        }
+    }
+
+    if(!Slot->Known || Slot->FrameCount != Count) {
+        buff Buff = {};
+        writeUpdateFrameCount(&Buff, Count);
+        Ctx->SentBytes += sendBuffer(&Buff, Ctx->Tty);
+        Slot->FrameCount = Count;
+        ++Sent;
+    }
+
+    Slot->Known = true;
+    Slot->QueryPending = false;
+    return Sent;
+}
+
+// NOTE(nox): Asks the device what all slots hold, the answers are handled by serialPoll. Firmwares that
+// don't know the query ignore it, and then the slots just stay unknown.
+static void queryDeviceSlots(serial_ctx *Ctx) {
+    for(u32 I = 0; I < arrayCount(Ctx->Slots); ++I) {
+        buff Buff = {};
+        writeQueryFrameHashes(&Buff, I);
+        sendBuffer(&Buff, Ctx->Tty);
+        Ctx->Slots[I].QueryPending = true;
+    }
+}
+
+static void handleDevicePacket(void *User, buff *Pkt, u8 Command, u16 Length) {
+    serial_ctx *Ctx = (serial_ctx *)User;
+    switch(Command) {
+        case Command_FrameHashes: {
+            if(Length < 1+1+4*MaxFrames) {
+                break;
+            }
+
+            u8 Anim = readU8(Pkt);
+            if(Anim >= arrayCount(Ctx->Slots) || !Ctx->Slots[Anim].QueryPending) {
+                break;
+            }
+
+            device_slot *Slot = Ctx->Slots + Anim;
+            Slot->FrameCount = readU8(Pkt);
+            for(u32 I = 0; I < MaxFrames; ++I) {
+                Slot->FrameHashes[I] = readU32(Pkt);
+            }
+            Slot->Known = true;
+            Slot->QueryPending = false;
+        } break;
+
+        case Command_Echo: {
+            // NOTE(nox): Echoes of an earlier session may still arrive, the probe may not be set up for them
+            if(Ctx->ProbeLatency) {
+                handleEcho(&Ctx->Probe, Pkt, Length);
+            }
+        } break;
+
+        case Command_SceneStatus: {
+            if(readSceneStatus(Pkt, Length, &Ctx->SceneStatus)) {
+                ++Ctx->SceneStatusCount;
+            }
+        } break;
+
+        case Command_PlaylistStatus: {
+            if(readPlaylistStatus(Pkt, Length, &Ctx->PlaylistStatus)) {
+                ++Ctx->PlaylistStatusCount;
+            }
+        } break;
+
+        default: {} break;
+    }
+}
+
+// NOTE(nox): Sends a ping when one is due, the echo is handled by serialPoll
+static void serialProbe(serial_ctx *Ctx) {
+    u64 Now = getTimeUs();
+    if(Ctx->ProbeLatency && Now - Ctx->LastPingUs >= PingIntervalMs*1000) {
+        sendPing(&Ctx->Probe, Ctx->Tty);
+        Ctx->LastPingUs = Now;
+    }
+}
+
+static void serialPoll(serial_ctx *Ctx, int TimeoutMs) {
+    readPackets(Ctx->Tty, &Ctx->Reader, TimeoutMs, handleDevicePacket, Ctx);
+}
+
+// NOTE(nox): serialPoll returns with the first bytes that arrive, which may be a part of a packet. This
+// keeps reading until the whole TimeoutMs has passed.
+static void serialWait(serial_ctx *Ctx, int TimeoutMs) {
+    u64 End = getTimeUs() + TimeoutMs*1000;
+    for(u64 Now = getTimeUs(); Now < End; Now = getTimeUs()) {
+        serialPoll(Ctx, max((End - Now + 999)/1000, 1));
+    }
+}
+
+// NOTE(nox): Returns whether the query of the slot was answered before TimeoutMs passed
+static bool waitForSlot(serial_ctx *Ctx, u32 Anim, int TimeoutMs) {
+    device_slot *Slot = Ctx->Slots + Anim;
+    u64 End = getTimeUs() + TimeoutMs*1000;
+    for(u64 Now = getTimeUs(); Slot->QueryPending && Now < End; Now = getTimeUs()) {
+        serialPoll(Ctx, max((End - Now + 999)/1000, 1));
+    }
+    return !Slot->QueryPending;
+}
@@ -7,6 +7,9 @@
 #define assert(...)
 #include <common.h>
 #include <protocol.hpp>
+#include <glyphs.hpp>
+#include <playlist.hpp>
+#include "Link.h"
 
 enum {
     DacAddr = 0x60,
@@ -18,55 +21,164 @@ enum {
 };
 
 #include "Animations.h"
+#include "Settle.h"
+
+// NOTE(nox): Build with -D AnalogZ=1 when the Z input of the oscilloscope is wired to output C of the DAC
+// instead of ZPin. Z is then written in the same transaction as X and Y and latched by the same LDAC pulse,
+// so there is no ZTimer, and the bright level can be set with Command_SetIntensity.
+enum {
+    ZDark = 0,
+    ZChannelCmd = (0x40 | (2 << 1) | 1), // NOTE(nox): Multi-Write to output C, see setCoordinatesHighRes
+};
 
 static Timer2 FrameTimer = {};
+#if !AnalogZ
 static Timer4 ZTimer = {};
+static u16 LastX, LastY; // NOTE(nox): For the length of the next blanking window, see Settle.h
+#endif
 
 static volatile bool ShouldUpdate = false;
-static u32 SelectedAnimation = 0;
+static u32 SelectedAnimation = 0; // NOTE(nox): The slot that plays
+static u32 UploadSlot = 0;
+static playlist Playlist;
 static u32 SelectedFrame = 0;
 static u32 FrameRepeatCount = 0;
+static u32 TweenStep = 0; // NOTE(nox): 0 while the keyframe itself is drawn
 static bool SetTo0 = false;
 
-static rx_buff Rx;
-static buff Pkt;
-static bool SkipPacket;
+static u16 ZBright = HighResMax;
+static u16 ZOutput = ZDark; // NOTE(nox): What output C holds
+
+// NOTE(nox): For the latency probe
+static bool Drawing = false;
+static u32 FrameStartUs;
+static u32 FramePeriodUs;
+
+// NOTE(nox): Drawn on top of the animation, see glyphs.hpp
+static text_slot TextSlots[MaxTextSlots];
 
 static void selectFrame(u8 FrameIdx) {
     animation *Animation = Animations + SelectedAnimation;
     if(FrameIdx < Animation->FrameCount) {
         FrameRepeatCount = 0;
+        TweenStep = 0;
         SelectedFrame = FrameIdx;
         u16 Fps = max(Animation->Frames[SelectedFrame].Fps, MinFps);
         FrameTimer.setFrequency(Fps);
+        FramePeriodUs = 1000000 / Fps;
     }
 }
 
-static inline void selectAnim(int Anim) {
-    if(Anim) {
-        SelectedAnimation = 1;
-    }
-    else {
-        SelectedAnimation = 0;
-    }
+static inline void selectSlot(u32 Slot) {
+    SelectedAnimation = Slot;
+    UploadSlot = Slot;
+    clearPlaylist(&Playlist);
     selectFrame(0);
 }
 
-// NOTE(nox): X and Y are in the range [0, 64[, except when X has the Z bit set.
-static void setCoordinates(u8 X, u8 Y) {
+#if AnalogZ
+static void writeZ(u16 Z) {
+    u8 Data[] = {ZChannelCmd, (0x90 | ((Z >> 8) & 0x0F)), (Z & 0xFF)};
+    Wire.write(Data, arrayCount(Data));
+    ZOutput = Z;
+}
+#endif
+
+// NOTE(nox): X and Y are in the range [0, 4096[
+static void setCoordinatesHighRes(u16 X, u16 Y, bool Blank) {
+#if !AnalogZ
+    u32 Distance = jumpDistance(LastX, LastY, X, Y);
+    LastX = X;
+    LastY = Y;
+#endif
+
     LATDSET = LDAC;
 
     // NOTE(nox): Multi-Write command - 5.6.2
-    u8 Data[] = {(0x40 | (0 << 1) | 1), (0x90 | inputMsb(X)), inputLsb(X),  // Output A
-                 (0x40 | (1 << 1) | 1), (0x90 | inputMsb(Y)), inputLsb(Y)}; // Output B
+    u8 Data[] = {(0x40 | (0 << 1) | 1), (0x90 | ((X >> 8) & 0x0F)), (X & 0xFF),  // Output A
+                 (0x40 | (1 << 1) | 1), (0x90 | ((Y >> 8) & 0x0F)), (Y & 0xFF)}; // Output B
     Wire.beginTransmission(DacAddr);
     Wire.write(Data, arrayCount(Data));
+#if AnalogZ
+    // NOTE(nox): Output C is only written when Z changes, so lit points cost the same 7 bytes as before
+    u16 Z = Blank ? ZDark : ZBright;
+    if(Z != ZOutput) {
+        writeZ(Z);
+    }
+#endif
     Wire.endTransmission();
 
-    LATDCLR = (X & ZDisableBit) ? ZPin : 0;
-    ZTimer.start();
+#if !AnalogZ
+    if(Blank) {
+        LATDCLR = ZPin;
+        ZTimer.reset();
+        ZTimer.setPeriod(settleTicks(Distance));
+        ZTimer.start();
+    }
+#endif
+
+    LATDCLR = LDAC; // NOTE(nox): Active all outputs at the same time
+
+#if AnalogZ
+    if(Blank) {
+        // NOTE(nox): The beam was dark while it moved here, and this point is lit again. The 4 bytes at
+        // 1MHz take longer than SettleFullScaleUs, so nothing has to wait for it.
+        LATDSET = LDAC;
+        Wire.beginTransmission(DacAddr);
+        writeZ(ZBright);
+        Wire.endTransmission();
+        LATDCLR = LDAC;
+    }
+#endif
+}
 
-    LATDCLR = LDAC; // NOTE(nox): Active both outputs at the same time
+// NOTE(nox): X and Y are in the range [0, 64[, except when X has the Z bit set.
+static inline void setCoordinates(u8 X, u8 Y) {
+    setCoordinatesHighRes((X & (GridSize-1)) << GridToHighResShift, Y << GridToHighResShift, X & ZDisableBit);
+}
+
+// NOTE(nox): Point I of a frame of either format, in the range of setCoordinatesHighRes
+static void framePoint(frame *Frame, u32 I, u16 *X, u16 *Y, bool *Blank) {
+    if(Frame->Format == FrameFormat_HighRes) {
+        unpackHighResPoint(Frame->Packed, I, X, Y);
+        *Blank = isHighResBlank(Frame->Packed + 3*Frame->PointCount, I);
+    }
+    else {
+        point *P = Frame->Points + I;
+        *X = (P->X & (GridSize-1)) << GridToHighResShift;
+        *Y = P->Y << GridToHighResShift;
+        *Blank = P->X & ZDisableBit;
+    }
+}
+
+static void drawFrame(frame *Frame) {
+    if(Frame->Format == FrameFormat_HighRes) {
+        u8 *Blanks = Frame->Packed + 3*Frame->PointCount;
+        for(u32 I = 0; I < Frame->PointCount; ++I) {
+            u16 X, Y;
+            unpackHighResPoint(Frame->Packed, I, &X, &Y);
+            setCoordinatesHighRes(X, Y, isHighResBlank(Blanks, I));
+        }
+    }
+    else {
+        for(u32 I = 0; I < Frame->PointCount; ++I) {
+            point *P = Frame->Points + I;
+            setCoordinates(P->X, P->Y);
+        }
+    }
+}
+
+// NOTE(nox): From and To have the same number of points. Blanking switches to the one of To halfway.
+static void drawTween(frame *From, frame *To, u32 Step) {
+    u32 Progress = tweenProgress(Step, From->TweenCount, From->Easing);
+    for(u32 I = 0; I < From->PointCount; ++I) {
+        u16 FromX, FromY, ToX, ToY;
+        bool FromBlank, ToBlank;
+        framePoint(From, I, &FromX, &FromY, &FromBlank);
+        framePoint(To, I, &ToX, &ToY, &ToBlank);
+        setCoordinatesHighRes(tweenCoord(FromX, ToX, Progress), tweenCoord(FromY, ToY, Progress),
+                              Progress < TweenOne/2 ? FromBlank : ToBlank);
+    }
 }
 
 static void powerOffOutputs() {
@@ -79,167 +191,240 @@ static void powerOffOutputs() {
     Wire.endTransmission();
 }
 
-static void nextPacket() {
-    while(Rx.Read != Rx.Write && Rx.Data[Rx.Read]) {
-        Rx.Read = (Rx.Read + 1) & Rx.Mask;
+// NOTE(nox): Same bytes the host hashes, see hashBytes
+static u32 hashFrame(frame *Frame) {
+    u8 Header[] = {(u8)Frame->Fps,         (u8)(Frame->Fps >> 8),
+                   (u8)Frame->RepeatCount, (u8)(Frame->RepeatCount >> 8),
+                   (u8)Frame->PointCount,  (u8)(Frame->PointCount >> 8)};
+    u32 Hash = hashBytes(frameHashSeed(Frame->Format), Header, sizeof(Header));
+    u32 Size = (Frame->Format == FrameFormat_HighRes ? highResFrameSize(Frame->PointCount) :
+                Frame->PointCount*sizeof(point));
+    Hash = hashBytes(Hash, Frame->Packed, Size);
+    if(Frame->TweenCount) {
+        u8 Tween[] = {(u8)Frame->TweenCount, (u8)(Frame->TweenCount >> 8), Frame->Easing};
+        Hash = hashBytes(Hash, Tween, sizeof(Tween));
     }
+    return Hash;
+}
 
-    if(Rx.Read != Rx.Write && Rx.Data[Rx.Read] == 0) {
-        Rx.Read = (Rx.Read + 1) & Rx.Mask;
-        --Rx.NewPacketCount;
-        resetBuff(&Pkt);
-        SkipPacket = false;
+// NOTE(nox): The tween that may follow the points, see tweenProgress
+static void readTween(frame *Frame, u32 Remaining) {
+    Frame->TweenCount = 0;
+    Frame->Easing = Ease_Linear;
+    if(Remaining >= TweenSize) {
+        Frame->TweenCount = readU16(&Pkt);
+        Frame->Easing = readU8(&Pkt);
     }
 }
 
-static void decodeRx() {
-    if(SkipPacket) {
-        nextPacket();
-        if(SkipPacket) {
-            return;
-        }
-    }
+static void handlePacket(u8 Command, u16 Length) {
+    switch((command)Command) {
+        case Command_InfoLedOn: {
+            LATGSET = InfoLed;
+        } break;
+
+        case Command_InfoLedOff: {
+            LATGCLR = InfoLed;
+        } break;
+
+        case Command_PowerOn: {
+            selectFrame(0);
+            FrameTimer.start();
+            LATDSET = ZPin;
+            Drawing = true;
+        } break;
+
+        case Command_PowerOff: {
+            FrameTimer.stop();
+#if !AnalogZ
+            ZTimer.stop();
+#endif
+            ShouldUpdate = false;
+            powerOffOutputs();
+            LATDCLR = ZPin;
+            ZOutput = ZDark; // NOTE(nox): Output C is pulled to ground too
+            Drawing = false;
+        } break;
+
+        case Command_Select0: {
+            selectSlot(0);
+        } break;
+
+        case Command_Select1: {
+            selectSlot(1);
+        } break;
+
+        case Command_SelectSlot: {
+            if(Length < 1) {
+                break;
+            }
+            u8 Slot = readU8(&Pkt);
+            if(Slot < AnimCount) {
+                selectSlot(Slot);
+            }
+        } break;
 
-    // NOTE(nox): With classical COBS, we ignore the zero of the last group of an encoded message,
-    // because it is the "ghost zero" that is added to the end of the message before encoding. We just
-    // wait for a message to arrive completely, which is marked by the delimiter, and ignore the last
-    // zero.
-    //
-    // However, with the delimiter at the start, we can't assume that we have the whole message yet (we
-    // can't know!), so we need to add all zeros of each decoded group even if the group is the last we
-    // have at the moment, because we may still be in the middle of a transmission and not at the end of
-    // the message.
-    //
-    // On the other hand, if a message is truncated and we start to transmit another, we will know
-    // immediately because the delimiter is at the beginning of the packets.
-
-    bool DidUnstuff = false;
-    u8 Code = 0xFF, Copy = 0;
-    for(;; --Copy) {
-        u8 Byte = Rx.Data[Rx.Read];
-        if(Copy == 0) {
-            if(Code != 0xFF) {
-                Pkt.Data[Pkt.Write++] = 0;
+        case Command_UploadSlot: {
+            if(Length < 1) {
+                break;
+            }
+            u8 Slot = readU8(&Pkt);
+            if(Slot < AnimCount) {
+                UploadSlot = Slot;
             }
+        } break;
 
-            Copy = Code = Byte;
-            if(Code == 0 || Copy > ((Rx.Write - Rx.Read) & Rx.Mask)) {
+        case Command_SetPlaylist: {
+            playlist_entry Entries[MaxPlaylistEntries];
+            u32 Count;
+            if(readPlaylist(&Pkt, Length, AnimCount, Entries, &Count)) {
+                setPlaylist(&Playlist, Entries, Count);
+            }
+        } break;
+
+        case Command_QueryPlaylist: {
+            playlist_status Status;
+            playlistStatus(&Playlist, SelectedAnimation, UploadSlot, &Status);
+            resetBuff(&Pkt);
+            writePlaylistStatus(&Pkt, &Status);
+            uartSend(&Pkt);
+        } break;
+
+        case Command_UpdateFrame: {
+            enum { CmdHeaderSize = 1+2+2+2 };
+
+            if(Length < CmdHeaderSize) {
                 break;
             }
 
-            Rx.Read = (Rx.Read + 1) & Rx.Mask;
-            DidUnstuff = true;
-        }
-        else if(Byte) {
-            Pkt.Data[Pkt.Write++] = Byte;
-            Rx.Read = (Rx.Read + 1) & Rx.Mask;
-        }
-        else {
-            // NOTE(nox): Encoded message ends too soon! We have encountered a delimeter (0) while we
-            // should still be copying
-            return;
-        }
-    }
+            u8 FrameIdx = readU8(&Pkt);
+            u16 Fps = readU16(&Pkt);
+            u16 RepeatCount = readU16(&Pkt);
+            u16 PointCount = readU16(&Pkt);
 
-    if(DidUnstuff && Pkt.Write >= (1+2)) {
-        u8 FirstByte = readU8NoAdv(&Pkt);
-        u8 MagicTest =             (FirstByte & 0xF0);
-        command Command = (command)(FirstByte & 0x0F);
-        if(MagicTest == MagicNumber) {
-            u16 Length = readU16NoAdv(&Pkt, 1);
-            if(Pkt.Write - 3 >= Length) {
-                Pkt.Read += 3;
-
-                switch(Command) {
-                    case Command_InfoLedOn: {
-                        LATGSET = InfoLed;
-                    } break;
-
-                    case Command_InfoLedOff: {
-                        LATGCLR = InfoLed;
-                    } break;
-
-                    case Command_PowerOn: {
-                        selectFrame(0);
-                        FrameTimer.start();
-                        LATDSET = ZPin;
-                    } break;
-
-                    case Command_PowerOff: {
-                        FrameTimer.stop();
-                        ZTimer.stop();
-                        ShouldUpdate = false;
-                        powerOffOutputs();
-                        LATDCLR = ZPin;
-                    } break;
-
-                    case Command_Select0: {
-                        selectAnim(0);
-                    } break;
-
-                    case Command_Select1: {
-                        selectAnim(1);
-                    } break;
-
-                    case Command_UpdateFrame: {
-                        enum { CmdHeaderSize = 1+2+2+2 };
-
-                        if(Length < CmdHeaderSize) {
-                            break;
-                        }
-
-                        u8 FrameIdx = readU8(&Pkt);
-                        u16 Fps = readU16(&Pkt);
-                        u16 RepeatCount = readU16(&Pkt);
-                        u16 PointCount = readU16(&Pkt);
-
-                        if((Length-CmdHeaderSize < 2*PointCount ||
-                            FrameIdx > MaxFrames || PointCount > MaxPointsPerFrame)) {
-                            break;
-                        }
-
-                        frame *Frame = Animations[SelectedAnimation].Frames + FrameIdx;
-                        Frame->Fps = max(Fps, MinFps);
-                        Frame->RepeatCount = RepeatCount;
-                        Frame->PointCount  = PointCount;
-                        for(u16 I = 0; I < PointCount; ++I) {
-                            point *Point = Frame->Points + I;
-                            Point->X = readU8(&Pkt);
-                            Point->Y = readU8(&Pkt);
-                        }
-
-                        if(SelectedFrame == FrameIdx) {
-                            selectFrame(FrameIdx);
-                        }
-                    } break;
-
-                    case Command_UpdateFrameCount: {
-                        u8 FrameCount = readU8(&Pkt);
-                        FrameCount = clamp(1, FrameCount, MaxFrames);
-                        Animations[SelectedAnimation].FrameCount = FrameCount;
-
-                        selectFrame(0);
-                    } break;
-
-                    case Command_SetTo0: {
-                        SetTo0 = true;
-                    } break;
-
-                    case Command_DontSetTo0: {
-                        SetTo0 = false;
-                    } break;
-
-                    default: {} break;
-                }
+            if((Length-CmdHeaderSize < 2*PointCount ||
+                FrameIdx >= MaxFrames || PointCount > MaxPointsPerFrame)) {
+                break;
+            }
 
-                // NOTE(nox): We are done with this packet
-                SkipPacket = true;
+            frame *Frame = Animations[UploadSlot].Frames + FrameIdx;
+            Frame->Fps = max(Fps, MinFps);
+            Frame->RepeatCount = RepeatCount;
+            Frame->PointCount  = PointCount;
+            Frame->Format = FrameFormat_Grid;
+            for(u16 I = 0; I < PointCount; ++I) {
+                point *Point = Frame->Points + I;
+                Point->X = readU8(&Pkt);
+                Point->Y = readU8(&Pkt);
             }
-        }
-        else {
-            // NOTE(nox): Invalid packet start!
-            SkipPacket = true;
-        }
+            readTween(Frame, Length-CmdHeaderSize - 2*PointCount);
+
+            if(UploadSlot == SelectedAnimation && SelectedFrame == FrameIdx) {
+                selectFrame(FrameIdx);
+            }
+        } break;
+
+        case Command_UpdateFrameHighRes: {
+            enum { CmdHeaderSize = 1+2+2+2 };
+
+            if(Length < CmdHeaderSize) {
+                break;
+            }
+
+            u8 FrameIdx = readU8(&Pkt);
+            u16 Fps = readU16(&Pkt);
+            u16 RepeatCount = readU16(&Pkt);
+            u16 PointCount = readU16(&Pkt);
+
+            if(((u32)(Length-CmdHeaderSize) < highResFrameSize(PointCount) ||
+                FrameIdx >= MaxFrames || PointCount > MaxHighResPoints)) {
+                break;
+            }
+
+            // NOTE(nox): Kept packed, see Animations.h
+            frame *Frame = Animations[UploadSlot].Frames + FrameIdx;
+            Frame->Fps = max(Fps, MinFps);
+            Frame->RepeatCount = RepeatCount;
+            Frame->PointCount  = PointCount;
+            Frame->Format = FrameFormat_HighRes;
+            memcpy(Frame->Packed, Pkt.Data + Pkt.Read, highResFrameSize(PointCount));
+            Pkt.Read += highResFrameSize(PointCount);
+            readTween(Frame, Length-CmdHeaderSize - highResFrameSize(PointCount));
+
+            if(UploadSlot == SelectedAnimation && SelectedFrame == FrameIdx) {
+                selectFrame(FrameIdx);
+            }
+        } break;
+
+        case Command_UpdateFrameCount: {
+            u8 FrameCount = readU8(&Pkt);
+            FrameCount = clamp(1, FrameCount, MaxFrames);
+            Animations[UploadSlot].FrameCount = FrameCount;
+
+            if(UploadSlot == SelectedAnimation) {
+                selectFrame(0);
+            }
+        } break;
+
+        case Command_QueryFrameHashes: {
+            u8 Anim = readU8(&Pkt);
+            if(Anim >= AnimCount) {
+                break;
+            }
+
+            animation *Animation = Animations + Anim;
+            u32 Hashes[MaxFrames];
+            for(u32 I = 0; I < MaxFrames; ++I) {
+                Hashes[I] = hashFrame(Animation->Frames + I);
+            }
+
+            // NOTE(nox): The request has been consumed, so the answer is built in its place
+            resetBuff(&Pkt);
+            writeFrameHashes(&Pkt, Anim, Animation->FrameCount, Hashes);
+            uartSend(&Pkt);
+        } break;
+
+        case Command_Ping: {
+            enum { CmdSize = 4+4 };
+            u32 Now = micros();
+            if(Length < CmdSize) {
+                break;
+            }
+
+            echo_info Echo = {};
+            Echo.Seq = readU32(&Pkt);
+            Echo.HostTimeUs = readU32(&Pkt);
+            Echo.DeviceRxUs = Now;
+            Echo.SinceFrameUs = Now - FrameStartUs;
+            Echo.FramePeriodUs = FramePeriodUs;
+            Echo.State = Drawing ? DeviceState_Drawing : 0;
+
+            resetBuff(&Pkt);
+            Echo.DeviceTxUs = micros();
+            writeEcho(&Pkt, &Echo);
+            uartSend(&Pkt);
+        } break;
+
+        case Command_DrawText: {
+            handleDrawText(&Pkt, Length, TextSlots);
+        } break;
+
+        case Command_SetTo0: {
+            SetTo0 = true;
+        } break;
+
+        case Command_DontSetTo0: {
+            SetTo0 = false;
+        } break;
+
+        case Command_SetIntensity: {
+            if(Length >= 2) {
+                // NOTE(nox): Used from the next point on
+                ZBright = min((s32)readU16(&Pkt), (s32)HighResMax);
+            }
+        } break;
+
+        default: {} break;
     }
 }
 
@@ -248,11 +433,13 @@ static void __USER_ISR setUpdateFlag() {
     clearIntFlag(_TIMER_2_IRQ);
 }
 
+#if !AnalogZ
 static void __USER_ISR enableZ() {
     LATDSET = ZPin;
     ZTimer.stop();
     clearIntFlag(_TIMER_4_IRQ);
 }
+#endif
 
 static void __USER_ISR uartRx() {
     u8 Byte = U1RXREG;
@@ -307,30 +494,55 @@ void setup() {
 
         // NOTE(nox): PD1 = 1, PD0 = 0 -> 100kΩ to ground
         u8 DisabledData[] = {0x40, 0x00};
+#if AnalogZ
+        Wire.write(ActiveData, 2); // NOTE(nox): Output C starts dark
+#else
         Wire.write(DisabledData, 2);
+#endif
         Wire.write(DisabledData, 2);
 
         Wire.endTransmission();
     }
     delay(50);
 
-    selectAnim(0);
+    selectSlot(0);
     FrameTimer.attachInterrupt(setUpdateFlag);
     FrameTimer.start();
+    Drawing = true;
 
-    // NOTE(nox): This prevents the transitions from being visible in the XYZ mode, and needs to wait at
-    // least the settling time, 6.5us. Giving it some margin, we chose 10us of period.
-    ZTimer.setFrequency(100000);
+#if !AnalogZ
+    // NOTE(nox): This prevents the transitions from being visible in the XYZ mode. The period is set for
+    // each jump, see Settle.h, this only selects the prescaler.
+    ZTimer.setFrequency(1000000 / SettleFullScaleUs);
     ZTimer.attachInterrupt(enableZ);
+#endif
 }
 
 void loop() {
     if(ShouldUpdate) {
+        FrameStartUs = micros();
         animation *Anim = Animations + SelectedAnimation;
         frame *Frame = Anim->Frames + SelectedFrame;
-        for(u32 I = 0; I < Frame->PointCount; ++I) {
-            point *P = Frame->Points + I;
-            setCoordinates(P->X, P->Y);
+
+        // NOTE(nox): After the last frame comes the first one of the same slot or of the next entry of
+        // the playlist
+        bool EndOfPass = SelectedFrame + 1 >= Anim->FrameCount;
+        playlist_entry *NextEntry = EndOfPass ? nextPlaylistEntry(&Playlist) : 0;
+        u32 NextIdx = EndOfPass ? 0 : SelectedFrame + 1;
+        frame *Next = Animations[NextEntry ? NextEntry->Slot : SelectedAnimation].Frames + NextIdx;
+        bool CanTween = (Next->PointCount == Frame->PointCount &&
+                         (!NextEntry || NextEntry->Transition == Transition_Tween));
+        if(TweenStep && CanTween) {
+            drawTween(Frame, Next, TweenStep);
+        }
+        else {
+            drawFrame(Frame);
+        }
+        for(u32 Slot = 0; Slot < MaxTextSlots; ++Slot) {
+            text_slot *Text = TextSlots + Slot;
+            for(u32 I = 0; I < Text->Count; ++I) {
+                setCoordinates(Text->Points[I].X, Text->Points[I].Y);
+            }
         }
         if(SetTo0) {
             setCoordinates(0, 0);
@@ -338,16 +550,20 @@ void loop() {
 
         ++FrameRepeatCount;
         if(FrameRepeatCount >= Frame->RepeatCount) {
-            selectFrame((SelectedFrame + 1 >= Anim->FrameCount) ? 0 : SelectedFrame + 1);
+            if(CanTween && TweenStep < Frame->TweenCount) {
+                ++TweenStep;
+            }
+            else {
+                if(EndOfPass && endPlaylistPass(&Playlist)) {
+                    SelectedAnimation = NextEntry->Slot;
+                }
+                selectFrame(NextIdx);
+            }
         }
         ShouldUpdate = false;
     }
 
-    decodeRx();
-    while(Rx.NewPacketCount) {
-        nextPacket();
-        decodeRx();
-    }
+    processRx();
 }
 
 #endif
@@ -2,13 +2,25 @@ typedef struct {
     u8 X, Y;
 } point;
 
+// NOTE(nox): High resolution frames keep their points packed like on the wire, in the same bytes, so they
+// don't make the animations any bigger. Format and the tween are last so AnimationData.h can leave them out
+// for grid frames without one.
 typedef struct {
     u16 Fps;
     u16 RepeatCount;
     u16 PointCount;
-    point Points[MaxPointsPerFrame];
+    union {
+        point Points[MaxPointsPerFrame];
+        u8 Packed[MaxPointsPerFrame*sizeof(point)];
+    };
+    u8 Format; // NOTE(nox): FrameFormat_*
+    u16 TweenCount; // NOTE(nox): Frames drawn on the way to the next one, see tweenProgress
+    u8 Easing;
 } frame;
 
+static_assert(highResFrameSize(MaxHighResPoints) <= sizeof(((frame *)0)->Packed),
+              "High resolution frames must fit in the points of a grid frame");
+
 typedef struct {
     u32 FrameCount;
     frame Frames[MaxFrames];
@@ -16,5 +28,5 @@ typedef struct {
 
 // NOTE(nox): For the data, AnimationData.h needs to define:
 // static animation Animations[AnimCount] = {...};
-enum { AnimCount = 2 };
+enum { AnimCount = AnimSlotCount };
 #include "AnimationData.h"
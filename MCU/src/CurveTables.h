@@ -0,0 +1,84 @@
+#if !defined(CURVE_TABLES_H)
+#define CURVE_TABLES_H
+
+// NOTE(nox): Sine tables generated by the compiler, so a new size or amplitude is a new template argument
+// instead of a hundred numbers typed from a spreadsheet. The tables are constexpr and end up in flash.
+//
+//     typedef sine_table<128, 2047, 2048> big_sin; // NOTE(nox): Full 12-bit range
+//     setCoordinates(big_sin::at(I + big_sin::Quarter), big_sin::at(I));
+//
+// Sizes are powers of two, so wrapping the index is a mask. The toolchain is C++11, so every constexpr
+// function below is a single return and loops are recursion. Needs u16, u32 and s32.
+
+static constexpr double CurvePi = 3.14159265358979323846;
+
+// NOTE(nox): Taylor series, Term is X^(2K-1)/(2K-1)! with its sign. Good to double precision for |X| <= Pi.
+static constexpr double curveSinSeries(double Term, double X2, u32 K) {
+    return K > 12 ? 0 : Term + curveSinSeries(-Term*X2 / ((2*K)*(2*K + 1)), X2, K + 1);
+}
+
+static constexpr double curveSinReduced(double X) {
+    return curveSinSeries(X, X*X, 1);
+}
+
+// NOTE(nox): Sine of Step/Size of a turn
+static constexpr double curveSin(u32 Step, u32 Size) {
+    return curveSinReduced(2*CurvePi*(Step % Size) / Size - (2*(Step % Size) > Size ? 2*CurvePi : 0));
+}
+
+static constexpr s32 curveRound(double X) {
+    return X < 0 ? (s32)(X - 0.5) : (s32)(X + 0.5);
+}
+
+static constexpr u16 curveSample(u32 Step, u32 Size, s32 Amplitude, s32 Offset) {
+    return (u16)curveRound(Offset + Amplitude*curveSin(Step, Size));
+}
+
+// NOTE(nox): 0, 1, ..., N-1 as a parameter pack. Built by halves so big tables don't hit the template depth
+// limit.
+template<u32... I> struct curve_indices {};
+
+template<typename A, typename B> struct concat_curve_indices;
+template<u32... I, u32... J> struct concat_curve_indices<curve_indices<I...>, curve_indices<J...>> {
+    typedef curve_indices<I..., (sizeof...(I) + J)...> type;
+};
+
+template<u32 N> struct make_curve_indices {
+    typedef typename concat_curve_indices<typename make_curve_indices<N/2>::type,
+                                          typename make_curve_indices<N - N/2>::type>::type type;
+};
+template<> struct make_curve_indices<0> { typedef curve_indices<> type; };
+template<> struct make_curve_indices<1> { typedef curve_indices<0> type; };
+
+template<u32 Size, s32 Amplitude, s32 Offset, u32 Phase, typename Indices> struct curve_table_data;
+template<u32 Size, s32 Amplitude, s32 Offset, u32 Phase, u32... I>
+struct curve_table_data<Size, Amplitude, Offset, Phase, curve_indices<I...>> {
+    static constexpr u16 Values[Size] = {curveSample(I + Phase, Size, Amplitude, Offset)...};
+};
+
+template<u32 Size, s32 Amplitude, s32 Offset, u32 Phase, u32... I>
+constexpr u16 curve_table_data<Size, Amplitude, Offset, Phase, curve_indices<I...>>::Values[Size];
+
+// NOTE(nox): Offset + Amplitude*sin(2 pi (I + Phase)/SampleCount), rounded. Phase is in samples.
+template<u32 SampleCount, s32 Amplitude, s32 Offset, u32 Phase = 0>
+struct sine_table : curve_table_data<SampleCount, Amplitude, Offset, Phase,
+                                     typename make_curve_indices<SampleCount>::type> {
+    static_assert(SampleCount >= 4 && (SampleCount & (SampleCount - 1)) == 0,
+                  "Curve tables are a power of two long");
+    static_assert(Offset - Amplitude >= 0 && Offset + Amplitude <= 0xFFFF, "Samples must fit in a u16");
+
+    enum : u32 {
+        Size = SampleCount,
+        Mask = SampleCount - 1,
+        Quarter = SampleCount / 4, // NOTE(nox): at(I + Quarter) is the cosine
+    };
+
+    static inline u16 at(u32 I) {
+        return sine_table::Values[I & Mask];
+    }
+};
+
+template<u32 SampleCount, s32 Amplitude, s32 Offset, u32 Phase = 0>
+using cosine_table = sine_table<SampleCount, Amplitude, Offset, Phase + SampleCount/4>;
+
+#endif // CURVE_TABLES_H
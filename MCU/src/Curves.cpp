@@ -0,0 +1,197 @@
+#if Curves
+
+// NOTE(nox): Draws the parametric curves set with Command_Curve (see Dds.h), computed point by point at the
+// full 12-bit resolution of the DAC. A timer ticks at the point rate and the main loop draws one point per
+// tick, so the timing does not depend on how long the I2C transfers take, as long as they keep up.
+
+#include <Arduino.h>
+#include "external/Wire.h"
+#include "external/timer.h"
+
+#define assert(...)
+#include <common.h>
+#include <protocol.hpp>
+#include "Link.h"
+#include "CurveTables.h"
+#include "Dds.h"
+
+#define dacMsb(Val) ((Val >> 8) & 0x0F)
+#define dacLsb(Val) ((Val >> 0) & 0xFF)
+
+enum {
+    DacAddr = 0x60,
+    LDAC = 1<<9,    // RD9
+    ZPin = 1<<2,    // RD2
+    InfoLed = 1<<6, // RG2
+    FPB = 80000000,
+};
+
+static Timer2 PointTimer = {};
+
+static volatile u32 PointTicks; // NOTE(nox): Only written by the ISR
+static u32 PointsDone;
+static bool Drawing = false;
+
+static dds_curve Curve;
+
+// NOTE(nox): X and Y are in the range [0, 4096[
+static void setCoordinates(u16 X, u16 Y) {
+    LATDSET = LDAC;
+
+    // NOTE(nox): Multi-Write command - 5.6.2
+    u8 Data[] = {(0x40 | (0 << 1) | 1), (0x90 | dacMsb(X)), dacLsb(X),  // Output A
+                 (0x40 | (1 << 1) | 1), (0x90 | dacMsb(Y)), dacLsb(Y)}; // Output B
+    Wire.beginTransmission(DacAddr);
+    Wire.write(Data, arrayCount(Data));
+    Wire.endTransmission();
+
+    LATDCLR = LDAC; // NOTE(nox): Active both outputs at the same time
+}
+
+static void powerOffOutputs() {
+    // NOTE(nox): Select power-down bits - 5.6.6
+    // PD1 = 1, PD0 = 0 -> 100kΩ to ground
+    enum {Cmd = 0xA0};
+    u8 Data[] = {(Cmd | 0x0A), (0xA0)};
+    Wire.beginTransmission(DacAddr);
+    Wire.write(Data, arrayCount(Data));
+    Wire.endTransmission();
+}
+
+static void setCurve(curve_params *Params) {
+    setupCurve(&Curve, Params);
+    PointTimer.setFrequency(Curve.Params.PointRate);
+}
+
+static void handlePacket(u8 Command, u16 Length) {
+    switch((command)Command) {
+        case Command_InfoLedOn: {
+            LATGSET = InfoLed;
+        } break;
+
+        case Command_InfoLedOff: {
+            LATGCLR = InfoLed;
+        } break;
+
+        case Command_PowerOn: {
+            PointsDone = PointTicks;
+            PointTimer.start();
+            LATDSET = ZPin;
+            Drawing = true;
+        } break;
+
+        case Command_PowerOff: {
+            PointTimer.stop();
+            powerOffOutputs();
+            LATDCLR = ZPin;
+            Drawing = false;
+        } break;
+
+        case Command_Curve: {
+            curve_params Params;
+            if(readCurve(&Pkt, Length, &Params)) {
+                setCurve(&Params);
+            }
+        } break;
+
+        default: {} break;
+    }
+}
+
+static void __USER_ISR pointTick() {
+    ++PointTicks;
+    clearIntFlag(_TIMER_2_IRQ);
+}
+
+static void __USER_ISR uartRx() {
+    u8 Byte = U1RXREG;
+    u32 NextWrite = (Rx.Write + 1) & Rx.Mask;
+
+    if(NextWrite != Rx.Read) {
+        Rx.Data[Rx.Write] = Byte;
+        Rx.Write = NextWrite;
+        if(Byte == 0) {
+            Rx.NewPacketCount++;
+        }
+    }
+    else {
+        // NOTE(nox): In the case of a buffer overflow, the _new_ byte is dropped. The information LED
+        // will light up so we know if it ever happens.
+        LATGSET = InfoLed;
+    }
+
+    clearIntFlag(_UART1_RX_IRQ);
+}
+
+void setup() {
+    // NOTE(nox): Setup serial communication
+    U1BRG = FPB/(4.0*BaudRate)-1;
+    U1MODEbits.ON   = 1;
+    U1MODEbits.BRGH = 1;
+    U1STAbits.UTXEN = 1;
+    U1STAbits.URXEN = 1;
+    U1STAbits.URXISEL = 0;
+    setIntVector(_UART1_VECTOR, uartRx);
+    setIntPriority(_UART1_VECTOR, 2, 2);
+    clearIntFlag(_UART1_RX_IRQ);
+    setIntEnable(_UART1_RX_IRQ);
+
+    TRISDCLR = LDAC | ZPin;
+    LATDSET  = LDAC | ZPin;
+    TRISGCLR = InfoLed;
+    LATGCLR  = InfoLed;
+
+    Wire.begin();
+    u32 Clock = Wire.setClock(1000000);
+
+    // NOTE(nox): Sequential write command (A -> D) - 5.6.3
+    {
+        Wire.beginTransmission(DacAddr);
+        Wire.write(0x50);
+
+        // NOTE(nox): VRef = 1 (internal voltage reference), Gx = 1 (2x gain)
+        u8 ActiveData[] = {0x90, 0x00};
+        Wire.write(ActiveData, 2);
+        Wire.write(ActiveData, 2);
+
+        // NOTE(nox): PD1 = 1, PD0 = 0 -> 100kΩ to ground
+        u8 DisabledData[] = {0x40, 0x00};
+        Wire.write(DisabledData, 2);
+        Wire.write(DisabledData, 2);
+
+        Wire.endTransmission();
+    }
+    delay(50);
+
+    // NOTE(nox): The circle the Circles firmware draws, until the host asks for something else
+    curve_params Circle = {};
+    Circle.Type = Curve_Lissajous;
+    Circle.PointRate = CurveDefaultPointRate;
+    Circle.FreqX = Circle.FreqY = 30000;
+    Circle.Phase = 1 << 14; // NOTE(nox): A quarter turn, X is the cosine
+    Circle.AmpX = Circle.AmpY = 2047;
+    Circle.CenterX = Circle.CenterY = 2048;
+    setCurve(&Circle);
+
+    PointTimer.attachInterrupt(pointTick);
+    PointTimer.start();
+    Drawing = true;
+}
+
+void loop() {
+    u32 Ticks = PointTicks;
+    u32 Due = Ticks - PointsDone;
+    if(Drawing && Due) {
+        u16 X, Y;
+        curvePoint(&Curve, &X, &Y);
+        setCoordinates(X, Y);
+
+        // NOTE(nox): If we fell behind, the missed points are skipped instead of drawn late
+        advanceCurve(&Curve, Due);
+        PointsDone = Ticks;
+    }
+
+    processRx();
+}
+
+#endif
@@ -0,0 +1,79 @@
+#if !defined(DDS_H)
+#define DDS_H
+
+// NOTE(nox): Direct digital synthesis of the curves of Command_Curve. Each axis has a 32-bit phase
+// accumulator that wraps once per turn and advances by a fixed increment per point, so a frequency is
+// exact to a fraction of a mHz and any ratio between the axes is just two increments. The top bits of the
+// phase index a Q15 sine table. All integer, the PIC32MX has no FPU. Needs common.h, protocol.hpp and
+// CurveTables.h.
+
+typedef sine_table<1024, 32767, 32768> dds_sin;
+
+enum {
+    DdsIndexShift = 32 - 10, // NOTE(nox): Phase bits that index dds_sin
+    DdsIndexRound = 1 << (DdsIndexShift - 1),
+};
+
+typedef struct {
+    curve_params Params;
+    u32 PhaseX;
+    u32 PhaseY;
+    u32 IncX; // NOTE(nox): Phase steps per point
+    u32 IncY;
+} dds_curve;
+
+// NOTE(nox): Q15, from the nearest sample
+static inline s32 ddsSin(u32 Phase) {
+    return (s32)dds_sin::at((Phase + DdsIndexRound) >> DdsIndexShift) - 32768;
+}
+
+static inline s32 ddsCos(u32 Phase) {
+    return (s32)dds_sin::at(((Phase + DdsIndexRound) >> DdsIndexShift) + dds_sin::Quarter) - 32768;
+}
+
+// NOTE(nox): Turns per point in 0.32, only done when a curve is set so the 64-bit division is fine
+static inline u32 ddsIncrement(u32 FreqMilliHz, u32 PointRate) {
+    return (u32)(((u64)FreqMilliHz << 32) / ((u64)PointRate*1000));
+}
+
+// NOTE(nox): Amplitudes are cut so the curve stays inside the DAC range
+static void setupCurve(dds_curve *Curve, curve_params *Params) {
+    curve_params *P = &Curve->Params;
+    *P = *Params;
+    P->Type = P->Type < CurveCount ? P->Type : (u8)Curve_Lissajous;
+    P->PointRate = clamp(CurveMinPointRate, P->PointRate, CurveMaxPointRate);
+    P->CenterX = min(P->CenterX, (s32)CurveDacMax);
+    P->CenterY = min(P->CenterY, (s32)CurveDacMax);
+    P->AmpX = min(P->AmpX, min(P->CenterX, CurveDacMax - P->CenterX));
+    P->AmpY = min(P->AmpY, min(P->CenterY, CurveDacMax - P->CenterY));
+
+    Curve->IncX = ddsIncrement(P->FreqX, P->PointRate);
+    Curve->IncY = ddsIncrement(P->FreqY, P->PointRate);
+    Curve->PhaseX = (u32)P->Phase << 16;
+    Curve->PhaseY = 0;
+}
+
+// NOTE(nox): Points that were not drawn in time are still stepped over, so the frequencies stay right
+static inline void advanceCurve(dds_curve *Curve, u32 Points) {
+    Curve->PhaseX += Curve->IncX*Points;
+    Curve->PhaseY += Curve->IncY*Points;
+}
+
+static inline void curvePoint(dds_curve *Curve, u16 *X, u16 *Y) {
+    curve_params *P = &Curve->Params;
+    s32 UnitX, UnitY;
+    if(P->Type == Curve_Rose) {
+        s32 Radius = ddsCos(Curve->PhaseX);
+        UnitX = (Radius*ddsCos(Curve->PhaseY)) >> 15;
+        UnitY = (Radius*ddsSin(Curve->PhaseY)) >> 15;
+    }
+    else {
+        UnitX = ddsSin(Curve->PhaseX);
+        UnitY = ddsSin(Curve->PhaseY);
+    }
+
+    *X = P->CenterX + ((P->AmpX*UnitX) >> 15);
+    *Y = P->CenterY + ((P->AmpY*UnitY) >> 15);
+}
+
+#endif // DDS_H
@@ -0,0 +1,146 @@
+#if !defined(LINK_H)
+#define LINK_H
+
+// NOTE(nox): Serial link, shared by the firmwares that talk to the host. Each firmware defines handlePacket
+// and calls processRx from its main loop, the UART ISR only fills Rx.
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Host -> device
+static rx_buff Rx;
+static buff Pkt;
+static bool SkipPacket;
+
+// NOTE(nox): Called for every complete packet, with Pkt.Read past the header. Pkt may be reused to build an
+// answer, as the request is not needed anymore.
+static void handlePacket(u8 Command, u16 Length);
+
+static void nextPacket() {
+    while(Rx.Read != Rx.Write && Rx.Data[Rx.Read]) {
+        Rx.Read = (Rx.Read + 1) & Rx.Mask;
+    }
+
+    if(Rx.Read != Rx.Write && Rx.Data[Rx.Read] == 0) {
+        Rx.Read = (Rx.Read + 1) & Rx.Mask;
+        --Rx.NewPacketCount;
+        resetBuff(&Pkt);
+        SkipPacket = false;
+    }
+}
+
+static void decodeRx() {
+    if(SkipPacket) {
+        nextPacket();
+        if(SkipPacket) {
+            return;
+        }
+    }
+
+    // NOTE(nox): With classical COBS, we ignore the zero of the last group of an encoded message,
+    // because it is the "ghost zero" that is added to the end of the message before encoding. We just
+    // wait for a message to arrive completely, which is marked by the delimiter, and ignore the last
+    // zero.
+    //
+    // However, with the delimiter at the start, we can't assume that we have the whole message yet (we
+    // can't know!), so we need to add all zeros of each decoded group even if the group is the last we
+    // have at the moment, because we may still be in the middle of a transmission and not at the end of
+    // the message.
+    //
+    // On the other hand, if a message is truncated and we start to transmit another, we will know
+    // immediately because the delimiter is at the beginning of the packets.
+
+    bool DidUnstuff = false;
+    u8 Code = 0xFF, Copy = 0;
+    for(;; --Copy) {
+        u8 Byte = Rx.Data[Rx.Read];
+        if(Copy == 0) {
+            if(Code != 0xFF) {
+                Pkt.Data[Pkt.Write++] = 0;
+            }
+
+            Copy = Code = Byte;
+            if(Code == 0 || Copy > ((Rx.Write - Rx.Read) & Rx.Mask)) {
+                break;
+            }
+
+            Rx.Read = (Rx.Read + 1) & Rx.Mask;
+            DidUnstuff = true;
+        }
+        else if(Byte) {
+            Pkt.Data[Pkt.Write++] = Byte;
+            Rx.Read = (Rx.Read + 1) & Rx.Mask;
+        }
+        else {
+            // NOTE(nox): Encoded message ends too soon! We have encountered a delimeter (0) while we
+            // should still be copying
+            return;
+        }
+    }
+
+    if(DidUnstuff && Pkt.Write >= (1+2)) {
+        u8 FirstByte = readU8NoAdv(&Pkt);
+        u8 MagicTest = (FirstByte & MagicMask);
+        u8 Command   = (FirstByte & CommandMask);
+        if(MagicTest == MagicNumber) {
+            u16 Length = readU16NoAdv(&Pkt, 1);
+            if(Pkt.Write - 3 >= Length) {
+                Pkt.Read += 3;
+                handlePacket(Command, Length);
+
+                // NOTE(nox): We are done with this packet
+                SkipPacket = true;
+            }
+        }
+        else {
+            // NOTE(nox): Invalid packet start!
+            SkipPacket = true;
+        }
+    }
+}
+
+// NOTE(nox): Handles everything that arrived since the last call
+static void processRx() {
+    decodeRx();
+    while(Rx.NewPacketCount) {
+        nextPacket();
+        decodeRx();
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Device -> host
+static inline void uartWrite(u8 Byte) {
+    while(U1STAbits.UTXBF) {}
+    U1TXREG = Byte;
+}
+
+// NOTE(nox): Sends Buff as a packet (Buff must start with the header written by writeHeader). The bytes are
+// stuffed as they are sent, exactly like stuffBytes does, so no second packet-sized buffer is needed and
+// the caller can build the answer in the buffer the request came in. This blocks until the last byte is
+// in the UART FIFO, which for small answers is a few ms at 115200 baud.
+template<typename buff_type>
+static void uartSend(buff_type *Buff) {
+    writePacketLength(Buff);
+
+    uartWrite(0); // NOTE(nox): Delimiter goes at the start
+    for(u32 Start = 0;;) {
+        u32 End = Start;
+        while(End < Buff->Write && Buff->Data[End] && End - Start < 0xFE) {
+            ++End;
+        }
+
+        uartWrite((u8)(End - Start + 1));
+        for(u32 I = Start; I < End; ++I) {
+            uartWrite(Buff->Data[I]);
+        }
+
+        if(End == Buff->Write) {
+            break;
+        }
+
+        // NOTE(nox): A full group (code 0xFF) doesn't stand for a zero
+        Start = (End - Start == 0xFE) ? End : End + 1;
+    }
+}
+
+#endif // LINK_H
@@ -6,6 +6,9 @@
 #define assert(...)
 #include <common.h>
 #include <protocol.hpp>
+#include <pong_fixed.hpp>
+#include <glyphs.hpp>
+#include "Link.h"
 
 enum {
     DacAddr = 0x60,
@@ -13,102 +16,110 @@ enum {
     InfoLed = 1<<6, // RG2
     MaxPointsPerFrame = 300,
     FPB = 80000000,
+    FrameRate = 60,
 };
 
 static Timer2 FrameTimer = {};
 
 static volatile bool ShouldUpdate = false;
+static u32 FrameStartUs; // NOTE(nox): For the latency probe
 static u8 LeftPaddleCenter = 32;
 static u8 RightPaddleCenter = 32;
-static u8 BallX = 128;
-static u8 BallY = 128;
 static u8 LeftScore;
 static u8 RightScore;
 
+// NOTE(nox): Scores are laid out again only when they change, and the text slots when the host sends text
+enum {
+    ScoreY = 58,
+    LeftScoreEndX = 28, // NOTE(nox): Last column of the left score, which grows to the left
+    RightScoreX = 35,
+    MaxScorePoints = 2*3*GlyphWidth*GlyphHeight,
+};
+
+static text_point ScorePoints[MaxScorePoints];
+static u32 ScorePointCount;
+static u8 LaidOutLeftScore = 0xFF, LaidOutRightScore = 0xFF;
+static text_slot TextSlots[MaxTextSlots];
+
+// NOTE(nox): Ball dead reckoning. The host sends the ball every 33ms or less often and we draw at 60Hz, so
+// between updates the ball keeps moving with the last velocity. Positions are high-res units in 24.8 fixed
+// point and velocities 8.8 high-res units per ms, as sent. When an update arrives, the distance between
+// where we were drawing the ball and where it really is is kept as a correction that fades out over a few
+// frames, unless it is big enough to be a bounce off a paddle or a new serve, where snapping looks right.
+enum {
+    BallMax = 255 << 8,
+    // NOTE(nox): If updates stop, so does the ball, after a few of the intervals the host sends them at
+    ExtrapolationIntervals = 3,
+    MinExtrapolationMs = 100,
+    MaxExtrapolationMs = 1000,
+    SnapDistance = 16 << 8,
+};
+
+static s32 BallX = 128 << 8;
+static s32 BallY = 128 << 8;
+static s16 BallVelX, BallVelY;
+static u32 BallTimeMs;
+static u32 BallIntervalMs; // NOTE(nox): Between the last two updates
+static s32 BallCorrectionX, BallCorrectionY;
+static u8 LastSeq;
+
+// NOTE(nox): When the game runs here, the host only sends keys (PongCmd_Input) and we send telemetry back
+// when something happens. Any PongCmd_Update gives control back to the host.
+static bool Simulating;
+static pong_sim Sim;
+static u8 SimKeys;
+
+// NOTE(nox): Pkt may hold half a packet when telemetry is sent. The answers are tiny, so they don't get a
+// whole buff.
+enum { MaxAnswerSize = 1+2 + 6*4+1 }; // NOTE(nox): An echo, telemetry is smaller
 typedef struct {
-    u8 X, Y;
-} point;
-typedef struct {
-    u32 PointCount;
-    point Points[13];
-} number;
-static const number Numbers[] = {
-    {
-        12,
-        {
-            {31, 62}, {32, 62}, {33, 62}, {33, 61}, {33, 60}, {33, 59}, {33, 58},
-            {32, 58}, {31, 58}, {31, 59}, {31, 60}, {31, 61},
-        }
-    },
-    {
-        5,
-        {
-            {32, 62}, {32, 61}, {32, 60}, {32, 59}, {32, 58},
-        }
-    },
-    {
-        11,
-        {
-            {31, 62}, {32, 62}, {33, 62}, {33, 61}, {33, 60}, {32, 60}, {31, 60},
-            {31, 59}, {31, 58}, {32, 58}, {33, 58},
-        }
-    },
-    {
-        10,
-        {
-            {31, 62}, {32, 62}, {33, 62}, {33, 61}, {33, 60}, {32, 60}, {33, 59},
-            {33, 58}, {32, 58}, {31, 58},
-        }
-    },
-    {
-        9,
-        {
-            {31, 62}, {31, 61}, {31, 60}, {32, 60}, {33, 60}, {33, 61}, {33, 62},
-            {33, 59}, {33, 58},
-        }
-    },
-    {
-        11,
-        {
-            {33, 62}, {32, 62}, {31, 62}, {31, 61}, {31, 60}, {32, 60}, {33, 60},
-            {33, 59}, {33, 58}, {32, 58}, {31, 58},
-        }
-    },
-    {
-        12,
-        {
-            {33, 62}, {32, 62}, {31, 62}, {31, 61}, {31, 60}, {31, 59}, {31, 58},
-            {32, 58}, {33, 58}, {33, 59}, {33, 60}, {32, 60},
-        }
-    },
-    {
-        7,
-        {
-            {31, 62}, {32, 62}, {33, 62}, {33, 61}, {33, 60}, {33, 59}, {33, 58},
-        }
-    },
-    {
-        13,
-        {
-            {33, 62}, {32, 62}, {31, 62}, {31, 61}, {31, 60}, {32, 60}, {33, 60},
-            {33, 61}, {33, 59}, {33, 58}, {32, 58}, {31, 58}, {31, 59},
-        }
-    },
-    {
-        12,
-        {
-            {31, 58}, {32, 58}, {33, 58}, {33, 59}, {33, 60}, {32, 60}, {31, 60},
-            {31, 61}, {31, 62}, {32, 62}, {33, 62}, {33, 61},
-        }
+    u32 Read;
+    u32 Write;
+    u8 Data[MaxAnswerSize];
+} answer_buff;
+static answer_buff Tx;
+
+// NOTE(nox): Walls at 0 and BallMax reflect the ball, as they do on the host
+static inline s32 reflect(s32 Val) {
+    Val %= 2*BallMax;
+    if(Val < 0) {
+        Val += 2*BallMax;
     }
-};
+    return Val > BallMax ? 2*BallMax - Val : Val;
+}
 
-static rx_buff Rx;
-static buff Pkt;
-static bool SkipPacket;
+static void predictBall(u32 NowMs, s32 *X, s32 *Y) {
+    s32 MaxMs = clamp(MinExtrapolationMs, (s32)(ExtrapolationIntervals*BallIntervalMs), MaxExtrapolationMs);
+    s32 ElapsedMs = min((s32)(NowMs - BallTimeMs), MaxMs);
+    *X = clamp(0, BallX + BallVelX*ElapsedMs, BallMax);
+    *Y = reflect(BallY + BallVelY*ElapsedMs);
+}
 
-// NOTE(nox): X and Y are in the range [0, 64[
+static void updateBall(u8 X, u8 Y, s16 VelX, s16 VelY) {
+    u32 Now = millis();
+    s32 OldX, OldY;
+    predictBall(Now, &OldX, &OldY);
+    OldX += BallCorrectionX;
+    OldY += BallCorrectionY;
+
+    BallX = X << 8;
+    BallY = Y << 8;
+    BallVelX = VelX;
+    BallVelY = VelY;
+    BallIntervalMs = Now - BallTimeMs;
+    BallTimeMs = Now;
+
+    BallCorrectionX = OldX - BallX;
+    BallCorrectionY = OldY - BallY;
+    if(abs(BallCorrectionX) > SnapDistance || abs(BallCorrectionY) > SnapDistance) {
+        BallCorrectionX = BallCorrectionY = 0;
+    }
+}
+
+// NOTE(nox): X and Y are in the range [0, 64[. Text points may carry ZDisableBit, which is dropped, as
+// there is no Z output here.
 static void setCoordinates(u8 X, u8 Y) {
+    X &= ~ZDisableBit;
     LATDSET = LDAC;
 
     // NOTE(nox): Multi-Write command - 5.6.2
@@ -136,129 +147,137 @@ static void setCoordinatesHighRes(u8 X, u8 Y) {
     LATDCLR = LDAC; // NOTE(nox): Active both outputs at the same time
 }
 
-static void drawNumber(u8 I, u8 Offset) {
-    if(I >= 10) {
-        I = 0;
+static u32 formatScore(u8 Score, u8 *Text) {
+    u32 Length = 0;
+    if(Score >= 100) {
+        Text[Length++] = '0' + Score/100;
     }
-
-    const number *Number = Numbers+I;
-    for(u32 Current = 0; Current < Number->PointCount; ++Current) {
-        const point *Point = Number->Points + Current;
-        setCoordinates(Point->X+Offset, Point->Y);
+    if(Score >= 10) {
+        Text[Length++] = '0' + (Score/10) % 10;
     }
+    Text[Length++] = '0' + Score % 10;
+    return Length;
 }
 
-static void nextPacket() {
-    while(Rx.Read != Rx.Write && Rx.Data[Rx.Read]) {
-        Rx.Read = (Rx.Read + 1) & Rx.Mask;
+static void layoutScores() {
+    if(LeftScore == LaidOutLeftScore && RightScore == LaidOutRightScore) {
+        return;
     }
 
-    if(Rx.Read != Rx.Write && Rx.Data[Rx.Read] == 0) {
-        Rx.Read = (Rx.Read + 1) & Rx.Mask;
-        --Rx.NewPacketCount;
-        resetBuff(&Pkt);
-        SkipPacket = false;
-    }
+    u8 Text[3];
+    u32 Length = formatScore(LeftScore, Text);
+    s32 LeftX = LeftScoreEndX - (GlyphWidth-1) - (Length-1)*GlyphAdvance;
+    ScorePointCount = layoutText(Text, Length, LeftX, ScoreY, 1, ScorePoints, MaxScorePoints);
+
+    Length = formatScore(RightScore, Text);
+    ScorePointCount += layoutText(Text, Length, RightScoreX, ScoreY, 1, ScorePoints + ScorePointCount,
+                                  MaxScorePoints - ScorePointCount);
+
+    LaidOutLeftScore = LeftScore;
+    LaidOutRightScore = RightScore;
 }
 
-static void decodeRx() {
-    if(SkipPacket) {
-        nextPacket();
-        if(SkipPacket) {
-            return;
-        }
-    }
+static void sendTelemetry(u8 Events) {
+    resetBuff(&Tx);
+    writePongTelemetry(&Tx, Events, Sim.LeftScore, Sim.RightScore, Sim.Tick);
+    uartSend(&Tx);
+}
 
-    // NOTE(nox): With classical COBS, we ignore the zero of the last group of an encoded message,
-    // because it is the "ghost zero" that is added to the end of the message before encoding. We just
-    // wait for a message to arrive completely, which is marked by the delimiter, and ignore the last
-    // zero.
-    //
-    // However, with the delimiter at the start, we can't assume that we have the whole message yet (we
-    // can't know!), so we need to add all zeros of each decoded group even if the group is the last we
-    // have at the moment, because we may still be in the middle of a transmission and not at the end of
-    // the message.
-    //
-    // On the other hand, if a message is truncated and we start to transmit another, we will know
-    // immediately because the delimiter is at the beginning of the packets.
-
-    bool DidUnstuff = false;
-    u8 Code = 0xFF, Copy = 0;
-    for(;; --Copy) {
-        u8 Byte = Rx.Data[Rx.Read];
-        if(Copy == 0) {
-            if(Code != 0xFF) {
-                Pkt.Data[Pkt.Write++] = 0;
-            }
+static void handlePacket(u8 Command, u16 Length) {
+    switch((pong_command)Command) {
+        case PongCmd_InfoLedOn: {
+            LATGSET = InfoLed;
+        } break;
 
-            Copy = Code = Byte;
-            if(Code == 0 || Copy > ((Rx.Write - Rx.Read) & Rx.Mask)) {
+        case PongCmd_InfoLedOff: {
+            LATGCLR = InfoLed;
+        } break;
+
+        case PongCmd_Update: {
+            enum { CmdSize = 4, CmdSizeWithVelocity = 4+4+1 };
+            if(Length < CmdSize) {
                 break;
             }
+            u8 LeftPaddle = readU8(&Pkt);
+            u8 RightPaddle = readU8(&Pkt);
+            u8 X = readU8(&Pkt);
+            u8 Y = readU8(&Pkt);
+
+            // NOTE(nox): Older hosts don't send the velocity, the ball then stays where it is
+            s16 VelX = 0, VelY = 0;
+            if(Length >= CmdSizeWithVelocity) {
+                VelX = (s16)readU16(&Pkt);
+                VelY = (s16)readU16(&Pkt);
+                // NOTE(nox): Only a little behind is a late or repeated update, much more means
+                // the host started over
+                u8 Seq = readU8(&Pkt);
+                s8 SeqDelta = (s8)(Seq - LastSeq);
+                if(SeqDelta <= 0 && SeqDelta > -8) {
+                    break;
+                }
+                LastSeq = Seq;
+            }
 
-            Rx.Read = (Rx.Read + 1) & Rx.Mask;
-            DidUnstuff = true;
-        }
-        else if(Byte) {
-            Pkt.Data[Pkt.Write++] = Byte;
-            Rx.Read = (Rx.Read + 1) & Rx.Mask;
-        }
-        else {
-            // NOTE(nox): Encoded message ends too soon! We have encountered a delimeter (0) while we
-            // should still be copying
-            return;
-        }
-    }
+            Simulating = false;
+            LeftPaddleCenter = LeftPaddle;
+            RightPaddleCenter = RightPaddle;
+            updateBall(X, Y, VelX, VelY);
+        } break;
 
-    if(DidUnstuff && Pkt.Write >= (1+2)) {
-        u8 FirstByte = readU8NoAdv(&Pkt);
-        u8 MagicTest =             (FirstByte & 0xF0);
-        pong_command Command = (pong_command)(FirstByte & 0x0F);
-        if(MagicTest == MagicNumber) {
-            u16 Length = readU16NoAdv(&Pkt, 1);
-            if(Pkt.Write - 3 >= Length) {
-                Pkt.Read += 3;
-
-                switch(Command) {
-                    case PongCmd_InfoLedOn: {
-                        LATGSET = InfoLed;
-                    } break;
-
-                    case PongCmd_InfoLedOff: {
-                        LATGCLR = InfoLed;
-                    } break;
-
-                    case PongCmd_Update: {
-                        enum { CmdSize = 4 };
-                        if(Length < CmdSize) {
-                            break;
-                        }
-                        LeftPaddleCenter = readU8(&Pkt);
-                        RightPaddleCenter = readU8(&Pkt);
-                        BallX = readU8(&Pkt);
-                        BallY = readU8(&Pkt);
-                    } break;
-
-                    case PongCmd_SetScore: {
-                        enum { CmdSize = 2 };
-                        if(Length < CmdSize) {
-                            break;
-                        }
-                        LeftScore = readU8(&Pkt);
-                        RightScore = readU8(&Pkt);
-                    } break;
-
-                    default: {} break;
-                }
+        case PongCmd_Input: {
+            enum { CmdSize = 1 };
+            if(Length < CmdSize) {
+                break;
+            }
+            SimKeys = readU8(&Pkt);
+        } break;
 
-                // NOTE(nox): We are done with this packet
-                SkipPacket = true;
+        case PongCmd_Reset: {
+            enum { CmdSize = 4 };
+            if(Length < CmdSize) {
+                break;
             }
-        }
-        else {
-            // NOTE(nox): Invalid packet start!
-            SkipPacket = true;
-        }
+            pongReset(&Sim, readU32(&Pkt));
+            SimKeys = 0;
+            Simulating = true;
+            sendTelemetry(PongEvent_Reset);
+        } break;
+
+        case PongCmd_Ping: {
+            enum { CmdSize = 4+4 };
+            u32 Now = micros();
+            if(Length < CmdSize) {
+                break;
+            }
+
+            echo_info Echo = {};
+            Echo.Seq = readU32(&Pkt);
+            Echo.HostTimeUs = readU32(&Pkt);
+            Echo.DeviceRxUs = Now;
+            Echo.SinceFrameUs = Now - FrameStartUs;
+            Echo.FramePeriodUs = 1000000 / FrameRate;
+            Echo.State = DeviceState_Drawing | (Simulating ? DeviceState_Simulating : 0);
+
+            resetBuff(&Tx);
+            Echo.DeviceTxUs = micros();
+            writeEcho(&Tx, &Echo);
+            uartSend(&Tx);
+        } break;
+
+        case PongCmd_DrawText: {
+            handleDrawText(&Pkt, Length, TextSlots);
+        } break;
+
+        case PongCmd_SetScore: {
+            enum { CmdSize = 2 };
+            if(Length < CmdSize) {
+                break;
+            }
+            LeftScore = readU8(&Pkt);
+            RightScore = readU8(&Pkt);
+        } break;
+
+        default: {} break;
     }
 }
 
@@ -327,33 +346,64 @@ void setup() {
     }
     delay(50);
 
-    // NOTE(nox): 60 FPS
-    FrameTimer.setFrequency(60);
+    FrameTimer.setFrequency(FrameRate);
     FrameTimer.attachInterrupt(setUpdateFlag);
     FrameTimer.start();
 }
 
 void loop() {
     if(ShouldUpdate) {
+        FrameStartUs = micros();
+        if(Simulating) {
+            u8 Events = pongStep(&Sim, SimKeys);
+            LeftPaddleCenter = Sim.LeftY;
+            RightPaddleCenter = Sim.RightY;
+            LeftScore = Sim.LeftScore;
+            RightScore = Sim.RightScore;
+            if(Events) {
+                sendTelemetry(Events);
+            }
+        }
+
         for(s8 I = -PaddleHeight/2; I <= PaddleHeight/2; ++I) {
             setCoordinates(LeftPaddleX, LeftPaddleCenter+I);
         }
         for(s8 I = -PaddleHeight/2; I <= PaddleHeight/2; ++I) {
             setCoordinates(RightPaddleX, RightPaddleCenter+I);
         }
-        drawNumber(LeftScore, -5);
+        layoutScores();
+        for(u32 I = 0; I < ScorePointCount; ++I) {
+            setCoordinates(ScorePoints[I].X, ScorePoints[I].Y);
+        }
         setCoordinates(31, 60);
         setCoordinates(32, 60);
-        drawNumber(RightScore, 4);
-        setCoordinatesHighRes(BallX, BallY);
+        for(u32 Slot = 0; Slot < MaxTextSlots; ++Slot) {
+            text_slot *Text = TextSlots + Slot;
+            for(u32 I = 0; I < Text->Count; ++I) {
+                setCoordinates(Text->Points[I].X, Text->Points[I].Y);
+            }
+        }
+
+        s32 X, Y;
+        if(Simulating) {
+            // NOTE(nox): From 16.16 grid units to 24.8 high-res units
+            X = (s32)(((int64_t)Sim.BallPos.X*BallMax/(GridSize-1)) >> FixedShift);
+            Y = (s32)(((int64_t)Sim.BallPos.Y*BallMax/(GridSize-1)) >> FixedShift);
+        }
+        else {
+            predictBall(millis(), &X, &Y);
+            X += BallCorrectionX;
+            Y += BallCorrectionY;
+            BallCorrectionX -= BallCorrectionX >> 2;
+            BallCorrectionY -= BallCorrectionY >> 2;
+        }
+        X = clamp(0, X, BallMax);
+        Y = clamp(0, Y, BallMax);
+        setCoordinatesHighRes(X >> 8, Y >> 8);
         ShouldUpdate = false;
     }
 
-    decodeRx();
-    while(Rx.NewPacketCount) {
-        nextPacket();
-        decodeRx();
-    }
+    processRx();
 }
 
 #endif
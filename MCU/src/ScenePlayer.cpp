@@ -0,0 +1,259 @@
+#if ScenePlayer
+
+// NOTE(nox): Generic real-time firmware. The host sends a whole display list every tick (Command_Scene, see
+// scene.hpp) and we draw whatever it describes, so new interactive applications only need host code.
+// Scenes are rendered into the back buffer as they arrive and swapped in at the start of the next frame,
+// so a frame never mixes two of them.
+
+#include <Arduino.h>
+#include "external/Wire.h"
+#include "external/timer.h"
+
+#define assert(...)
+#include <common.h>
+#include <protocol.hpp>
+#include <glyphs.hpp>
+#include <scene.hpp>
+#include "Link.h"
+
+enum {
+    DacAddr = 0x60,
+    LDAC = 1<<9,    // RD9
+    ZPin = 1<<2,    // RD2
+    InfoLed = 1<<6, // RG2
+    FPB = 80000000,
+    DefaultFps = 60,
+};
+
+#include "Settle.h"
+
+static Timer2 FrameTimer = {};
+static Timer4 ZTimer = {};
+
+static volatile bool ShouldUpdate = false;
+static bool Drawing = false;
+static u32 FrameStartUs;
+static u8 Fps;
+
+static scene_points Scenes[2];
+static u32 FrontScene;
+static bool BackReady;
+static text_slot TextSlots[MaxTextSlots];
+static u8 LastX, LastY;
+
+static void setFps(u8 NewFps) {
+    if(NewFps != Fps) {
+        Fps = NewFps;
+        FrameTimer.setFrequency(Fps);
+    }
+}
+
+// NOTE(nox): X and Y are in the range [0, 64[, except when X has the Z bit set.
+static void setCoordinates(u8 X, u8 Y) {
+    u8 GridX = X & (GridSize-1);
+    u32 Distance = jumpDistance(LastX << GridToHighResShift, LastY << GridToHighResShift,
+                                GridX << GridToHighResShift, Y << GridToHighResShift);
+    bool Blank = X & ZDisableBit;
+    LastX = GridX;
+    LastY = Y;
+
+    LATDSET = LDAC;
+
+    // NOTE(nox): Multi-Write command - 5.6.2
+    u8 Data[] = {(0x40 | (0 << 1) | 1), (0x90 | inputMsb(X)), inputLsb(X),  // Output A
+                 (0x40 | (1 << 1) | 1), (0x90 | inputMsb(Y)), inputLsb(Y)}; // Output B
+    Wire.beginTransmission(DacAddr);
+    Wire.write(Data, arrayCount(Data));
+    Wire.endTransmission();
+
+    if(Blank) {
+        LATDCLR = ZPin;
+        ZTimer.reset();
+        ZTimer.setPeriod(settleTicks(Distance));
+        ZTimer.start();
+    }
+
+    LATDCLR = LDAC; // NOTE(nox): Active both outputs at the same time
+}
+
+static void powerOffOutputs() {
+    // NOTE(nox): Select power-down bits - 5.6.6
+    // PD1 = 1, PD0 = 0 -> 100kΩ to ground
+    enum {Cmd = 0xA0};
+    u8 Data[] = {(Cmd | 0x0A), (0xA0)};
+    Wire.beginTransmission(DacAddr);
+    Wire.write(Data, arrayCount(Data));
+    Wire.endTransmission();
+}
+
+static void handlePacket(u8 Command, u16 Length) {
+    switch((command)Command) {
+        case Command_InfoLedOn: {
+            LATGSET = InfoLed;
+        } break;
+
+        case Command_InfoLedOff: {
+            LATGCLR = InfoLed;
+        } break;
+
+        case Command_PowerOn: {
+            FrameTimer.start();
+            LATDSET = ZPin;
+            Drawing = true;
+        } break;
+
+        case Command_PowerOff: {
+            FrameTimer.stop();
+            ZTimer.stop();
+            ShouldUpdate = false;
+            powerOffOutputs();
+            LATDCLR = ZPin;
+            Drawing = false;
+        } break;
+
+        case Command_DrawText: {
+            handleDrawText(&Pkt, Length, TextSlots);
+        } break;
+
+        case Command_Scene: {
+            scene_points *Back = Scenes + (FrontScene ^ 1);
+            u8 Seq = 0, Flags = 0;
+            renderScene(&Pkt, Length, TextSlots, Back, &Seq, &Flags);
+            if(Back->Budget) {
+                setFps(Back->Fps);
+            }
+            BackReady = true;
+
+            if(Back->Status || (Flags & SceneFlag_Status)) {
+                scene_status Status = {Seq, Back->Status, (u16)Back->Count, (u16)Back->Budget};
+                resetBuff(&Pkt);
+                writeSceneStatus(&Pkt, &Status);
+                uartSend(&Pkt);
+            }
+        } break;
+
+        case Command_Ping: {
+            enum { CmdSize = 4+4 };
+            u32 Now = micros();
+            if(Length < CmdSize) {
+                break;
+            }
+
+            echo_info Echo = {};
+            Echo.Seq = readU32(&Pkt);
+            Echo.HostTimeUs = readU32(&Pkt);
+            Echo.DeviceRxUs = Now;
+            Echo.SinceFrameUs = Now - FrameStartUs;
+            Echo.FramePeriodUs = 1000000 / Fps;
+            Echo.State = Drawing ? DeviceState_Drawing : 0;
+
+            resetBuff(&Pkt);
+            Echo.DeviceTxUs = micros();
+            writeEcho(&Pkt, &Echo);
+            uartSend(&Pkt);
+        } break;
+
+        default: {} break;
+    }
+}
+
+static void __USER_ISR setUpdateFlag() {
+    ShouldUpdate = true;
+    clearIntFlag(_TIMER_2_IRQ);
+}
+
+static void __USER_ISR enableZ() {
+    LATDSET = ZPin;
+    ZTimer.stop();
+    clearIntFlag(_TIMER_4_IRQ);
+}
+
+static void __USER_ISR uartRx() {
+    u8 Byte = U1RXREG;
+    u32 NextWrite = (Rx.Write + 1) & Rx.Mask;
+
+    if(NextWrite != Rx.Read) {
+        Rx.Data[Rx.Write] = Byte;
+        Rx.Write = NextWrite;
+        if(Byte == 0) {
+            Rx.NewPacketCount++;
+        }
+    }
+    else {
+        // NOTE(nox): In the case of a buffer overflow, the _new_ byte is dropped. The information LED
+        // will light up so we know if it ever happens.
+        LATGSET = InfoLed;
+    }
+
+    clearIntFlag(_UART1_RX_IRQ);
+}
+
+void setup() {
+    // NOTE(nox): Setup serial communication
+    U1BRG = FPB/(4.0*BaudRate)-1;
+    U1MODEbits.ON   = 1;
+    U1MODEbits.BRGH = 1;
+    U1STAbits.UTXEN = 1;
+    U1STAbits.URXEN = 1;
+    U1STAbits.URXISEL = 0;
+    setIntVector(_UART1_VECTOR, uartRx);
+    setIntPriority(_UART1_VECTOR, 2, 2);
+    clearIntFlag(_UART1_RX_IRQ);
+    setIntEnable(_UART1_RX_IRQ);
+
+    TRISDCLR = LDAC | ZPin;
+    LATDSET  = LDAC | ZPin;
+    TRISGCLR = InfoLed;
+    LATGCLR  = InfoLed;
+
+    Wire.begin();
+    u32 Clock = Wire.setClock(1000000);
+
+    // NOTE(nox): Sequential write command (A -> D) - 5.6.3
+    {
+        Wire.beginTransmission(DacAddr);
+        Wire.write(0x50);
+
+        // NOTE(nox): VRef = 1 (internal voltage reference), Gx = 1 (2x gain)
+        u8 ActiveData[] = {0x90, 0x00};
+        Wire.write(ActiveData, 2);
+        Wire.write(ActiveData, 2);
+
+        // NOTE(nox): PD1 = 1, PD0 = 0 -> 100kΩ to ground
+        u8 DisabledData[] = {0x40, 0x00};
+        Wire.write(DisabledData, 2);
+        Wire.write(DisabledData, 2);
+
+        Wire.endTransmission();
+    }
+    delay(50);
+
+    setFps(DefaultFps);
+    FrameTimer.attachInterrupt(setUpdateFlag);
+    FrameTimer.start();
+    Drawing = true;
+
+    // NOTE(nox): Same as AnimPlayer, blanks the jumps to points with the Z bit set, see Settle.h
+    ZTimer.setFrequency(1000000 / SettleFullScaleUs);
+    ZTimer.attachInterrupt(enableZ);
+}
+
+void loop() {
+    if(ShouldUpdate) {
+        FrameStartUs = micros();
+        if(BackReady) {
+            FrontScene ^= 1;
+            BackReady = false;
+        }
+
+        scene_points *Scene = Scenes + FrontScene;
+        for(u32 I = 0; I < Scene->Count; ++I) {
+            setCoordinates(Scene->Points[I].X, Scene->Points[I].Y);
+        }
+        ShouldUpdate = false;
+    }
+
+    processRx();
+}
+
+#endif
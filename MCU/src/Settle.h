@@ -0,0 +1,29 @@
+#if !defined(SETTLE_H)
+#define SETTLE_H
+
+// NOTE(nox): How long a blanked jump stays dark, from the LDAC pulse to the ZTimer interrupt. The outputs
+// take 6.5us to settle over the full scale but much less for a few steps, so the window grows with the
+// distance the beam moves instead of always being the full-scale one. Short steps barely blank and long
+// jumps get the whole margin, so they don't leave a trail at their end. Only the length of the window
+// depends on the distance, a point marked as blanked is always blanked. Needs common.h, protocol.hpp and
+// FPB.
+enum {
+    SettleMinUs = 2,
+    SettleFullScaleUs = 10, // NOTE(nox): 6.5us with some margin
+    SettleTicksPerUs = FPB / 1000000,
+};
+
+// NOTE(nox): In DAC steps. Both outputs move at the same time, so the longer axis decides.
+static inline u32 jumpDistance(u16 FromX, u16 FromY, u16 ToX, u16 ToY) {
+    u32 Dx = FromX > ToX ? FromX - ToX : ToX - FromX;
+    u32 Dy = FromY > ToY ? FromY - ToY : ToY - FromY;
+    return Dx > Dy ? Dx : Dy;
+}
+
+// NOTE(nox): In timer ticks without prescaler, for Timer::setPeriod
+static inline u32 settleTicks(u32 Distance) {
+    return (SettleMinUs*SettleTicksPerUs +
+            Distance*(SettleFullScaleUs - SettleMinUs)*SettleTicksPerUs / HighResMax);
+}
+
+#endif
@@ -10,3 +10,4 @@ then
     c++ -O2 -I../External/ ../External/imgui/imgui_impl_opengl3.cpp -c -o build/imgui_impl_opengl3.o
 fi
 c++ -Wall -Wextra -Wno-unused-function -g3 -lGL -lX11 -ldl -lpthread -I../External/ -I../Shared main.cpp build/*.o -o build/PongControl
+c++ -Wall -Wextra -Wno-unused-function -g3 -I../Shared replay.cpp -o build/PongReplay
@@ -0,0 +1,346 @@
+// NOTE(nox): Pong game and what the host sends for it
+//
+// Everything here is deterministic: the game only depends on its state (random numbers included) and the
+// keys of each tick, and stepHost turns that into the exact packets to send. The tick thread, the recorder
+// and the replay runner all go through stepHost, so a recording replays into the same bytes as long as the
+// rules don't change. Floats are only deterministic with the same compiler flags and libm, so PongReplay is
+// built like PongControl.
+
+static const u64 UpdateDeltaMs = 33;
+static const r32 Pi = 3.1415926535f;
+static const r32 BallVel = 2.f;
+
+typedef enum {
+    Control_None,
+    Control_Up,
+    Control_Down,
+} paddle_control;
+
+typedef enum {
+    Game_WaitingForInput,
+    Game_Playing,
+} game_state;
+
+typedef struct {
+    paddle_control Left;
+    paddle_control Right;
+} controls;
+
+typedef struct {
+    r32 X;
+    r32 Y;
+} v2;
+
+typedef struct {
+    v2 Pos;
+    v2 Vel;
+} ball;
+
+typedef struct {
+    u8 CenterY;
+} paddle;
+
+static inline v2 add(v2 A, v2 B) {
+    v2 Result = {A.X + B.X, A.Y + B.Y};
+    return Result;
+}
+
+static inline v2 sub(v2 A, v2 B) {
+    v2 Result = {A.X - B.X, A.Y - B.Y};
+    return Result;
+}
+
+static inline v2 mult(v2 Vec, r32 A) {
+    v2 Result = {Vec.X*A, Vec.Y*A};
+    return Result;
+}
+
+static inline r32 lengthSq(v2 Vec) {
+    return Vec.X*Vec.X + Vec.Y*Vec.Y;
+}
+
+static inline r32 length(v2 Vec) {
+    return sqrt(lengthSq(Vec));
+}
+
+static inline v2 normalize(v2 Vec) {
+    v2 Result = mult(Vec, 1.0f / length(Vec));
+    return Result;
+}
+
+static inline r32 cross(v2 A, v2 B) {
+    return A.X*B.Y - A.Y*B.X;
+}
+
+static inline v2 rotate(v2 Vec, r32 Deg) {
+    r32 Rad = Pi * Deg / 180.0f;
+    r32 Cos = cos(Rad);
+    r32 Sin = sin(Rad);
+    v2 Result = {Cos*Vec.X - Sin*Vec.Y, Sin*Vec.X + Cos*Vec.Y};
+    return Result;
+}
+
+typedef struct {
+    bool Exists;
+    r32 T, U;
+} segment_intersection;
+static segment_intersection intersect(v2 Pos1, v2 Dir1, v2 Pos2, v2 Dir2) {
+    segment_intersection Result = {};
+
+    r32 Cross = cross(Dir1, Dir2);
+    if(Cross != 0) {
+        v2 Diff = sub(Pos2, Pos1);
+        Result.T = cross(Diff, Dir2)/Cross;
+        Result.U = cross(Diff, Dir1)/Cross;
+
+        if((Result.T >= 0.0f && Result.T <= 1.0f) &&
+           (Result.U >= 0.0f && Result.U <= 1.0f))
+        {
+            Result.Exists = true;
+        }
+    }
+
+    return Result;
+}
+
+typedef struct {
+    paddle Left;
+    paddle Right;
+    ball Ball;
+    u8 LeftScore;
+    u8 RightScore;
+    u32 Rng;
+} game;
+
+// NOTE(nox): xorshift32, same as the device's pongRandom
+static inline u32 gameRandom(game *Game) {
+    Game->Rng ^= Game->Rng << 13;
+    Game->Rng ^= Game->Rng >> 17;
+    Game->Rng ^= Game->Rng << 5;
+    return Game->Rng;
+}
+
+// NOTE(nox): In [0, 1[
+static inline r32 gameRandomUnit(game *Game) {
+    return (gameRandom(Game) >> 8) / (r32)(1 << 24);
+}
+
+static inline void randomizeBall(game *Game) {
+    ball *Ball = &Game->Ball;
+    Ball->Pos.X = Ball->Pos.Y = (GridSize-1)/2.f;
+    Ball->Vel = rotate({BallVel*0.5f, 0}, (gameRandomUnit(Game)*2.0f - 1)*45);
+    if(gameRandomUnit(Game) >= .5f) {
+        Ball->Vel = mult(Ball->Vel, -1);
+    }
+}
+
+static inline void seedGame(game *Game, u32 Seed) {
+    Game->Rng = Seed ? Seed : 1; // NOTE(nox): xorshift never leaves 0
+}
+
+// NOTE(nox): Keeps the random state going, only seedGame starts it over
+static inline void restartGame(game *Game) {
+    Game->LeftScore = Game->RightScore = 0;
+    Game->Left.CenterY = Game->Right.CenterY = GridSize/2;
+    Game->Ball.Pos = {GridSize/2.0f, (r32)(Game->Left.CenterY)};
+    Game->Ball.Vel = {BallVel, 0};
+}
+
+static inline void updatePaddle(paddle *Paddle, paddle_control Control) {
+    u8 PaddleDelta = 2;
+
+    if(Control == Control_Up) {
+        Paddle->CenterY += PaddleDelta;
+    } else if(Control == Control_Down) {
+        Paddle->CenterY -= PaddleDelta;
+    }
+
+    Paddle->CenterY = clamp(PaddleMinY, Paddle->CenterY, PaddleMaxY);
+}
+
+// NOTE(nox): Advances the game by one tick, returns true if the score changed. Depends on nothing but
+// Game and Controls.
+static bool tickGame(game *Game, controls Controls) {
+    bool ScoreChanged = false;
+    ball *Ball = &Game->Ball;
+
+    updatePaddle(&Game->Left, Controls.Left);
+    updatePaddle(&Game->Right, Controls.Right);
+
+    v2 OldPos = Ball->Pos;
+    Ball->Pos = add(Ball->Pos, Ball->Vel);
+    if(Ball->Vel.Y > 0.0f && Ball->Pos.Y > GridSize-1) {
+        Ball->Pos.Y = GridSize-1;
+        Ball->Vel.Y = -Ball->Vel.Y;
+    }
+    else if(Ball->Vel.Y < 0.0f && Ball->Pos.Y < 0) {
+        Ball->Pos.Y = 0;
+        Ball->Vel.Y = -Ball->Vel.Y;
+    }
+    else {
+        v2 WallStart, WallDirection, VelDirection;
+        if(Ball->Vel.X < 0) {
+            WallStart = {LeftPaddleX+0.5f, Game->Left.CenterY - PaddleHeight/2.0f};
+            WallDirection = {0, PaddleHeight};
+            VelDirection = {BallVel, 0};
+        }
+        else {
+            WallStart = {RightPaddleX-0.5f, Game->Right.CenterY + PaddleHeight/2.0f};
+            WallDirection = {0, -PaddleHeight};
+            VelDirection = {-BallVel, 0};
+        }
+
+        segment_intersection Intersection = intersect(OldPos, Ball->Vel, WallStart, WallDirection);
+        if(Intersection.Exists) {
+            Ball->Pos = add(OldPos, mult(Ball->Vel, Intersection.T));
+            Ball->Vel = rotate(VelDirection, (Intersection.U - 0.5f)*75.0f);
+        }
+    }
+
+    if(Ball->Pos.X < -0.5f) {
+        ++Game->RightScore;
+        if(Game->RightScore >= 10) {
+            Game->LeftScore = Game->RightScore = 0;
+        }
+        randomizeBall(Game);
+        ScoreChanged = true;
+    }
+    else if(Ball->Pos.X > GridSize-0.5f) {
+        ++Game->LeftScore;
+        if(Game->LeftScore >= 10) {
+            Game->LeftScore = Game->RightScore = 0;
+        }
+        randomizeBall(Game);
+        ScoreChanged = true;
+    }
+
+    return ScoreChanged;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Host side of a tick
+enum {
+    Input_LeftUp    = PongInput_LeftUp,
+    Input_LeftDown  = PongInput_LeftDown,
+    Input_RightUp   = PongInput_RightUp,
+    Input_RightDown = PongInput_RightDown,
+    Input_Restart   = 1<<4,
+
+    HostTick_DeviceGame = 1<<0,
+
+    MaxPacketsPerTick = 2,
+    InputPollUs = 2000, // NOTE(nox): Tick period when the game runs on the device
+};
+
+typedef struct {
+    u8 Keys;           // NOTE(nox): Input_* bits
+    u8 Flags;          // NOTE(nox): HostTick_* bits
+    u8 UpdateInterval; // NOTE(nox): In ticks, when the device could have predicted everything
+} host_input;
+
+typedef struct {
+    game Game;
+    game Sent; // NOTE(nox): As of the last update sent
+    u32 TicksSinceUpdate;
+    u8 Seq;
+    bool WasDeviceGame;
+    u8 SentKeys;
+    bool SentUpdate; // NOTE(nox): In the last step
+} pong_host;
+
+typedef struct {
+    buff Packets[MaxPacketsPerTick];
+    u32 Count;
+} tick_packets;
+
+static inline buff *pushPacket(tick_packets *Out) {
+    assert(Out->Count < MaxPacketsPerTick);
+    buff *Buff = Out->Packets + Out->Count++;
+    resetBuff(Buff);
+    return Buff;
+}
+
+static controls controlsFromInput(u32 Keys) {
+    controls Controls = {};
+    if(Keys & Input_LeftUp) {
+        Controls.Left = Control_Up;
+    }
+    else if(Keys & Input_LeftDown) {
+        Controls.Left = Control_Down;
+    }
+
+    if(Keys & Input_RightUp) {
+        Controls.Right = Control_Up;
+    }
+    else if(Keys & Input_RightDown) {
+        Controls.Right = Control_Down;
+    }
+    return Controls;
+}
+
+static void initHost(pong_host *Host, u32 Seed) {
+    *Host = (pong_host){};
+    seedGame(&Host->Game, Seed);
+    restartGame(&Host->Game);
+}
+
+// NOTE(nox): One tick, the packets to send end up in Out. In device game mode only the keys are sent, when
+// they change, and a reset when restarting. Otherwise the game runs here, and as the device keeps moving
+// the ball by itself, an update is only needed when something it can't predict happened, or every
+// UpdateInterval ticks to correct the drift.
+static void stepHost(pong_host *Host, host_input Input, tick_packets *Out) {
+    game *Game = &Host->Game;
+    Out->Count = 0;
+    Host->SentUpdate = false;
+
+    if(Input.Flags & HostTick_DeviceGame) {
+        u8 GameKeys = Input.Keys & ~Input_Restart;
+        if(!Host->WasDeviceGame || ((Input.Keys & Input_Restart) && !(Host->SentKeys & Input_Restart))) {
+            writePongReset(pushPacket(Out), gameRandom(Game));
+        }
+
+        if(Input.Keys != Host->SentKeys) {
+            if(GameKeys != (Host->SentKeys & ~Input_Restart)) {
+                writePongInput(pushPacket(Out), GameKeys);
+            }
+            Host->SentKeys = Input.Keys;
+        }
+
+        Host->WasDeviceGame = true;
+        return;
+    }
+
+    if(Host->WasDeviceGame) {
+        // NOTE(nox): Back to running here, the first update takes control back from the device
+        restartGame(Game);
+        Host->Sent = (game){};
+        Host->WasDeviceGame = false;
+    }
+
+    bool UpdateScore;
+    if(Input.Keys & Input_Restart) {
+        restartGame(Game);
+        UpdateScore = true;
+    }
+    else {
+        UpdateScore = tickGame(Game, controlsFromInput(Input.Keys));
+    }
+
+    ++Host->TicksSinceUpdate;
+    game *Sent = &Host->Sent;
+    bool Predictable = (Game->Left.CenterY == Sent->Left.CenterY && Game->Right.CenterY == Sent->Right.CenterY &&
+                        Game->Ball.Vel.X == Sent->Ball.Vel.X && Game->Ball.Vel.Y == Sent->Ball.Vel.Y);
+    if(!Predictable || UpdateScore || Host->TicksSinceUpdate >= Input.UpdateInterval) {
+        writePongUpdate(pushPacket(Out), Game->Left.CenterY, Game->Right.CenterY, Game->Ball.Pos.X,
+                        Game->Ball.Pos.Y, Game->Ball.Vel.X / UpdateDeltaMs, Game->Ball.Vel.Y / UpdateDeltaMs,
+                        ++Host->Seq);
+        Host->TicksSinceUpdate = 0;
+        Host->SentUpdate = true;
+        *Sent = *Game;
+    }
+
+    if(UpdateScore) {
+        writePongScore(pushPacket(Out), Game->LeftScore, Game->RightScore);
+    }
+}
@@ -7,13 +7,22 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <common.h>
 #include <protocol.hpp>
+#include <trace.hpp>
+#include <serial.hpp>
+#include <latency.hpp>
+#include "game.cpp"
+#include "recording.cpp"
 
 typedef int serial_ctx;
 
@@ -21,199 +30,202 @@ static void glfwErrorCallback(int Error, const char* Description) {
     fprintf(stderr, "GLFW Error %d: %s\n", Error, Description);
 }
 
-static int serialConnect() {
-    int Tty = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY | O_NONBLOCK);
-
-    if(!isatty(Tty)) {
-        goto connectionError;
-    }
-
-    termios Config;
-    if(tcgetattr(Tty, &Config) < 0) {
-        goto connectionError;
-    }
-
-
-    Config.c_iflag &= ~(INPCK); // NOTE(nox): Disable input parity check
-    Config.c_iflag &= ~(IXON | IXOFF | IXANY); // NOTE(nox): Disable software flow control
-    Config.c_iflag &= ~(IGNBRK | BRKINT | ISTRIP | INLCR | IGNCR | ICRNL); // NOTE(nox): Disable any special handling of received bytes
-
-    Config.c_oflag  = ~(OPOST | ONLCR); // NOTE(nox): Disable output processing
-
-    Config.c_cflag &= ~(PARENB | CRTSCTS);  // NOTE(nox): Disable parity generation and RTS/CTS flow control
-    Config.c_cflag &= ~CSTOPB; // NOTE(nox): Only 1 stop bit
-    Config.c_cflag &= ~CSIZE;
-    Config.c_cflag |=  CS8; // NOTE(nos): Set 8 bits as communication unit
-    Config.c_cflag |=  (CREAD | CLOCAL); // NOTE(nox): Enable receiver and ignore modem lines
-
-    Config.c_lflag &= ~(ICANON | ECHO | ISIG); // NOTE(nox): Disable canonical mode, echos and don't generate signals
-
-    // NOTE(nox): Non blocking, return immediately what is available (ignored due to O_NONBLOCK)
-    Config.c_cc[VMIN]  = 0;
-    Config.c_cc[VTIME] = 0;
-
-    if(cfsetispeed(&Config, B115200) < 0 || cfsetospeed(&Config, B115200) < 0) {
-        goto connectionError;
-    }
-    if(tcsetattr(Tty, TCSAFLUSH, &Config) < 0) {
-        goto connectionError;
-    }
-
-    return Tty;
-
-  connectionError:
-    close(Tty);
-    return -1;
-}
-
 static inline void serialDisconnect(serial_ctx *Tty) {
     close(*Tty);
     *Tty = -1;
 }
 
-static void sendBuffer(buff *Buffer, int SerialTTY) {
-    assert(SerialTTY >= 0);
-
-    buff Encoded = {};
-    finalizePacket(Buffer, &Encoded);
-    u8 Delimiter = 0;
-    write(SerialTTY, &Delimiter, 1);
-    write(SerialTTY, Encoded.Data, Encoded.Write);
-}
-
-
-static const u64 UpdateDeltaMs = 33;
-static const r32 Pi = 3.1415926535f;
-static const r32 BallVel = 2.f;
-
-typedef enum {
-    Control_None,
-    Control_Up,
-    Control_Down,
-} paddle_control;
-
-typedef enum {
-    Game_WaitingForInput,
-    Game_Playing,
-} game_state;
-
-typedef struct {
-    paddle_control Left;
-    paddle_control Right;
-} controls;
-
-typedef struct {
-    r32 X;
-    r32 Y;
-} v2;
-
-typedef struct {
-    v2 Pos;
-    v2 Vel;
-} ball;
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Tick thread
+//
+// The game runs and transmits in its own thread, woken at absolute deadlines every UpdateDeltaMs, so the
+// ticks neither drift nor wait for the UI's vsync. The UI only publishes the keys in Input, a single word
+// holding the key bits and the time they last changed, so the thread never waits on the UI either.
+//
+// With DeviceGame set the game runs on the device instead (see pong_fixed.hpp). The thread then wakes
+// every InputPollUs and only sends the keys when they change, and a reset when restarting. The device
+// answers with telemetry, which is published for the UI in the Device* fields.
+//
+// With ProbeLatency set the thread also pings the device every PingIntervalMs, in either mode.
+//
+// What is sent each tick comes from stepHost (see game.cpp). While Record is set, the ticks are also written
+// to a recording for PongReplay, whose name the thread leaves in RecordingName.
+enum {
+    InputKeyBits = 8, // NOTE(nox): Above them, the time of the last change in us
+};
 
 typedef struct {
-    u8 CenterY;
-} paddle;
-
-static inline v2 add(v2 A, v2 B) {
-    v2 Result = {A.X + B.X, A.Y + B.Y};
-    return Result;
+    serial_ctx Serial;
+    pthread_t Thread;
+    bool Running;
+    u64 Input;
+    u32 UpdateInterval; // NOTE(nox): In ticks, when the device could have predicted everything
+    bool DeviceGame;
+    packet_reader Reader;
+
+    u32 DeviceScore; // NOTE(nox): Left score in the low byte, right in the next one
+    u32 DeviceTick;
+    u32 TelemetryCount;
+
+    histogram TickJitter;   // NOTE(nox): How late each tick woke up
+    histogram InputLatency; // NOTE(nox): From a key change to the write of the first update after it
+
+    bool ProbeLatency;
+    latency_probe Probe;
+
+    const char *DevicePath;
+    u32 Seed;
+    bool Record;
+    char RecordingName[64];
+    u32 RecordedTicks;
+} pong_ctx;
+
+static inline u64 timespecToUs(timespec Spec) {
+    return Spec.tv_sec*1000000 + Spec.tv_nsec / 1000;
 }
 
-static inline v2 sub(v2 A, v2 B) {
-    v2 Result = {A.X - B.X, A.Y - B.Y};
-    return Result;
+static inline void addUs(timespec *Spec, u64 Us) {
+    Spec->tv_nsec += (Us % 1000000) * 1000;
+    Spec->tv_sec  += Us / 1000000 + Spec->tv_nsec / 1000000000;
+    Spec->tv_nsec %= 1000000000;
 }
 
-static inline v2 mult(v2 Vec, r32 A) {
-    v2 Result = {Vec.X*A, Vec.Y*A};
-    return Result;
+static void handleDevicePacket(void *User, buff *Pkt, u8 Command, u16 Length) {
+    pong_ctx *Pong = (pong_ctx *)User;
+    switch(Command) {
+        case PongCmd_Telemetry: {
+            if(Length < 1+1+1+4) {
+                break;
+            }
+            readU8(Pkt); // NOTE(nox): Events, the score and tick are all the UI shows
+            u8 LeftScore = readU8(Pkt);
+            u8 RightScore = readU8(Pkt);
+            __atomic_store_n(&Pong->DeviceScore, LeftScore | (RightScore << 8), __ATOMIC_RELAXED);
+            __atomic_store_n(&Pong->DeviceTick, readU32(Pkt), __ATOMIC_RELAXED);
+            __atomic_fetch_add(&Pong->TelemetryCount, 1, __ATOMIC_RELAXED);
+        } break;
+
+        case PongCmd_Echo: {
+            handleEcho(&Pong->Probe, Pkt, Length);
+        } break;
+
+        default: {} break;
+    }
 }
 
-static inline r32 lengthSq(v2 Vec) {
-    return Vec.X*Vec.X + Vec.Y*Vec.Y;
-}
+static void *tickThread(void *Data) {
+    pong_ctx *Pong = (pong_ctx *)Data;
+
+    static pong_host Host;
+    static tick_packets Packets;
+    initHost(&Host, Pong->Seed);
+    u64 LastInputChange = 0;
+    u64 LastPing = 0;
+    FILE *Recording = 0;
+
+    timespec Deadline;
+    clock_gettime(CLOCK_MONOTONIC, &Deadline);
+    while(__atomic_load_n(&Pong->Running, __ATOMIC_ACQUIRE)) {
+        bool DeviceGame = __atomic_load_n(&Pong->DeviceGame, __ATOMIC_RELAXED);
+        addUs(&Deadline, DeviceGame ? (u64)InputPollUs : UpdateDeltaMs*1000);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Deadline, 0) == EINTR) {}
+
+        u64 Now = getTimeUs();
+        u64 DeadlineUs = timespecToUs(Deadline);
+        u64 Late = Now > DeadlineUs ? Now - DeadlineUs : 0;
+        recordSample(&Pong->TickJitter, Late);
+        if(Late > 4*UpdateDeltaMs*1000) {
+            // NOTE(nox): Too far behind (e.g. the machine was suspended), don't try to catch up
+            clock_gettime(CLOCK_MONOTONIC, &Deadline);
+        }
 
-static inline r32 length(v2 Vec) {
-    return sqrt(lengthSq(Vec));
-}
+        readPackets(Pong->Serial, &Pong->Reader, 0, handleDevicePacket, Pong);
+        if(__atomic_load_n(&Pong->ProbeLatency, __ATOMIC_RELAXED) && Now - LastPing >= PingIntervalMs*1000) {
+            sendPing(&Pong->Probe, Pong->Serial);
+            LastPing = Now;
+        }
 
-static inline v2 normalize(v2 Vec) {
-    v2 Result = mult(Vec, 1.0f / length(Vec));
-    return Result;
-}
+        bool Record = __atomic_load_n(&Pong->Record, __ATOMIC_RELAXED);
+        if(Record && !Recording) {
+            time_t Time = time(0);
+            tm Local;
+            strftime(Pong->RecordingName, sizeof(Pong->RecordingName), "pong-%Y%m%d-%H%M%S.rec",
+                     localtime_r(&Time, &Local));
+            Recording = startRecording(Pong->RecordingName, &Host);
+            __atomic_store_n(&Pong->RecordedTicks, 0, __ATOMIC_RELEASE);
+        }
+        else if(!Record && Recording) {
+            fclose(Recording);
+            Recording = 0;
+        }
 
-static inline r32 cross(v2 A, v2 B) {
-    return A.X*B.Y - A.Y*B.X;
-}
+        u64 Input = __atomic_load_n(&Pong->Input, __ATOMIC_ACQUIRE);
+        u64 InputChange = Input >> InputKeyBits;
+        host_input TickInput = {};
+        TickInput.Keys = Input & ((1 << InputKeyBits) - 1);
+        TickInput.Flags = DeviceGame ? HostTick_DeviceGame : 0;
+        TickInput.UpdateInterval = __atomic_load_n(&Pong->UpdateInterval, __ATOMIC_RELAXED);
 
-static inline v2 rotate(v2 Vec, r32 Deg) {
-    r32 Rad = Pi * Deg / 180.0f;
-    r32 Cos = cos(Rad);
-    r32 Sin = sin(Rad);
-    v2 Result = {Cos*Vec.X - Sin*Vec.Y, Sin*Vec.X + Cos*Vec.Y};
-    return Result;
-}
+        stepHost(&Host, TickInput, &Packets);
+        for(u32 I = 0; I < Packets.Count; ++I) {
+            sendBuffer(Packets.Packets + I, Pong->Serial);
+        }
+        if(Recording) {
+            recordTick(Recording, TickInput, &Packets);
+            __atomic_fetch_add(&Pong->RecordedTicks, 1, __ATOMIC_RELAXED);
+        }
 
-typedef struct {
-    bool Exists;
-    r32 T, U;
-} segment_intersection;
-static segment_intersection intersect(v2 Pos1, v2 Dir1, v2 Pos2, v2 Dir2) {
-    segment_intersection Result = {};
-
-    r32 Cross = cross(Dir1, Dir2);
-    if(Cross != 0) {
-        v2 Diff = sub(Pos2, Pos1);
-        Result.T = cross(Diff, Dir2)/Cross;
-        Result.U = cross(Diff, Dir1)/Cross;
-
-        if((Result.T >= 0.0f && Result.T <= 1.0f) &&
-           (Result.U >= 0.0f && Result.U <= 1.0f))
-        {
-            Result.Exists = true;
+        // NOTE(nox): In device game mode the keys are sent as soon as they are seen, otherwise they only
+        // reach the device with the next update
+        if(InputChange != LastInputChange && (DeviceGame || Host.SentUpdate)) {
+            recordSample(&Pong->InputLatency, getTimeUs() - InputChange);
+            LastInputChange = InputChange;
         }
     }
 
-    return Result;
+    if(Recording) {
+        fclose(Recording);
+    }
+    return 0;
 }
 
-static inline void randomizeBall(ball *Ball) {
-    Ball->Pos.X = Ball->Pos.Y = (GridSize-1)/2.f;
-    Ball->Vel = rotate({BallVel*0.5f, 0}, (drand48()*2.0f - 1)*45);
-    if(drand48() >= .5f) {
-        Ball->Vel = mult(Ball->Vel, -1);
+static bool startPong(pong_ctx *Pong) {
+    Pong->Serial = serialConnect(Pong->DevicePath);
+    if(Pong->Serial < 0) {
+        return false;
     }
-}
+    resetPacketReader(&Pong->Reader);
 
-static inline void restartGame(paddle *Left, paddle *Right, ball *Ball, u8 *LeftScore, u8 *RightScore) {
-    *LeftScore = *RightScore = 0;
-    Left->CenterY = Right->CenterY = GridSize/2;
-    Ball->Pos = {GridSize/2.0f, (r32)(Left->CenterY)};
-    Ball->Vel = {BallVel, 0};
+    __atomic_store_n(&Pong->Running, true, __ATOMIC_RELEASE);
+    if(pthread_create(&Pong->Thread, 0, tickThread, Pong) != 0) {
+        serialDisconnect(&Pong->Serial);
+        return false;
+    }
+    return true;
 }
 
-static inline u64 getTimeMs() {
-    timespec Spec = {};
-    clock_gettime(CLOCK_MONOTONIC, &Spec);
-    return Spec.tv_sec*1000 + Spec.tv_nsec / 1000000;
+static void stopPong(pong_ctx *Pong) {
+    __atomic_store_n(&Pong->Running, false, __ATOMIC_RELEASE);
+    pthread_join(Pong->Thread, 0);
+    serialDisconnect(&Pong->Serial);
 }
 
-static inline void updatePaddle(paddle *Paddle, paddle_control Control) {
-    u8 PaddleDelta = 2;
-
-    if(Control == Control_Up) {
-        Paddle->CenterY += PaddleDelta;
-    } else if(Control == Control_Down) {
-        Paddle->CenterY -= PaddleDelta;
+// NOTE(nox): Called from the UI thread with the keys it sees now
+static void publishInput(pong_ctx *Pong, u32 Keys) {
+    u64 Input = __atomic_load_n(&Pong->Input, __ATOMIC_RELAXED);
+    if((Input & ((1 << InputKeyBits) - 1)) != Keys) {
+        __atomic_store_n(&Pong->Input, (getTimeUs() << InputKeyBits) | Keys, __ATOMIC_RELEASE);
     }
-
-    Paddle->CenterY = clamp(PaddleMinY, Paddle->CenterY, PaddleMaxY);
 }
 
-int main(int, char**) {
-    srand48(time(0));
+int main(int ArgCount, char **Args) {
+    // NOTE(nox): The same seed gives the same serves, to reproduce a game
+    u32 Seed = time(0);
+    for(int I = 1; I+1 < ArgCount; ++I) {
+        if(strcmp(Args[I], "--seed") == 0) {
+            Seed = strtoul(Args[++I], 0, 0);
+        }
+    }
 
     glfwSetErrorCallback(glfwErrorCallback);
     if(!glfwInit()) {
@@ -249,14 +261,16 @@ int main(int, char**) {
     ImGui_ImplOpenGL3_Init(glsl_version);
 
 
-    serial_ctx Serial = -1;
+    pong_ctx Pong = {};
+    Pong.Serial = -1;
+    Pong.TickJitter.BucketUs = 50;
+    Pong.InputLatency.BucketUs = 1000;
+    resetLatencyProbe(&Pong.Probe);
+    Pong.UpdateInterval = 1;
+    Pong.Seed = Seed;
+    Pong.DevicePath = serialDevicePath(ArgCount, Args);
+    startTraceFromArgs(ArgCount, Args, TraceFlag_Pong);
 
-    u64 Time = getTimeMs();
-    u64 TimeAccumulator = 0;
-
-    paddle LeftPaddle, RightPaddle;
-    u8 LeftScore, RightScore;
-    ball Ball;
     while(!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
@@ -265,122 +279,81 @@ int main(int, char**) {
         ImGui::NewFrame();
 
         // NOTE(nox): Unplug detection
-        if(Serial >= 0) {
+        if(Pong.Serial >= 0) {
             termios Conf;
-            if(tcgetattr(Serial, &Conf)) {
-                serialDisconnect(&Serial);
+            if(tcgetattr(Pong.Serial, &Conf)) {
+                stopPong(&Pong);
             }
         }
 
+        // NOTE(nox): Straight from GLFW, which is as fresh as the last poll
+        u32 Keys = 0;
+        Keys |= glfwGetKey(window, GLFW_KEY_W)     == GLFW_PRESS ? Input_LeftUp    : 0;
+        Keys |= glfwGetKey(window, GLFW_KEY_S)     == GLFW_PRESS ? Input_LeftDown  : 0;
+        Keys |= glfwGetKey(window, GLFW_KEY_UP)    == GLFW_PRESS ? Input_RightUp   : 0;
+        Keys |= glfwGetKey(window, GLFW_KEY_DOWN)  == GLFW_PRESS ? Input_RightDown : 0;
+        Keys |= glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS ? Input_Restart   : 0;
+        publishInput(&Pong, Keys);
+
         ImGui::Begin("Control", 0, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysAutoResize);
-        if(Serial < 0) {
+        if(Pong.Serial < 0) {
             if(ImGui::Button("Connect")) {
-                Serial = serialConnect();
-                if(Serial >= 0) {
-                    restartGame(&LeftPaddle, &RightPaddle, &Ball, &LeftScore, &RightScore);
-                }
+                startPong(&Pong);
             }
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s", Pong.DevicePath);
         }
         else {
-            // NOTE(nox): Game processing
-            u64 NewTime = getTimeMs();
-            TimeAccumulator = min(TimeAccumulator + (NewTime-Time), 4*UpdateDeltaMs);
-            Time = NewTime;
-
-            bool DidUpdate = false;
-            bool UpdateScore = false;
-
-            if(ImGui::IsKeyDown(GLFW_KEY_SPACE)) {
-                DidUpdate = true;
-                UpdateScore = true;
-                restartGame(&LeftPaddle, &RightPaddle, &Ball, &LeftScore, &RightScore);
-            }
-            else {
-                while(TimeAccumulator >= UpdateDeltaMs) {
-                    TimeAccumulator -= UpdateDeltaMs;
-                    DidUpdate = true;
-
-                    controls Controls = {};
-                    if(ImGui::IsKeyDown(GLFW_KEY_W)) {
-                        Controls.Left = Control_Up;
-                    }
-                    else if(ImGui::IsKeyDown(GLFW_KEY_S)) {
-                        Controls.Left = Control_Down;
-                    }
-
-                    if(ImGui::IsKeyDown(GLFW_KEY_UP)) {
-                        Controls.Right = Control_Up;
-                    }
-                    else if(ImGui::IsKeyDown(GLFW_KEY_DOWN)) {
-                        Controls.Right = Control_Down;
-                    }
-
-                    updatePaddle(&LeftPaddle, Controls.Left);
-                    updatePaddle(&RightPaddle, Controls.Right);
-
-                    v2 OldPos = Ball.Pos;
-                    Ball.Pos = add(Ball.Pos, Ball.Vel);
-                    if(Ball.Vel.Y > 0.0f && Ball.Pos.Y > GridSize-1) {
-                        Ball.Pos.Y = GridSize-1;
-                        Ball.Vel.Y = -Ball.Vel.Y;
-                    }
-                    else if(Ball.Vel.Y < 0.0f && Ball.Pos.Y < 0) {
-                        Ball.Pos.Y = 0;
-                        Ball.Vel.Y = -Ball.Vel.Y;
-                    }
-                    else {
-                        v2 WallStart, WallDirection, VelDirection;
-                        if(Ball.Vel.X < 0) {
-                            WallStart = {LeftPaddleX+0.5f, LeftPaddle.CenterY - PaddleHeight/2.0f};
-                            WallDirection = {0, PaddleHeight};
-                            VelDirection = {BallVel, 0};
-                        }
-                        else {
-                            WallStart = {RightPaddleX-0.5f, RightPaddle.CenterY + PaddleHeight/2.0f};
-                            WallDirection = {0, -PaddleHeight};
-                            VelDirection = {-BallVel, 0};
-                        }
-
-                        segment_intersection Intersection = intersect(OldPos, Ball.Vel, WallStart, WallDirection);
-                        if(Intersection.Exists) {
-                            Ball.Pos = add(OldPos, mult(Ball.Vel, Intersection.T));
-                            Ball.Vel = rotate(VelDirection, (Intersection.U - 0.5f)*75.0f);
-                        }
-                    }
-
-                    if(Ball.Pos.X < -0.5f) {
-                        ++RightScore;
-                        if(RightScore >= 10) {
-                            LeftScore = RightScore = 0;
-                        }
-                        randomizeBall(&Ball);
-                        UpdateScore = true;
-                    }
-                    else if(Ball.Pos.X > GridSize-0.5f) {
-                        ++LeftScore;
-                        if(LeftScore >= 10) {
-                            LeftScore = RightScore = 0;
-                        }
-                        randomizeBall(&Ball);
-                        UpdateScore = true;
-                    }
-                }
+            if(ImGui::Button("Disconnect")) {
+                stopPong(&Pong);
             }
+        }
 
-            if(DidUpdate) {
-                buff Buff = {};
-                writePongUpdate(&Buff, LeftPaddle.CenterY, RightPaddle.CenterY, Ball.Pos.X, Ball.Pos.Y);
-                sendBuffer(&Buff, Serial);
-            }
+        bool DeviceGame = Pong.DeviceGame;
+        ImGui::Checkbox("Run the game on the device", &DeviceGame);
+        __atomic_store_n(&Pong.DeviceGame, DeviceGame, __ATOMIC_RELAXED);
+        if(DeviceGame) {
+            u32 Score = __atomic_load_n(&Pong.DeviceScore, __ATOMIC_RELAXED);
+            ImGui::Text("Device: %d - %d at tick %d (%d telemetry packets)", Score & 0xFF, Score >> 8,
+                        __atomic_load_n(&Pong.DeviceTick, __ATOMIC_RELAXED),
+                        __atomic_load_n(&Pong.TelemetryCount, __ATOMIC_RELAXED));
+        }
+        else {
+            s32 UpdateInterval = Pong.UpdateInterval;
+            ImGui::SliderInt("Ticks between updates", &UpdateInterval, 1, 8);
+            __atomic_store_n(&Pong.UpdateInterval, (u32)UpdateInterval, __ATOMIC_RELAXED);
+        }
 
-            if(UpdateScore) {
-                buff Buff = {};
-                writePongScore(&Buff, LeftScore, RightScore);
-                sendBuffer(&Buff, Serial);
-            }
+        ImGui::Separator();
 
-            if(ImGui::Button("Disconnect")) {
-                serialDisconnect(&Serial);
+        drawHistogram("Tick lateness", &Pong.TickJitter);
+        drawHistogram("Input to write latency", &Pong.InputLatency);
+        if(ImGui::Button("Reset statistics")) {
+            resetHistogram(&Pong.TickJitter);
+            resetHistogram(&Pong.InputLatency);
+        }
+
+        ImGui::Separator();
+
+        ImGui::Text("Seed %u", Pong.Seed);
+        bool Record = Pong.Record;
+        ImGui::Checkbox("Record", &Record);
+        __atomic_store_n(&Pong.Record, Record, __ATOMIC_RELAXED);
+        if(Record && Pong.Serial >= 0) {
+            u32 Ticks = __atomic_load_n(&Pong.RecordedTicks, __ATOMIC_ACQUIRE);
+            ImGui::SameLine();
+            ImGui::Text("%d ticks to %s", Ticks, Pong.RecordingName);
+        }
+
+        ImGui::Separator();
+
+        bool ProbeLatency = Pong.ProbeLatency;
+        ImGui::Checkbox("Probe latency", &ProbeLatency);
+        __atomic_store_n(&Pong.ProbeLatency, ProbeLatency, __ATOMIC_RELAXED);
+        if(ProbeLatency) {
+            drawLatencyPanel(&Pong.Probe);
+            if(ImGui::Button("Reset latency")) {
+                resetLatencyProbe(&Pong.Probe);
             }
         }
         ImGui::End();
@@ -398,6 +371,10 @@ int main(int, char**) {
         glfwSwapBuffers(window);
     }
 
+    if(Pong.Serial >= 0) {
+        stopPong(&Pong);
+    }
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,104 @@
+// NOTE(nox): Recordings
+//
+// A recording is the pong_host state when it started followed by one record per tick: the host_input of the
+// tick and the packets stepHost made of it, stuffed exactly as they went on the wire (without the
+// delimiter). Replaying the inputs from the saved state must give the same bytes.
+enum {
+    RecordingVersion = 1,
+};
+
+static const u8 RecordingMagic[4] = {'P', 'R', 'E', 'C'};
+
+typedef struct {
+    u8 Magic[4];
+    u32 Version;
+    u32 StateSize; // NOTE(nox): The state is saved as is, so it only loads in builds with the same layout
+    pong_host State;
+} recording_header;
+
+// NOTE(nox): Followed by PacketCount times a u16 size and the stuffed packet
+typedef struct {
+    host_input Input;
+    u8 PacketCount;
+} tick_record;
+
+typedef struct {
+    FILE *File;
+    pong_host State; // NOTE(nox): When the recording started
+} recording;
+
+static FILE *startRecording(const char *Path, pong_host *Host) {
+    FILE *File = fopen(Path, "wb");
+    if(File) {
+        recording_header Header = {};
+        memcpy(Header.Magic, RecordingMagic, sizeof(RecordingMagic));
+        Header.Version = RecordingVersion;
+        Header.StateSize = sizeof(pong_host);
+        Header.State = *Host;
+        fwrite(&Header, sizeof(Header), 1, File);
+    }
+    return File;
+}
+
+static void recordTick(FILE *File, host_input Input, tick_packets *Packets) {
+    tick_record Record = {Input, (u8)Packets->Count};
+    fwrite(&Record, sizeof(Record), 1, File);
+    for(u32 I = 0; I < Packets->Count; ++I) {
+        buff Encoded = {};
+        finalizePacket(Packets->Packets + I, &Encoded);
+        u16 Size = Encoded.Write;
+        fwrite(&Size, sizeof(Size), 1, File);
+        fwrite(Encoded.Data, 1, Encoded.Write, File);
+    }
+}
+
+static bool openRecording(const char *Path, recording *Recording) {
+    Recording->File = fopen(Path, "rb");
+    if(!Recording->File) {
+        return false;
+    }
+
+    recording_header Header;
+    if(fread(&Header, sizeof(Header), 1, Recording->File) != 1 ||
+       memcmp(Header.Magic, RecordingMagic, sizeof(RecordingMagic)) != 0 ||
+       Header.Version != RecordingVersion || Header.StateSize != sizeof(pong_host))
+    {
+        fclose(Recording->File);
+        Recording->File = 0;
+        return false;
+    }
+
+    Recording->State = Header.State;
+    return true;
+}
+
+// NOTE(nox): The packets come back stuffed, as they were recorded. Returns false at the end of the file or
+// if the record is cut short.
+static bool readTick(recording *Recording, host_input *Input, tick_packets *Packets) {
+    tick_record Record;
+    if(fread(&Record, sizeof(Record), 1, Recording->File) != 1 || Record.PacketCount > MaxPacketsPerTick) {
+        return false;
+    }
+
+    *Input = Record.Input;
+    Packets->Count = Record.PacketCount;
+    for(u32 I = 0; I < Packets->Count; ++I) {
+        buff *Buff = Packets->Packets + I;
+        u16 Size;
+        if(fread(&Size, sizeof(Size), 1, Recording->File) != 1 || Size > arrayCount(Buff->Data) ||
+           fread(Buff->Data, 1, Size, Recording->File) != Size)
+        {
+            return false;
+        }
+        Buff->Read = 0;
+        Buff->Write = Size;
+    }
+    return true;
+}
+
+static void closeRecording(recording *Recording) {
+    if(Recording->File) {
+        fclose(Recording->File);
+        Recording->File = 0;
+    }
+}
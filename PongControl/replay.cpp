@@ -0,0 +1,141 @@
+// NOTE(nox): Headless replay of PongControl recordings. Every recorded tick goes through stepHost again as
+// fast as possible and the packets are compared byte for byte with the recorded ones. The packet rate and
+// bandwidth are computed for the time the ticks took in the real game, so with --no-check this measures
+// what a change to the rules in game.cpp costs on the link before it ever reaches the device.
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <common.h>
+#include <protocol.hpp>
+#include "game.cpp"
+#include "recording.cpp"
+
+typedef struct {
+    u64 Ticks;
+    u64 DeviceGameTicks;
+    u64 Packets;
+    u64 WireBytes; // NOTE(nox): Stuffed, delimiters included
+    u64 Mismatches;
+    u64 FirstMismatch; // NOTE(nox): Only if there are any
+    u64 WallUs;
+} replay_stats;
+
+static inline u64 wallTimeUs() {
+    timespec Spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &Spec);
+    return Spec.tv_sec*1000000 + Spec.tv_nsec / 1000;
+}
+
+static bool samePackets(tick_packets *Recorded, tick_packets *Replayed) {
+    if(Recorded->Count != Replayed->Count) {
+        return false;
+    }
+
+    for(u32 I = 0; I < Recorded->Count; ++I) {
+        buff Encoded = {};
+        finalizePacket(Replayed->Packets + I, &Encoded);
+        buff *Expected = Recorded->Packets + I;
+        if(Encoded.Write != Expected->Write || memcmp(Encoded.Data, Expected->Data, Encoded.Write) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool replay(const char *Path, bool Check, replay_stats *Stats) {
+    static recording Recording;
+    if(!openRecording(Path, &Recording)) {
+        return false;
+    }
+
+    static pong_host Host;
+    static tick_packets Recorded, Replayed;
+    Host = Recording.State;
+
+    *Stats = (replay_stats){};
+    u64 Start = wallTimeUs();
+
+    host_input Input;
+    while(readTick(&Recording, &Input, &Recorded)) {
+        stepHost(&Host, Input, &Replayed);
+
+        if(Check && !samePackets(&Recorded, &Replayed)) {
+            if(Stats->Mismatches == 0) {
+                Stats->FirstMismatch = Stats->Ticks;
+            }
+            ++Stats->Mismatches;
+        }
+
+        for(u32 I = 0; I < Replayed.Count; ++I) {
+            buff Encoded = {};
+            finalizePacket(Replayed.Packets + I, &Encoded);
+            Stats->WireBytes += 1 + Encoded.Write;
+        }
+        Stats->Packets += Replayed.Count;
+        Stats->DeviceGameTicks += (Input.Flags & HostTick_DeviceGame) ? 1 : 0;
+        ++Stats->Ticks;
+    }
+
+    Stats->WallUs = wallTimeUs() - Start;
+    closeRecording(&Recording);
+    return true;
+}
+
+int main(int ArgCount, char **Args) {
+    bool Check = true;
+    int Result = 0;
+    u32 Replayed = 0;
+
+    for(int I = 1; I < ArgCount; ++I) {
+        if(strcmp(Args[I], "--no-check") == 0) {
+            Check = false;
+            continue;
+        }
+
+        replay_stats Stats;
+        if(!replay(Args[I], Check, &Stats)) {
+            fprintf(stderr, "Could not read %s as a recording of this build\n", Args[I]);
+            Result = 1;
+            continue;
+        }
+        ++Replayed;
+
+        // NOTE(nox): As long as the ticks took when they were recorded
+        u64 GameUs = ((Stats.Ticks - Stats.DeviceGameTicks)*UpdateDeltaMs*1000 +
+                      Stats.DeviceGameTicks*InputPollUs);
+        double GameSeconds = GameUs / 1e6;
+        double LinkBytesPerSecond = BaudRate / 10.0; // NOTE(nox): 8N1
+        double BytesPerSecond = GameSeconds > 0 ? Stats.WireBytes / GameSeconds : 0;
+
+        printf("%s\n", Args[I]);
+        printf("  %llu ticks (%llu with the game on the device), %.1f s of game replayed in %.3f s (%.0fx)\n",
+               (unsigned long long)Stats.Ticks, (unsigned long long)Stats.DeviceGameTicks, GameSeconds,
+               Stats.WallUs / 1e6, Stats.WallUs ? GameUs / (double)Stats.WallUs : 0.0);
+        printf("  %llu packets, %llu bytes on the wire: %.1f packets/s, %.0f B/s (%.1f%% of the link)\n",
+               (unsigned long long)Stats.Packets, (unsigned long long)Stats.WireBytes,
+               GameSeconds > 0 ? Stats.Packets / GameSeconds : 0, BytesPerSecond,
+               100*BytesPerSecond / LinkBytesPerSecond);
+
+        if(Check) {
+            if(Stats.Mismatches) {
+                printf("  MISMATCH in %llu ticks, the first at tick %llu\n",
+                       (unsigned long long)Stats.Mismatches, (unsigned long long)Stats.FirstMismatch);
+                Result = 1;
+            }
+            else {
+                printf("  packet stream matches\n");
+            }
+        }
+    }
+
+    if(Replayed == 0 && Result == 0) {
+        fprintf(stderr, "Usage: PongReplay [--no-check] <recording>...\n");
+        return 1;
+    }
+    return Result;
+}
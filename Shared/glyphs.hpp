@@ -0,0 +1,250 @@
+#if !defined(GLYPHS_HPP)
+#define GLYPHS_HPP
+
+// NOTE(nox): Stroke font for drawing text on the device. Glyphs are 3x5 cells, like the digits Pong always
+// had, and are written below as pictures that are turned into one u16 mask per glyph at compile time, so
+// the whole table is 128 bytes of flash. Text is laid out into points once, when it changes, and then
+// drawn point by point like everything else. Needs protocol.hpp.
+
+enum {
+    GlyphWidth = 3,
+    GlyphHeight = 5,
+    GlyphFirst = ' ',
+    GlyphLast = '_',
+    GlyphAdvance = GlyphWidth + 1, // NOTE(nox): In cells, scaled like everything else
+
+    // NOTE(nox): The text is drawn on top of every frame, so all slots together get a fixed budget of points,
+    // about 13ms at the 111us a point takes. One slot alone holds any text at scale 1.
+    MaxTextPoints = MaxTextLength*GlyphWidth*GlyphHeight,
+    MaxTextSlotPoints = MaxTextPoints,
+};
+
+// NOTE(nox): Rows go top to bottom and '#' is a lit cell. Bit Row*GlyphWidth + Col of the mask.
+static constexpr u16 glyphBits(const char *Rows, u32 Bit) {
+    return Bit == GlyphWidth*GlyphHeight ? 0 : (u16)(((Rows[Bit] == '#') << Bit) | glyphBits(Rows, Bit + 1));
+}
+
+static constexpr u16 glyph(const char (&Rows)[GlyphWidth*GlyphHeight + 1]) {
+    return glyphBits(Rows, 0);
+}
+
+static constexpr u16 GlyphTable[] = {
+    glyph("..." "..." "..." "..." "..."), // ' '
+    glyph(".#." ".#." ".#." "..." ".#."), // !
+    glyph("#.#" "#.#" "..." "..." "..."), // "
+    glyph("#.#" "###" "#.#" "###" "#.#"), // #
+    glyph(".##" "##." ".#." ".##" "##."), // $
+    glyph("#.#" "..#" ".#." "#.." "#.#"), // %
+    glyph(".#." "#.#" ".#." "#.#" ".##"), // &
+    glyph(".#." ".#." "..." "..." "..."), // '
+    glyph("..#" ".#." ".#." ".#." "..#"), // (
+    glyph("#.." ".#." ".#." ".#." "#.."), // )
+    glyph("..." "#.#" ".#." "#.#" "..."), // *
+    glyph("..." ".#." "###" ".#." "..."), // +
+    glyph("..." "..." "..." ".#." "#.."), // ,
+    glyph("..." "..." "###" "..." "..."), // -
+    glyph("..." "..." "..." "..." ".#."), // .
+    glyph("..#" "..#" ".#." "#.." "#.."), // /
+    glyph("###" "#.#" "#.#" "#.#" "###"), // 0
+    glyph(".#." ".#." ".#." ".#." ".#."), // 1
+    glyph("###" "..#" "###" "#.." "###"), // 2
+    glyph("###" "..#" ".##" "..#" "###"), // 3
+    glyph("#.#" "#.#" "###" "..#" "..#"), // 4
+    glyph("###" "#.." "###" "..#" "###"), // 5
+    glyph("###" "#.." "###" "#.#" "###"), // 6
+    glyph("###" "..#" "..#" "..#" "..#"), // 7
+    glyph("###" "#.#" "###" "#.#" "###"), // 8
+    glyph("###" "#.#" "###" "..#" "###"), // 9
+    glyph("..." ".#." "..." ".#." "..."), // :
+    glyph("..." ".#." "..." ".#." "#.."), // ;
+    glyph("..#" ".#." "#.." ".#." "..#"), // <
+    glyph("..." "###" "..." "###" "..."), // =
+    glyph("#.." ".#." "..#" ".#." "#.."), // >
+    glyph("###" "..#" ".#." "..." ".#."), // ?
+    glyph(".#." "#.#" "###" "#.." ".##"), // @
+    glyph(".#." "#.#" "###" "#.#" "#.#"), // A
+    glyph("##." "#.#" "##." "#.#" "##."), // B
+    glyph(".##" "#.." "#.." "#.." ".##"), // C
+    glyph("##." "#.#" "#.#" "#.#" "##."), // D
+    glyph("###" "#.." "##." "#.." "###"), // E
+    glyph("###" "#.." "##." "#.." "#.."), // F
+    glyph(".##" "#.." "#.#" "#.#" ".##"), // G
+    glyph("#.#" "#.#" "###" "#.#" "#.#"), // H
+    glyph("###" ".#." ".#." ".#." "###"), // I
+    glyph("..#" "..#" "..#" "#.#" ".#."), // J
+    glyph("#.#" "#.#" "##." "#.#" "#.#"), // K
+    glyph("#.." "#.." "#.." "#.." "###"), // L
+    glyph("#.#" "###" "###" "#.#" "#.#"), // M
+    glyph("##." "#.#" "#.#" "#.#" "#.#"), // N
+    glyph(".#." "#.#" "#.#" "#.#" ".#."), // O
+    glyph("##." "#.#" "##." "#.." "#.."), // P
+    glyph(".#." "#.#" "#.#" "##." ".##"), // Q
+    glyph("##." "#.#" "##." "#.#" "#.#"), // R
+    glyph(".##" "#.." ".#." "..#" "##."), // S
+    glyph("###" ".#." ".#." ".#." ".#."), // T
+    glyph("#.#" "#.#" "#.#" "#.#" "###"), // U
+    glyph("#.#" "#.#" "#.#" "#.#" ".#."), // V
+    glyph("#.#" "#.#" "###" "###" "#.#"), // W
+    glyph("#.#" "#.#" ".#." "#.#" "#.#"), // X
+    glyph("#.#" "#.#" ".#." ".#." ".#."), // Y
+    glyph("###" "..#" ".#." "#.." "###"), // Z
+    glyph("##." "#.." "#.." "#.." "##."), // [
+    glyph("#.." "#.." ".#." "..#" "..#"), // backslash
+    glyph(".##" "..#" "..#" "..#" ".##"), // ]
+    glyph(".#." "#.#" "..." "..." "..."), // ^
+    glyph("..." "..." "..." "..." "###"), // _
+};
+static_assert(arrayCount(GlyphTable) == GlyphLast - GlyphFirst + 1, "One glyph per character");
+
+// NOTE(nox): Lowercase is drawn as uppercase and anything else without a glyph as '?'
+static inline u16 glyphMask(u8 Char) {
+    if(Char >= 'a' && Char <= 'z') {
+        Char -= 'a' - 'A';
+    }
+    if(Char < GlyphFirst || Char > GlyphLast) {
+        Char = '?';
+    }
+    return GlyphTable[Char - GlyphFirst];
+}
+
+static inline bool glyphCell(u16 Mask, s32 Row, s32 Col) {
+    return (Row >= 0 && Row < GlyphHeight && Col >= 0 && Col < GlyphWidth &&
+            (Mask & (1 << (Row*GlyphWidth + Col))));
+}
+
+typedef struct {
+    u8 X, Y;
+} text_point;
+
+typedef struct {
+    u32 Count;
+    bool Truncated; // NOTE(nox): The text had more points than fit, see layoutText
+    text_point Points[MaxTextSlotPoints];
+} text_slot;
+
+typedef struct {
+    text_point *Points;
+    u32 Count;
+    u32 Max;
+    bool Truncated;
+    bool NewGlyph;
+} text_layout;
+
+// NOTE(nox): X gets ZDisableBit, like the animation points, on the first point of every glyph and on every
+// point that isn't next to the one before, so the beam doesn't draw its way into the text or across gaps
+static inline void pushTextPoint(text_layout *Layout, s32 X, s32 Y) {
+    // NOTE(nox): Whatever falls outside of the grid is dropped, so text can be partly off screen
+    if(X < 0 || X >= GridSize || Y < 0 || Y >= GridSize) {
+        return;
+    }
+    if(Layout->Count >= Layout->Max) {
+        Layout->Truncated = true;
+        return;
+    }
+
+    bool Blank = Layout->NewGlyph || Layout->Count == 0;
+    if(!Blank) {
+        text_point *Last = Layout->Points + Layout->Count - 1;
+        Blank = abs(X - (Last->X & ~ZDisableBit)) > 1 || abs(Y - Last->Y) > 1;
+    }
+
+    text_point *Point = Layout->Points + Layout->Count++;
+    Point->X = X | (Blank ? ZDisableBit : 0);
+    Point->Y = Y;
+    Layout->NewGlyph = false;
+}
+
+// NOTE(nox): (X, Y) is the bottom left of the first glyph. Every lit cell is a point, and with Scale > 1 the
+// gaps to the lit neighbours are filled so the strokes stay lines. The rows are walked back and forth so
+// the beam mostly moves to a neighbouring point. Returns the number of points written to Out, and sets
+// Truncated when there were more than MaxPoints.
+static u32 layoutText(const u8 *Text, u32 Length, s32 X, s32 Y, u32 Scale, text_point *Out, u32 MaxPoints,
+                      bool *Truncated = 0)
+{
+    text_layout Layout = {Out, 0, MaxPoints, false, false};
+    Scale = clamp(1, (s32)Scale, MaxTextScale);
+
+    for(u32 I = 0; I < Length; ++I, X += GlyphAdvance*Scale) {
+        u16 Mask = glyphMask(Text[I]);
+        Layout.NewGlyph = true;
+        for(s32 Row = 0; Row < GlyphHeight; ++Row) {
+            bool Reverse = Row & 1;
+            s32 Step = Reverse ? -1 : 1;
+            for(s32 Walk = 0; Walk < GlyphWidth; ++Walk) {
+                s32 Col = Reverse ? GlyphWidth-1 - Walk : Walk;
+                if(!glyphCell(Mask, Row, Col)) {
+                    continue;
+                }
+
+                s32 CellX = X + Col*Scale;
+                s32 CellY = Y + (GlyphHeight-1 - Row)*Scale;
+                pushTextPoint(&Layout, CellX, CellY);
+                if(glyphCell(Mask, Row+1, Col)) {
+                    for(s32 K = 1; K < (s32)Scale; ++K) {
+                        pushTextPoint(&Layout, CellX, CellY - K);
+                    }
+                }
+                if(glyphCell(Mask, Row, Col + Step)) {
+                    for(s32 K = 1; K < (s32)Scale; ++K) {
+                        pushTextPoint(&Layout, CellX + K*Step, CellY);
+                    }
+                }
+            }
+        }
+    }
+
+    if(Truncated) {
+        *Truncated = Layout.Truncated;
+    }
+    return Layout.Count;
+}
+
+// NOTE(nox): Points of the text budget the slots other than Except use
+static u32 otherTextPoints(text_slot *Slots, u32 Except) {
+    u32 Result = 0;
+    for(u32 Slot = 0; Slot < MaxTextSlots; ++Slot) {
+        Result += Slot == Except ? 0 : Slots[Slot].Count;
+    }
+    return Result;
+}
+
+// NOTE(nox): For the host, to tell before sending whether the device will have room for all of Text, with
+// OtherPoints of the budget taken by the other slots. The text is laid out as the device would after
+// writeDrawText. Returns the number of points it takes.
+static bool textFitsSlot(const char *Text, u8 X, u8 Y, u8 Scale, u32 OtherPoints, u32 *PointCount = 0) {
+    text_point Points[MaxTextSlotPoints];
+    bool Truncated;
+    u32 Length = min((u64)strlen(Text), (u64)MaxTextLength);
+    u32 Max = MaxTextPoints - min((u64)OtherPoints, (u64)MaxTextPoints);
+    u32 Count = layoutText((const u8 *)Text, Length, X, Y, Scale, Points, Max, &Truncated);
+    if(PointCount) {
+        *PointCount = Count;
+    }
+    return strlen(Text) <= MaxTextLength && !Truncated;
+}
+
+// NOTE(nox): Command_DrawText payload, see writeDrawText. An empty string clears the slot. The slot gets what
+// is left of the text budget, the rest of its text is dropped and Truncated is set.
+static bool handleDrawText(buff *Pkt, u16 Length, text_slot *Slots) {
+    enum { CmdHeaderSize = 5 };
+    if(Length < CmdHeaderSize) {
+        return false;
+    }
+
+    u8 Slot = readU8(Pkt);
+    u8 X = readU8(Pkt);
+    u8 Y = readU8(Pkt);
+    u8 Scale = readU8(Pkt);
+    u8 TextLength = readU8(Pkt);
+    if(Slot >= MaxTextSlots || TextLength > MaxTextLength || Length - CmdHeaderSize < TextLength) {
+        return false;
+    }
+
+    text_slot *TextSlot = Slots + Slot;
+    u32 Budget = MaxTextPoints - otherTextPoints(Slots, Slot);
+    TextSlot->Count = layoutText(Pkt->Data + Pkt->Read, TextLength, X, Y, Scale,
+                                 TextSlot->Points, Budget, &TextSlot->Truncated);
+    return true;
+}
+
+#endif // GLYPHS_HPP
@@ -0,0 +1,174 @@
+#if !defined(LATENCY_HPP)
+#define LATENCY_HPP
+
+// NOTE(nox): Latency histograms and the ping/echo probe, shared by both applications and the CLI. Needs
+// protocol.hpp and serial.hpp. The drawing functions are only there when ImGui was included before.
+
+static inline u64 getTimeUs() {
+    timespec Spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &Spec);
+    return Spec.tv_sec*1000000 + Spec.tv_nsec / 1000;
+}
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Histogram
+enum { HistogramBucketCount = 64 };
+
+// NOTE(nox): Written by one thread only, but may be read by another while it runs. The counters are updated
+// atomically one by one, which is all the readers need to draw them.
+typedef struct {
+    u32 BucketUs; // NOTE(nox): The last bucket also holds everything above it
+    u32 Buckets[HistogramBucketCount];
+    u32 Count;
+    u32 MaxUs;
+} histogram;
+
+// NOTE(nox): A histogram that was never reset has no buckets yet and drops the sample, so a stray echo
+// can't hurt a probe that isn't running
+static void recordSample(histogram *Histogram, u64 Us) {
+    if(Histogram->BucketUs == 0) {
+        return;
+    }
+
+    u32 Bucket = min(Us / Histogram->BucketUs, (u64)HistogramBucketCount - 1);
+    __atomic_fetch_add(Histogram->Buckets + Bucket, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&Histogram->Count, 1, __ATOMIC_RELAXED);
+    if(Us > __atomic_load_n(&Histogram->MaxUs, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&Histogram->MaxUs, (u32)min(Us, (u64)UINT32_MAX), __ATOMIC_RELAXED);
+    }
+}
+
+static void resetHistogram(histogram *Histogram) {
+    for(u32 I = 0; I < HistogramBucketCount; ++I) {
+        __atomic_store_n(Histogram->Buckets + I, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&Histogram->Count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&Histogram->MaxUs, 0, __ATOMIC_RELAXED);
+}
+
+// NOTE(nox): Upper bound of the bucket where the percentile falls, but never above the largest sample. 0
+// without samples.
+static u32 histogramPercentile(histogram *Histogram, r32 Percentile) {
+    u32 Count = __atomic_load_n(&Histogram->Count, __ATOMIC_RELAXED);
+    u32 MaxUs = __atomic_load_n(&Histogram->MaxUs, __ATOMIC_RELAXED);
+    if(Count == 0) {
+        return 0;
+    }
+
+    u32 Wanted = (u32)ceilf(Count*Percentile);
+    u32 Seen = 0;
+    for(u32 I = 0; I < HistogramBucketCount; ++I) {
+        Seen += __atomic_load_n(Histogram->Buckets + I, __ATOMIC_RELAXED);
+        if(Seen >= Wanted) {
+            return min((u64)(I+1)*Histogram->BucketUs, (u64)MaxUs);
+        }
+    }
+    return MaxUs;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Ping probe
+//
+// Each ping carries the host time, which the device echoes back with its own timestamps, so nothing has
+// to be remembered about the pings in flight. From one echo we get:
+//   - RoundTrip: host write to host read, including the USB-serial adapter buffering both ways
+//   - Device:    ping decoded to echo sent. Waiting for the draw loop to reach decodeRx happens before
+//                the decode, so it is not in here but in RoundTrip
+//   - ToBeam:    ping decoded to the start of the next frame, when something sent along with the ping
+//                would start being drawn
+// The host to device time alone can't be measured without synchronized clocks, the half of the round trip
+// minus the device time is the estimate shown.
+enum {
+    PingIntervalMs = 100,
+};
+
+typedef struct {
+    u32 NextSeq;
+    u32 Sent;
+    u32 Received;
+    u8 LastState; // NOTE(nox): DeviceState_* of the last echo
+
+    histogram RoundTrip;
+    histogram Device;
+    histogram ToBeam;
+} latency_probe;
+
+static void resetLatencyProbe(latency_probe *Probe) {
+    __atomic_store_n(&Probe->Sent, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&Probe->Received, 0, __ATOMIC_RELAXED);
+    Probe->RoundTrip.BucketUs = 500;
+    Probe->Device.BucketUs = 50;
+    Probe->ToBeam.BucketUs = 500;
+    resetHistogram(&Probe->RoundTrip);
+    resetHistogram(&Probe->Device);
+    resetHistogram(&Probe->ToBeam);
+}
+
+static void sendPing(latency_probe *Probe, int Fd) {
+    buff Buff = {};
+    writePing(&Buff, Probe->NextSeq++, (u32)getTimeUs());
+    sendBuffer(&Buff, Fd);
+    __atomic_fetch_add(&Probe->Sent, 1, __ATOMIC_RELAXED);
+}
+
+// NOTE(nox): Call with every Command_Echo packet
+static void handleEcho(latency_probe *Probe, buff *Pkt, u16 Length) {
+    echo_info Echo;
+    if(!readEcho(Pkt, Length, &Echo)) {
+        return;
+    }
+
+    // NOTE(nox): All of these wrap around together, so the differences are right even when they do
+    u32 RoundTrip = (u32)getTimeUs() - Echo.HostTimeUs;
+    u32 Device = Echo.DeviceTxUs - Echo.DeviceRxUs;
+    recordSample(&Probe->RoundTrip, RoundTrip);
+    recordSample(&Probe->Device, Device);
+    if(Echo.State & DeviceState_Drawing) {
+        u32 ToBeam = Echo.SinceFrameUs < Echo.FramePeriodUs ? Echo.FramePeriodUs - Echo.SinceFrameUs : 0;
+        recordSample(&Probe->ToBeam, ToBeam);
+    }
+    __atomic_store_n(&Probe->LastState, Echo.State, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&Probe->Received, 1, __ATOMIC_RELAXED);
+}
+
+static inline u32 estimatedOneWayUs(latency_probe *Probe, r32 Percentile) {
+    u32 RoundTrip = histogramPercentile(&Probe->RoundTrip, Percentile);
+    u32 Device = histogramPercentile(&Probe->Device, 0.5f);
+    return RoundTrip > Device ? (RoundTrip - Device) / 2 : 0;
+}
+
+#if defined(IMGUI_VERSION)
+static void drawHistogram(const char *Label, histogram *Histogram) {
+    r32 Values[HistogramBucketCount];
+    for(u32 I = 0; I < HistogramBucketCount; ++I) {
+        Values[I] = __atomic_load_n(Histogram->Buckets + I, __ATOMIC_RELAXED);
+    }
+
+    char Overlay[100];
+    snprintf(Overlay, sizeof(Overlay), "p50 %d us, p99 %d us, max %d us (%d samples)",
+             histogramPercentile(Histogram, 0.5f), histogramPercentile(Histogram, 0.99f),
+             __atomic_load_n(&Histogram->MaxUs, __ATOMIC_RELAXED),
+             __atomic_load_n(&Histogram->Count, __ATOMIC_RELAXED));
+    ImGui::Text("%s (%d us per bar)", Label, Histogram->BucketUs);
+    ImGui::PushID(Label);
+    ImGui::PlotHistogram("", Values, HistogramBucketCount, 0, Overlay, 0, FLT_MAX, ImVec2(500, 80));
+    ImGui::PopID();
+}
+
+static void drawLatencyPanel(latency_probe *Probe) {
+    u32 Sent = __atomic_load_n(&Probe->Sent, __ATOMIC_RELAXED);
+    u32 Received = __atomic_load_n(&Probe->Received, __ATOMIC_RELAXED);
+    u8 State = __atomic_load_n(&Probe->LastState, __ATOMIC_RELAXED);
+    ImGui::Text("%d pings, %d echoes. Device is %s%s", Sent, Received,
+                (State & DeviceState_Drawing) ? "drawing" : "powered off",
+                (State & DeviceState_Simulating) ? " and running the game" : "");
+    ImGui::Text("Host -> device estimate: p50 %d us, p99 %d us",
+                estimatedOneWayUs(Probe, 0.5f), estimatedOneWayUs(Probe, 0.99f));
+    drawHistogram("Round trip", &Probe->RoundTrip);
+    drawHistogram("Time on the device", &Probe->Device);
+    drawHistogram("Device decode to beam", &Probe->ToBeam);
+}
+#endif
+
+#endif // LATENCY_HPP
@@ -0,0 +1,66 @@
+#if !defined(PLAYLIST_HPP)
+#define PLAYLIST_HPP
+
+// NOTE(nox): The device side of playlists (see Command_SetPlaylist), shared by AnimPlayer and VirtualDevice
+// so both advance the same way. The firmware asks nextPlaylistEntry what comes after the last frame of the
+// playing slot, so it can tween into it, and calls endPlaylistPass once that frame is done. Needs
+// protocol.hpp.
+typedef struct {
+    playlist_entry Entries[MaxPlaylistEntries];
+    u32 Count;
+    u32 Current;
+    u32 PassesDone;
+    bool Pending; // NOTE(nox): Set by a new playlist, which starts at the end of the current pass
+} playlist;
+
+static void setPlaylist(playlist *Playlist, playlist_entry *Entries, u32 Count) {
+    memcpy(Playlist->Entries, Entries, Count*sizeof(*Entries));
+    Playlist->Count = Count;
+    Playlist->Pending = Count > 0;
+}
+
+static inline void clearPlaylist(playlist *Playlist) {
+    Playlist->Count = 0;
+    Playlist->Pending = false;
+}
+
+// NOTE(nox): The entry that starts when the current pass ends, or 0 if the same slot plays again
+static playlist_entry *nextPlaylistEntry(playlist *Playlist) {
+    if(Playlist->Count == 0) {
+        return 0;
+    }
+    if(Playlist->Pending) {
+        return Playlist->Entries;
+    }
+
+    playlist_entry *Entry = Playlist->Entries + Playlist->Current;
+    if(Entry->Loops == 0 || Playlist->PassesDone + 1 < Entry->Loops) {
+        return 0;
+    }
+    return Playlist->Entries + (Playlist->Current + 1) % Playlist->Count;
+}
+
+// NOTE(nox): Returns the entry that starts, like nextPlaylistEntry
+static playlist_entry *endPlaylistPass(playlist *Playlist) {
+    playlist_entry *Next = nextPlaylistEntry(Playlist);
+    if(Next) {
+        Playlist->Current = Next - Playlist->Entries;
+        Playlist->PassesDone = 0;
+        Playlist->Pending = false;
+    }
+    else if(Playlist->PassesDone < 0xFFFF) {
+        ++Playlist->PassesDone;
+    }
+    return Next;
+}
+
+static void playlistStatus(playlist *Playlist, u8 PlayingSlot, u8 UploadSlot, playlist_status *Status) {
+    Status->PlayingSlot = PlayingSlot;
+    Status->UploadSlot = UploadSlot;
+    Status->Entry = Playlist->Pending ? 0 : Playlist->Current;
+    Status->EntryCount = Playlist->Count;
+    Status->PassesDone = Playlist->Pending ? 0 : Playlist->PassesDone;
+    Status->Pending = Playlist->Pending;
+}
+
+#endif // PLAYLIST_HPP
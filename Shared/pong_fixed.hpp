@@ -0,0 +1,200 @@
+#if !defined(PONG_FIXED_HPP)
+#define PONG_FIXED_HPP
+
+// NOTE(nox): Fixed point port of PongControl's game, so the whole game can run on the device, which has no
+// FPU. Numbers are 16.16 and the game steps once per device frame (60Hz) instead of every 33ms, so the
+// speeds are half of PongControl's to keep the same feel. Everything random comes from the seed given to
+// pongReset, so a game is reproducible. Needs protocol.hpp.
+
+typedef s32 fixed;
+
+enum {
+    FixedShift = 16,
+    FixedOne = 1 << FixedShift,
+};
+
+#define toFixed(Val) ((fixed)((Val)*FixedOne))
+
+typedef struct {
+    fixed X, Y;
+} fixed_v2;
+
+static inline fixed fixedMul(fixed A, fixed B) {
+    return (fixed)(((int64_t)A*B) >> FixedShift);
+}
+
+static inline fixed fixedDiv(fixed A, fixed B) {
+    return (fixed)(((int64_t)A * FixedOne) / B);
+}
+
+static inline fixed fixedCross(fixed_v2 A, fixed_v2 B) {
+    return fixedMul(A.X, B.Y) - fixedMul(A.Y, B.X);
+}
+
+// NOTE(nox): Bhaskara I's approximation, sin(x) ~ 4x(180 - x)/(40500 - x(180 - x)) for x in [0, 180]
+// degrees, which is off by less than 0.002 and only needs one division.
+static fixed fixedSinDeg(fixed Deg) {
+    Deg %= 360*FixedOne;
+    if(Deg >= 180*FixedOne) {
+        Deg -= 360*FixedOne;
+    }
+    else if(Deg < -180*FixedOne) {
+        Deg += 360*FixedOne;
+    }
+
+    bool Negative = Deg < 0;
+    if(Negative) {
+        Deg = -Deg;
+    }
+
+    int64_t P = fixedMul(Deg, 180*FixedOne - Deg);
+    fixed Result = (fixed)((4*P << FixedShift) / ((int64_t)40500*FixedOne - P));
+    return Negative ? -Result : Result;
+}
+
+static inline fixed fixedCosDeg(fixed Deg) {
+    return fixedSinDeg(Deg + 90*FixedOne);
+}
+
+static inline fixed_v2 fixedRotate(fixed_v2 Vec, fixed Deg) {
+    fixed Cos = fixedCosDeg(Deg);
+    fixed Sin = fixedSinDeg(Deg);
+    fixed_v2 Result = {fixedMul(Cos, Vec.X) - fixedMul(Sin, Vec.Y), fixedMul(Sin, Vec.X) + fixedMul(Cos, Vec.Y)};
+    return Result;
+}
+
+static bool fixedIntersect(fixed_v2 Pos1, fixed_v2 Dir1, fixed_v2 Pos2, fixed_v2 Dir2, fixed *T, fixed *U) {
+    fixed Cross = fixedCross(Dir1, Dir2);
+    if(Cross == 0) {
+        return false;
+    }
+
+    fixed_v2 Diff = {Pos2.X - Pos1.X, Pos2.Y - Pos1.Y};
+    *T = fixedDiv(fixedCross(Diff, Dir2), Cross);
+    *U = fixedDiv(fixedCross(Diff, Dir1), Cross);
+    return (*T >= 0 && *T <= FixedOne) && (*U >= 0 && *U <= FixedOne);
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Game
+enum {
+    PongSimBallSpeed = FixedOne, // NOTE(nox): Grid units per step
+    PongSimPaddleSpeed = 1,
+};
+
+typedef struct {
+    u8 LeftY, RightY; // NOTE(nox): Paddle centers
+    fixed_v2 BallPos;
+    fixed_v2 BallVel;
+    u8 LeftScore, RightScore;
+    u32 Rng;
+    u32 Tick;
+} pong_sim;
+
+// NOTE(nox): xorshift32
+static inline u32 pongRandom(pong_sim *Sim) {
+    Sim->Rng ^= Sim->Rng << 13;
+    Sim->Rng ^= Sim->Rng >> 17;
+    Sim->Rng ^= Sim->Rng << 5;
+    return Sim->Rng;
+}
+
+// NOTE(nox): In [0, 1[
+static inline fixed pongRandomUnit(pong_sim *Sim) {
+    return pongRandom(Sim) >> (32 - FixedShift);
+}
+
+static void pongServe(pong_sim *Sim) {
+    Sim->BallPos.X = Sim->BallPos.Y = toFixed(GridSize-1) / 2;
+
+    fixed_v2 Vel = {PongSimBallSpeed/2, 0};
+    Sim->BallVel = fixedRotate(Vel, fixedMul(2*pongRandomUnit(Sim) - FixedOne, toFixed(45)));
+    if(pongRandomUnit(Sim) >= FixedOne/2) {
+        Sim->BallVel.X = -Sim->BallVel.X;
+        Sim->BallVel.Y = -Sim->BallVel.Y;
+    }
+}
+
+static void pongReset(pong_sim *Sim, u32 Seed) {
+    *Sim = (pong_sim){};
+    Sim->Rng = Seed ? Seed : 1; // NOTE(nox): xorshift never leaves 0
+    Sim->LeftY = Sim->RightY = GridSize/2;
+    Sim->BallPos.X = toFixed(GridSize/2);
+    Sim->BallPos.Y = toFixed(Sim->LeftY);
+    Sim->BallVel.X = PongSimBallSpeed;
+}
+
+static inline void pongMovePaddle(u8 *CenterY, u8 Keys, u8 UpBit, u8 DownBit) {
+    if(Keys & UpBit) {
+        *CenterY += PongSimPaddleSpeed;
+    }
+    else if(Keys & DownBit) {
+        *CenterY -= PongSimPaddleSpeed;
+    }
+    *CenterY = clamp(PaddleMinY, *CenterY, PaddleMaxY);
+}
+
+// NOTE(nox): Advances the game by one step with the given PongInput_* keys, returns PongEvent_* flags
+static u8 pongStep(pong_sim *Sim, u8 Keys) {
+    u8 Events = 0;
+    ++Sim->Tick;
+
+    pongMovePaddle(&Sim->LeftY, Keys, PongInput_LeftUp, PongInput_LeftDown);
+    pongMovePaddle(&Sim->RightY, Keys, PongInput_RightUp, PongInput_RightDown);
+
+    fixed_v2 *Pos = &Sim->BallPos;
+    fixed_v2 *Vel = &Sim->BallVel;
+    fixed_v2 OldPos = *Pos;
+    Pos->X += Vel->X;
+    Pos->Y += Vel->Y;
+    if(Vel->Y > 0 && Pos->Y > toFixed(GridSize-1)) {
+        Pos->Y = toFixed(GridSize-1);
+        Vel->Y = -Vel->Y;
+    }
+    else if(Vel->Y < 0 && Pos->Y < 0) {
+        Pos->Y = 0;
+        Vel->Y = -Vel->Y;
+    }
+    else {
+        fixed_v2 WallStart, WallDirection, VelDirection;
+        if(Vel->X < 0) {
+            WallStart = {toFixed(LeftPaddleX) + FixedOne/2, toFixed(Sim->LeftY) - toFixed(PaddleHeight)/2};
+            WallDirection = {0, toFixed(PaddleHeight)};
+            VelDirection = {PongSimBallSpeed, 0};
+        }
+        else {
+            WallStart = {toFixed(RightPaddleX) - FixedOne/2, toFixed(Sim->RightY) + toFixed(PaddleHeight)/2};
+            WallDirection = {0, -toFixed(PaddleHeight)};
+            VelDirection = {-PongSimBallSpeed, 0};
+        }
+
+        fixed T, U;
+        if(fixedIntersect(OldPos, *Vel, WallStart, WallDirection, &T, &U)) {
+            Pos->X = OldPos.X + fixedMul(Vel->X, T);
+            Pos->Y = OldPos.Y + fixedMul(Vel->Y, T);
+            *Vel = fixedRotate(VelDirection, fixedMul(U - FixedOne/2, toFixed(75)));
+        }
+    }
+
+    if(Pos->X < -FixedOne/2) {
+        ++Sim->RightScore;
+        if(Sim->RightScore >= 10) {
+            Sim->LeftScore = Sim->RightScore = 0;
+        }
+        pongServe(Sim);
+        Events |= PongEvent_Score;
+    }
+    else if(Pos->X > toFixed(GridSize) - FixedOne/2) {
+        ++Sim->LeftScore;
+        if(Sim->LeftScore >= 10) {
+            Sim->LeftScore = Sim->RightScore = 0;
+        }
+        pongServe(Sim);
+        Events |= PongEvent_Score;
+    }
+
+    return Events;
+}
+
+#endif // PONG_FIXED_HPP
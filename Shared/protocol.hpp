@@ -25,9 +25,15 @@
 // NOTE(nox): This version uses the full byte
 #define inputMsbHighRes(Val) ((Val >> 4) & 0x0F)
 #define inputLsbHighRes(Val) ((Val << 4) & 0xF0)
+
+// NOTE(nox): The first byte of a packet is MagicNumber | Command. Commands used to be 4 bits with the magic in
+// the high nibble, now they are 5 bits with the magic in the top 3. Commands below 16 are sent exactly as
+// before, and older firmwares see the newer ones as an invalid packet start and skip them.
 enum {
     BaudRate = 115200,
     MagicNumber = 0xA0,
+    MagicMask = 0xE0,
+    CommandMask = 0x1F,
     MaxPacketSize = 1<<13,
     GridSize = 1<<6,
 };
@@ -42,6 +48,81 @@ enum {
     ZDisableBit = 1<<6,
 };
 
+// NOTE(nox): High resolution frames (Command_UpdateFrameHighRes) have the full 12 bits of the DAC per
+// axis instead of the 6 of the grid, with Y going up like on the device. Each point is packed in 3 bytes
+// (X low byte, X high nibble | Y low nibble << 4, Y high byte) and the blanking flags come after all of
+// them as a bitmap, bit I of byte I/8 for point I. That's 3.125 bytes per point instead of 2, and it
+// takes the same space on the device as a full grid frame.
+enum {
+    FrameFormat_Grid,
+    FrameFormat_HighRes,
+
+    HighResMax = (1<<12) - 1,
+    GridToHighResShift = 6, // NOTE(nox): A grid coordinate is the top 6 bits of a high resolution one
+    MaxHighResPoints = 192,
+};
+
+static constexpr u32 highResFrameSize(u32 PointCount) {
+    return 3*PointCount + (PointCount + 7)/8;
+}
+
+static inline void packHighResPoint(u8 *Packed, u32 Idx, u16 X, u16 Y) {
+    u8 *Out = Packed + 3*Idx;
+    Out[0] = X & 0xFF;
+    Out[1] = ((X >> 8) & 0x0F) | ((Y & 0x0F) << 4);
+    Out[2] = (Y >> 4) & 0xFF;
+}
+
+static inline void unpackHighResPoint(const u8 *Packed, u32 Idx, u16 *X, u16 *Y) {
+    const u8 *In = Packed + 3*Idx;
+    *X = In[0] | ((In[1] & 0x0F) << 8);
+    *Y = (In[1] >> 4) | (In[2] << 4);
+}
+
+// NOTE(nox): Bitmap is the part of the frame after the PointCount packed points
+static inline void setHighResBlank(u8 *Bitmap, u32 Idx, bool Blank) {
+    Bitmap[Idx/8] = (Bitmap[Idx/8] & ~(1 << (Idx & 7))) | ((Blank ? 1 : 0) << (Idx & 7));
+}
+
+static inline bool isHighResBlank(const u8 *Bitmap, u32 Idx) {
+    return (Bitmap[Idx/8] >> (Idx & 7)) & 1;
+}
+
+// NOTE(nox): Keyframe tweening. A frame update may end with a u16 Count and a u8 easing after its points,
+// which older firmwares ignore as they only read PointCount points. Once such a frame has been shown
+// RepeatCount times, the device draws Count more frames, one per refresh, that move each of its points
+// towards the same point of the next frame, so smooth motion costs two keyframes instead of every frame of
+// it. This only happens when both have the same number of points, grid and high resolution frames can be
+// mixed. The tween is only sent when Count > 0 and is hashed with the points, so frames without one hash
+// like before.
+enum {
+    TweenSize = 2+1,
+    TweenOne = 1<<15, // NOTE(nox): Progress is Q15
+};
+
+typedef enum : u8 {
+    Ease_Linear,
+    Ease_In,
+    Ease_Out,
+    Ease_InOut,
+    EaseCount
+} easing;
+
+// NOTE(nox): Step goes from 1 to Count, 0 and Count+1 are the keyframes themselves
+static inline u32 tweenProgress(u32 Step, u32 Count, u8 Easing) {
+    u32 T = Step*TweenOne / (Count + 1);
+    switch(Easing) {
+        case Ease_In:    return T*T / TweenOne;
+        case Ease_Out:   return TweenOne - (TweenOne - T)*(TweenOne - T) / TweenOne;
+        case Ease_InOut: return (T*T / TweenOne) * (3*TweenOne - 2*T) / TweenOne;
+        default:         return T;
+    }
+}
+
+static inline u16 tweenCoord(u16 From, u16 To, u32 Progress) {
+    return From + ((s32)To - (s32)From)*(s32)Progress / TweenOne;
+}
+
 typedef enum : u8 {
     Command_InfoLedOn,
     Command_InfoLedOff,
@@ -53,9 +134,41 @@ typedef enum : u8 {
     Command_UpdateFrameCount,
     Command_SetTo0,
     Command_DontSetTo0,
+    Command_QueryFrameHashes,
+    Command_FrameHashes, // NOTE(nox): Device -> host, answer to Command_QueryFrameHashes
+    Command_Ping,
+    Command_Echo, // NOTE(nox): Device -> host, answer to Command_Ping
+    Command_DrawText,
+    Command_Scene,
+    Command_SceneStatus, // NOTE(nox): Device -> host, answer to Command_Scene
+    Command_Curve,
+    Command_UpdateFrameHighRes,
+    Command_SetIntensity, // NOTE(nox): u16 level of the analog Z output, [0, HighResMax]
+    Command_UploadSlot,
+    Command_SelectSlot,
+    Command_SetPlaylist,
+    Command_QueryPlaylist,
+    Command_PlaylistStatus, // NOTE(nox): Device -> host, answer to Command_QueryPlaylist
     CommandCount
 } command;
 
+// NOTE(nox): FNV-1a, used to compare frame slots without reading them back. The hash of a frame slot is
+// the hash of an UpdateFrame payload after the frame index, i.e. Fps, RepeatCount, PointCount (all u16)
+// and the points, which is also exactly what the device stores. High resolution frames start from the
+// hash of their format byte, so they never match a grid frame with the same bytes.
+static const u32 HashSeed = 2166136261u;
+
+static inline u32 hashBytes(u32 Hash, const u8 *Data, u32 Size) {
+    for(u32 I = 0; I < Size; ++I) {
+        Hash = (Hash ^ Data[I]) * 16777619u;
+    }
+    return Hash;
+}
+
+static inline u32 frameHashSeed(u8 Format) {
+    return Format == FrameFormat_HighRes ? hashBytes(HashSeed, &Format, 1) : HashSeed;
+}
+
 
 // ------------------------------------------------------------------------------------------
 // NOTE(nox): Pong related
@@ -73,9 +186,221 @@ typedef enum : u8 {
     PongCmd_InfoLedOff,
     PongCmd_Update,
     PongCmd_SetScore,
+    PongCmd_Input,     // NOTE(nox): Keys for the game running on the device
+    PongCmd_Reset,     // NOTE(nox): Starts (over) the game on the device, until the next PongCmd_Update
+    PongCmd_Telemetry, // NOTE(nox): Device -> host, when the game on the device changes state
+
+    // NOTE(nox): Same as in command, so the latency probe works with every firmware
+    PongCmd_Ping = Command_Ping,
+    PongCmd_Echo = Command_Echo,
+    PongCmd_DrawText = Command_DrawText,
     PongCommandCount
 } pong_command;
 
+enum {
+    PongInput_LeftUp    = 1<<0,
+    PongInput_LeftDown  = 1<<1,
+    PongInput_RightUp   = 1<<2,
+    PongInput_RightDown = 1<<3,
+};
+
+enum {
+    PongEvent_Reset = 1<<0,
+    PongEvent_Score = 1<<1,
+};
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Names
+static const char *const CommandNames[] = {
+    "InfoLedOn",
+    "InfoLedOff",
+    "PowerOn",
+    "PowerOff",
+    "Select0",
+    "Select1",
+    "UpdateFrame",
+    "UpdateFrameCount",
+    "SetTo0",
+    "DontSetTo0",
+    "QueryFrameHashes",
+    "FrameHashes",
+    "Ping",
+    "Echo",
+    "DrawText",
+    "Scene",
+    "SceneStatus",
+    "Curve",
+    "UpdateFrameHighRes",
+    "SetIntensity",
+    "UploadSlot",
+    "SelectSlot",
+    "SetPlaylist",
+    "QueryPlaylist",
+    "PlaylistStatus",
+};
+static_assert(arrayCount(CommandNames) == CommandCount, "A command has no name");
+
+// NOTE(nox): For the tools that print packets. The pong commands have a gap before the ones shared with
+// command.
+static const char *pongCommandName(u8 Command) {
+    switch(Command) {
+        case PongCmd_InfoLedOn:  return "InfoLedOn";
+        case PongCmd_InfoLedOff: return "InfoLedOff";
+        case PongCmd_Update:     return "Update";
+        case PongCmd_SetScore:   return "SetScore";
+        case PongCmd_Input:      return "Input";
+        case PongCmd_Reset:      return "Reset";
+        case PongCmd_Telemetry:  return "Telemetry";
+        case PongCmd_Ping:       return "Ping";
+        case PongCmd_Echo:       return "Echo";
+        case PongCmd_DrawText:   return "DrawText";
+    }
+    return 0;
+}
+
+static const char *commandName(u8 Command, bool PongCommands) {
+    if(PongCommands) {
+        return pongCommandName(Command);
+    }
+    return Command < CommandCount ? CommandNames[Command] : 0;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Latency probe
+//
+// The host sends a ping with its own time and the device echoes it back with its own timestamps, so the
+// host gets the round trip without keeping track of what it sent. Device times are in us from micros(),
+// only differences between them mean something.
+enum {
+    DeviceState_Drawing = 1<<0,
+    DeviceState_Simulating = 1<<1,
+};
+
+typedef struct {
+    u32 Seq;
+    u32 HostTimeUs;    // NOTE(nox): As sent in the ping
+    u32 DeviceRxUs;    // NOTE(nox): When the ping was decoded
+    u32 DeviceTxUs;    // NOTE(nox): When the echo started going out
+    u32 SinceFrameUs;  // NOTE(nox): Time since the current frame started drawing, at DeviceRxUs
+    u32 FramePeriodUs;
+    u8 State;          // NOTE(nox): DeviceState_* flags
+} echo_info;
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Text, drawn by the device with the font in glyphs.hpp
+enum {
+    MaxTextLength = 8, // NOTE(nox): At scale 1 it always fits in the text point budget, see glyphs.hpp
+    MaxTextSlots = 4,
+    MaxTextScale = 8,
+};
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Scene, a display list drawn by the ScenePlayer firmware (see scene.hpp)
+//
+// Each Command_Scene replaces the whole picture. After a u8 Seq, the u8 refresh rate the host wants (which
+// sets how many points fit in a frame) and u8 SceneFlag_* flags comes a list of primitives, each starting
+// with a byte that has its ScenePrim_* type in the low bits and SceneBlank in the top one. With SceneBlank
+// the beam is off while it jumps to the first point of the primitive.
+enum {
+    ScenePrim_Points,   // NOTE(nox): u8 Count, Count*(u8 X, u8 Y)
+    ScenePrim_Polyline, // NOTE(nox): Same as points, with straight lines between them
+    ScenePrim_Polygon,  // NOTE(nox): Same as polyline, closed
+    ScenePrim_Circle,   // NOTE(nox): u8 X, u8 Y, u8 Radius
+    ScenePrim_Text,     // NOTE(nox): u8 Slot, with the text set by Command_DrawText
+    ScenePrimCount,
+    ScenePrimMask = 0x7F,
+    SceneBlank = 0x80,
+
+    SceneFlag_Status = 1<<0, // NOTE(nox): Always answer with Command_SceneStatus, not only on problems
+
+    SceneStatus_OverBudget    = 1<<0, // NOTE(nox): Points were dropped to keep the refresh rate
+    SceneStatus_Malformed     = 1<<1, // NOTE(nox): Drawn up to the first primitive that made no sense
+    SceneStatus_TextTruncated = 1<<2, // NOTE(nox): A text slot in the scene could not hold all its text
+
+    MaxScenePoints = MaxActive,
+    ScenePointTimeUs = 111, // NOTE(nox): MaxActive points at MinFps
+};
+
+typedef struct {
+    u8 Seq;
+    u8 Status; // NOTE(nox): SceneStatus_* flags
+    u16 PointCount;
+    u16 Budget;
+} scene_status;
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Curves, generated on the device by the Curves firmware (see Dds.h)
+//
+// Both axes are sines with their own frequency, so a curve is a handful of bytes instead of thousands of
+// points. Coordinates are in DAC steps, the full 12 bits.
+enum {
+    Curve_Lissajous, // NOTE(nox): X = sin(2 pi FreqX t + Phase), Y = sin(2 pi FreqY t)
+    Curve_Rose,      // NOTE(nox): R = cos(2 pi FreqX t + Phase) at angle 2 pi FreqY t, k = FreqX/FreqY
+    CurveCount,
+
+    CurveDacMax = 4095,
+    CurveMinPointRate = 1000,
+    CurveMaxPointRate = 9000, // NOTE(nox): A point takes a bit over 100us on the I2C bus
+    CurveDefaultPointRate = 8000,
+};
+
+typedef struct {
+    u8 Type;       // NOTE(nox): Curve_*
+    u16 PointRate; // NOTE(nox): Points per second
+    u32 FreqX;     // NOTE(nox): In mHz
+    u32 FreqY;
+    u16 Phase;     // NOTE(nox): Of X, in 1/65536 of a turn
+    u16 AmpX;
+    u16 AmpY;
+    u16 CenterX;
+    u16 CenterY;
+} curve_params;
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Animation slots and playlists
+//
+// The device holds AnimSlotCount animations. Select0/Select1 (SelectSlot, with a u8 slot, for any of them)
+// make one play and receive the uploads, while UploadSlot (u8 slot) only changes where the uploads go, so
+// the next piece can be loaded while another one plays.
+//
+// SetPlaylist (u8 entry count and the entries) makes the device go through the slots on its own. Each
+// entry plays its slot Loops times, or until the playlist changes if Loops is 0, and is entered with a cut
+// or, with Transition_Tween, through the tween of the last frame before it (see tweenProgress). A new
+// playlist starts at its first entry when the current pass through the playing slot ends, so the picture
+// never stops, and an empty one keeps playing the current slot. Selecting a slot drops the playlist.
+// QueryPlaylist is answered with PlaylistStatus.
+enum {
+    AnimSlotCount = 2, // NOTE(nox): A slot takes 6KB of the 32KB of RAM of the uC32
+    MaxPlaylistEntries = 16,
+};
+
+typedef enum : u8 {
+    Transition_Cut,
+    Transition_Tween,
+    TransitionCount
+} transition;
+
+typedef struct {
+    u8 Slot;
+    u8 Transition; // NOTE(nox): Into this entry
+    u16 Loops;
+} playlist_entry;
+
+typedef struct {
+    u8 PlayingSlot;
+    u8 UploadSlot;
+    u8 Entry;      // NOTE(nox): Of the playlist, meaningless without entries
+    u8 EntryCount;
+    u16 PassesDone; // NOTE(nox): Through the slot of the current entry
+    bool Pending;   // NOTE(nox): The playlist starts when the current pass ends, Entry and PassesDone are 0
+} playlist_status;
+
 
 // ------------------------------------------------------------------------------------------
 // NOTE(nox): Common to RX/TX
@@ -86,7 +411,10 @@ typedef struct {
     u8 Data[MaxPacketSize];
 } buff;
 
-static inline void resetBuff(buff *Buff) {
+// NOTE(nox): resetBuff, the write primitives and the writers of the device's answers take any struct with
+// Read, Write and Data, so a firmware can build its answers in one much smaller than a buff
+template<typename buff_type>
+static inline void resetBuff(buff_type *Buff) {
     Buff->Read  = 0;
     Buff->Write = 0;
 }
@@ -152,29 +480,47 @@ static inline u16 readU16NoAdv(buff *Buff, u32 Offset = 0) {
 
 // ------------------------------------------------------------------------------------------
 // NOTE(nox): TX related
-static void writeU8(buff *Buff, u8 Value) {
+template<typename buff_type>
+static void writeU8(buff_type *Buff, u8 Value) {
     assert(Buff->Write + sizeof(Value) <= arrayCount(Buff->Data));
     *((u8 *)(Buff->Data + Buff->Write)) = Value;
     Buff->Write += sizeof(Value);
 }
 
-static void writeU16(buff *Buff, u16 Value) {
+// NOTE(nox): Byte by byte like the readers, the PIC32 traps on unaligned halfword and word stores and the
+// fields sit at any offset
+template<typename buff_type>
+static void writeU16(buff_type *Buff, u16 Value) {
     assert(Buff->Write + sizeof(Value) <= arrayCount(Buff->Data));
-    *((u16 *)(Buff->Data + Buff->Write)) = Value;
+    Buff->Data[Buff->Write+0] = (u8)(Value >> 0);
+    Buff->Data[Buff->Write+1] = (u8)(Value >> 8);
     Buff->Write += sizeof(Value);
 }
 
-static void writeU32(buff *Buff, u32 Value) {
+template<typename buff_type>
+static void writeU32(buff_type *Buff, u32 Value) {
     assert(Buff->Write + sizeof(Value) <= arrayCount(Buff->Data));
-    *((u32 *)(Buff->Data + Buff->Write)) = Value;
+    Buff->Data[Buff->Write+0] = (u8)(Value >>  0);
+    Buff->Data[Buff->Write+1] = (u8)(Value >>  8);
+    Buff->Data[Buff->Write+2] = (u8)(Value >> 16);
+    Buff->Data[Buff->Write+3] = (u8)(Value >> 24);
     Buff->Write += sizeof(Value);
 }
 
-static void writeHeader(buff *Buff, command Command) {
+template<typename buff_type>
+static void writeHeader(buff_type *Buff, command Command) {
     writeU8(Buff, (MagicNumber | Command));
     writeU16(Buff, 0); // NOTE(nox): Placeholder for length
 }
 
+// NOTE(nox): Fills the placeholder of writeHeader, once everything is written
+template<typename buff_type>
+static inline void writePacketLength(buff_type *Buff) {
+    u16 Length = Buff->Write-3;
+    Buff->Data[1] = (u8)(Length >> 0);
+    Buff->Data[2] = (u8)(Length >> 8);
+}
+
 static void writeInfoLedOn(buff *Buff) {
     writeHeader(Buff, Command_InfoLedOn);
 }
@@ -205,6 +551,224 @@ static void writeUpdateFrameCount(buff *Buff, u8 NewFrameCount) {
     writeU8(Buff, NewFrameCount);
 }
 
+static void writeQueryFrameHashes(buff *Buff, u8 Anim) {
+    writeHeader(Buff, Command_QueryFrameHashes);
+    writeU8(Buff, Anim);
+}
+
+static void writeSetIntensity(buff *Buff, u16 Level) {
+    writeHeader(Buff, Command_SetIntensity);
+    writeU16(Buff, Level);
+}
+
+// NOTE(nox): Hashes has MaxFrames entries, slots past FrameCount included
+static void writeFrameHashes(buff *Buff, u8 Anim, u8 FrameCount, u32 *Hashes) {
+    writeHeader(Buff, Command_FrameHashes);
+    writeU8(Buff, Anim);
+    writeU8(Buff, FrameCount);
+    for(u32 I = 0; I < MaxFrames; ++I) {
+        writeU32(Buff, Hashes[I]);
+    }
+}
+
+static void writePing(buff *Buff, u32 Seq, u32 HostTimeUs) {
+    writeHeader(Buff, Command_Ping);
+    writeU32(Buff, Seq);
+    writeU32(Buff, HostTimeUs);
+}
+
+template<typename buff_type>
+static void writeEcho(buff_type *Buff, echo_info *Echo) {
+    writeHeader(Buff, Command_Echo);
+    writeU32(Buff, Echo->Seq);
+    writeU32(Buff, Echo->HostTimeUs);
+    writeU32(Buff, Echo->DeviceRxUs);
+    writeU32(Buff, Echo->DeviceTxUs);
+    writeU32(Buff, Echo->SinceFrameUs);
+    writeU32(Buff, Echo->FramePeriodUs);
+    writeU8(Buff, Echo->State);
+}
+
+static bool readEcho(buff *Buff, u16 Length, echo_info *Echo) {
+    if(Length < 6*4+1) {
+        return false;
+    }
+    Echo->Seq = readU32(Buff);
+    Echo->HostTimeUs = readU32(Buff);
+    Echo->DeviceRxUs = readU32(Buff);
+    Echo->DeviceTxUs = readU32(Buff);
+    Echo->SinceFrameUs = readU32(Buff);
+    Echo->FramePeriodUs = readU32(Buff);
+    Echo->State = readU8(Buff);
+    return true;
+}
+
+// NOTE(nox): Shows Text in one of the device's text slots, with the bottom left corner of the first glyph at
+// (X, Y) in grid cells and every glyph cell Scale cells big. See glyphs.hpp.
+static void writeDrawText(buff *Buff, u8 Slot, u8 X, u8 Y, u8 Scale, const char *Text) {
+    u32 Length = min((u64)strlen(Text), (u64)MaxTextLength);
+    writeHeader(Buff, Command_DrawText);
+    writeU8(Buff, Slot);
+    writeU8(Buff, X);
+    writeU8(Buff, Y);
+    writeU8(Buff, Scale);
+    writeU8(Buff, Length);
+    for(u32 I = 0; I < Length; ++I) {
+        writeU8(Buff, Text[I]);
+    }
+}
+
+static void writeScene(buff *Buff, u8 Seq, u8 Fps, u8 Flags) {
+    writeHeader(Buff, Command_Scene);
+    writeU8(Buff, Seq);
+    writeU8(Buff, Fps);
+    writeU8(Buff, Flags);
+}
+
+// NOTE(nox): Points has Count X, Y pairs
+static void writeScenePoints(buff *Buff, u8 Type, bool Blank, const u8 *Points, u8 Count) {
+    writeU8(Buff, Type | (Blank ? SceneBlank : 0));
+    writeU8(Buff, Count);
+    for(u32 I = 0; I < 2*Count; ++I) {
+        writeU8(Buff, Points[I]);
+    }
+}
+
+static void writeSceneCircle(buff *Buff, bool Blank, u8 X, u8 Y, u8 Radius) {
+    writeU8(Buff, ScenePrim_Circle | (Blank ? SceneBlank : 0));
+    writeU8(Buff, X);
+    writeU8(Buff, Y);
+    writeU8(Buff, Radius);
+}
+
+static void writeSceneText(buff *Buff, bool Blank, u8 Slot) {
+    writeU8(Buff, ScenePrim_Text | (Blank ? SceneBlank : 0));
+    writeU8(Buff, Slot);
+}
+
+static void writeSceneStatus(buff *Buff, scene_status *Status) {
+    writeHeader(Buff, Command_SceneStatus);
+    writeU8(Buff, Status->Seq);
+    writeU8(Buff, Status->Status);
+    writeU16(Buff, Status->PointCount);
+    writeU16(Buff, Status->Budget);
+}
+
+static bool readSceneStatus(buff *Buff, u16 Length, scene_status *Status) {
+    if(Length < 1+1+2+2) {
+        return false;
+    }
+    Status->Seq = readU8(Buff);
+    Status->Status = readU8(Buff);
+    Status->PointCount = readU16(Buff);
+    Status->Budget = readU16(Buff);
+    return true;
+}
+
+static void writeCurve(buff *Buff, curve_params *Curve) {
+    writeHeader(Buff, Command_Curve);
+    writeU8(Buff, Curve->Type);
+    writeU16(Buff, Curve->PointRate);
+    writeU32(Buff, Curve->FreqX);
+    writeU32(Buff, Curve->FreqY);
+    writeU16(Buff, Curve->Phase);
+    writeU16(Buff, Curve->AmpX);
+    writeU16(Buff, Curve->AmpY);
+    writeU16(Buff, Curve->CenterX);
+    writeU16(Buff, Curve->CenterY);
+}
+
+static bool readCurve(buff *Buff, u16 Length, curve_params *Curve) {
+    if(Length < 1+2+4+4+2+4*2) {
+        return false;
+    }
+    Curve->Type = readU8(Buff);
+    Curve->PointRate = readU16(Buff);
+    Curve->FreqX = readU32(Buff);
+    Curve->FreqY = readU32(Buff);
+    Curve->Phase = readU16(Buff);
+    Curve->AmpX = readU16(Buff);
+    Curve->AmpY = readU16(Buff);
+    Curve->CenterX = readU16(Buff);
+    Curve->CenterY = readU16(Buff);
+    return true;
+}
+
+static void writeUploadSlot(buff *Buff, u8 Slot) {
+    writeHeader(Buff, Command_UploadSlot);
+    writeU8(Buff, Slot);
+}
+
+// NOTE(nox): The first two slots go with the old commands, which every firmware knows
+static void writeSelectSlot(buff *Buff, u8 Slot) {
+    if(Slot < 2) {
+        writeSelectAnim(Buff, Slot);
+        return;
+    }
+    writeHeader(Buff, Command_SelectSlot);
+    writeU8(Buff, Slot);
+}
+
+static void writeSetPlaylist(buff *Buff, playlist_entry *Entries, u8 Count) {
+    writeHeader(Buff, Command_SetPlaylist);
+    writeU8(Buff, Count);
+    for(u32 I = 0; I < Count; ++I) {
+        writeU8(Buff, Entries[I].Slot);
+        writeU8(Buff, Entries[I].Transition);
+        writeU16(Buff, Entries[I].Loops);
+    }
+}
+
+// NOTE(nox): Entries has MaxPlaylistEntries entries. Slots past SlotCount and unknown transitions make the
+// whole playlist invalid.
+static bool readPlaylist(buff *Buff, u16 Length, u32 SlotCount, playlist_entry *Entries, u32 *Count) {
+    if(Length < 1) {
+        return false;
+    }
+    u8 EntryCount = readU8(Buff);
+    if(EntryCount > MaxPlaylistEntries || Length - 1 < EntryCount*(1+1+2)) {
+        return false;
+    }
+
+    for(u32 I = 0; I < EntryCount; ++I) {
+        Entries[I].Slot = readU8(Buff);
+        Entries[I].Transition = readU8(Buff);
+        Entries[I].Loops = readU16(Buff);
+        if(Entries[I].Slot >= SlotCount || Entries[I].Transition >= TransitionCount) {
+            return false;
+        }
+    }
+    *Count = EntryCount;
+    return true;
+}
+
+static void writeQueryPlaylist(buff *Buff) {
+    writeHeader(Buff, Command_QueryPlaylist);
+}
+
+static void writePlaylistStatus(buff *Buff, playlist_status *Status) {
+    writeHeader(Buff, Command_PlaylistStatus);
+    writeU8(Buff, Status->PlayingSlot);
+    writeU8(Buff, Status->UploadSlot);
+    writeU8(Buff, Status->Entry);
+    writeU8(Buff, Status->EntryCount);
+    writeU16(Buff, Status->PassesDone);
+    writeU8(Buff, Status->Pending);
+}
+
+static bool readPlaylistStatus(buff *Buff, u16 Length, playlist_status *Status) {
+    if(Length < 1+1+1+1+2+1) {
+        return false;
+    }
+    Status->PlayingSlot = readU8(Buff);
+    Status->UploadSlot = readU8(Buff);
+    Status->Entry = readU8(Buff);
+    Status->EntryCount = readU8(Buff);
+    Status->PassesDone = readU16(Buff);
+    Status->Pending = readU8(Buff);
+    return true;
+}
+
 static void writeSetTo0(buff *Buff) {
     writeHeader(Buff, Command_SetTo0);
 }
@@ -213,12 +777,23 @@ static void writeDontSetTo0(buff *Buff) {
     writeHeader(Buff, Command_DontSetTo0);
 }
 
-static void writePongUpdate(buff *Buff, u8 LeftPaddleCenter, u8 RightPaddleCenter, r32 BallX, r32 BallY) {
+// NOTE(nox): Ball positions go in the 8-bit high-res units, [0, 63] scaled to [0, 255]. Velocities are in
+// grid units per ms and go as 8.8 fixed point high-res units per ms, so the device can move the ball
+// between updates. Seq only has to increase by one for every update sent, so the device can drop updates
+// that arrive out of order.
+static const r32 PongHighResScale = 4.04761904762f;
+
+static void writePongUpdate(buff *Buff, u8 LeftPaddleCenter, u8 RightPaddleCenter, r32 BallX, r32 BallY,
+                            r32 BallVelX, r32 BallVelY, u8 Seq)
+{
     writeHeader(Buff, (command)PongCmd_Update);
     writeU8(Buff, LeftPaddleCenter);
     writeU8(Buff, RightPaddleCenter);
-    writeU8(Buff, round(BallX*4.04761904762f));
-    writeU8(Buff, round(BallY*4.04761904762f));
+    writeU8(Buff, round(BallX*PongHighResScale));
+    writeU8(Buff, round(BallY*PongHighResScale));
+    writeU16(Buff, (s16)round(BallVelX*PongHighResScale*256));
+    writeU16(Buff, (s16)round(BallVelY*PongHighResScale*256));
+    writeU8(Buff, Seq);
 }
 
 static void writePongScore(buff *Buff, u8 LeftScore, u8 RightScore) {
@@ -227,6 +802,25 @@ static void writePongScore(buff *Buff, u8 LeftScore, u8 RightScore) {
     writeU8(Buff, RightScore);
 }
 
+static void writePongInput(buff *Buff, u8 Keys) {
+    writeHeader(Buff, (command)PongCmd_Input);
+    writeU8(Buff, Keys);
+}
+
+static void writePongReset(buff *Buff, u32 Seed) {
+    writeHeader(Buff, (command)PongCmd_Reset);
+    writeU32(Buff, Seed);
+}
+
+template<typename buff_type>
+static void writePongTelemetry(buff_type *Buff, u8 Events, u8 LeftScore, u8 RightScore, u32 Tick) {
+    writeHeader(Buff, (command)PongCmd_Telemetry);
+    writeU8(Buff, Events);
+    writeU8(Buff, LeftScore);
+    writeU8(Buff, RightScore);
+    writeU32(Buff, Tick);
+}
+
 static void stuffBytes(buff *Orig, buff *Dest) {
     Dest->Write = 0;
 
@@ -252,9 +846,47 @@ static void stuffBytes(buff *Orig, buff *Dest) {
     *CodeLocation = Code;
 }
 
+// NOTE(nox): Inverse of stuffBytes, for a packet whose leading delimiter was already stripped. As in the
+// firmware's decodeRx, every complete group is decoded with its zero, even the last one we have, because
+// only the length in the header can tell if the packet is complete; see readPacketHeader.
+static void unstuffBytes(buff *Orig, buff *Dest) {
+    resetBuff(Dest);
+
+    for(u32 Read = 0; Read < Orig->Write;) {
+        u8 Code = Orig->Data[Read];
+        if(Code == 0 || Read + Code > Orig->Write) {
+            break;
+        }
+
+        ++Read;
+        for(u8 I = 1; I < Code; ++I) {
+            assert(Dest->Write + 1 <= arrayCount(Dest->Data));
+            Dest->Data[Dest->Write++] = Orig->Data[Read++];
+        }
+        if(Code != 0xFF && Dest->Write < arrayCount(Dest->Data)) {
+            Dest->Data[Dest->Write++] = 0;
+        }
+    }
+}
+
+// NOTE(nox): When Pkt holds a complete packet, skips its header and returns true
+static bool readPacketHeader(buff *Pkt, u8 *Command, u16 *Length) {
+    if(!hasAvailable(Pkt, 1+2) || (readU8NoAdv(Pkt) & MagicMask) != MagicNumber) {
+        return false;
+    }
+
+    *Command = readU8NoAdv(Pkt) & CommandMask;
+    *Length = readU16NoAdv(Pkt, 1);
+    if(!hasAvailable(Pkt, 1+2 + *Length)) {
+        return false;
+    }
+
+    Pkt->Read += 1+2;
+    return true;
+}
+
 static inline void finalizePacket(buff *Buff, buff *Dest) {
-    // NOTE(nox): Update packet length
-    *((u16 *)(Buff->Data + 1)) = Buff->Write-3;
+    writePacketLength(Buff);
     stuffBytes(Buff, Dest);
 }
 
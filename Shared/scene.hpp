@@ -0,0 +1,183 @@
+#if !defined(SCENE_HPP)
+#define SCENE_HPP
+
+// NOTE(nox): Turns a Command_Scene display list into the points the ScenePlayer firmware draws. Lines are
+// walked cell by cell and circles are stepped around with the Minsky circle algorithm, which needs no trig
+// and always comes back to where it started. Everything stops at the point budget of the requested refresh
+// rate, so a scene that is too big keeps its rate and loses its last points instead. Needs protocol.hpp
+// and glyphs.hpp.
+
+enum {
+    MaxSceneFps = 120,
+};
+
+typedef struct {
+    u32 Count;
+    u32 Budget;
+    u8 Fps;
+    u8 Status; // NOTE(nox): SceneStatus_* flags
+    text_point Points[MaxScenePoints]; // NOTE(nox): X may have ZDisableBit, like the animation points
+} scene_points;
+
+static inline u8 sceneFps(u8 Fps) {
+    return clamp((u8)MinFps, Fps, (u8)MaxSceneFps);
+}
+
+static inline u32 sceneBudget(u8 Fps) {
+    Fps = sceneFps(Fps);
+    return min(1000000 / (Fps*ScenePointTimeUs), (s32)MaxScenePoints);
+}
+
+// NOTE(nox): Points outside of the grid are dropped, and the one after them is blanked
+static bool pushScenePoint(scene_points *Scene, s32 X, s32 Y, bool *Blank) {
+    if(X < 0 || X >= GridSize || Y < 0 || Y >= GridSize) {
+        *Blank = true;
+        return true;
+    }
+
+    if(Scene->Count >= Scene->Budget) {
+        Scene->Status |= SceneStatus_OverBudget;
+        return false;
+    }
+
+    if(Scene->Count && !*Blank) {
+        text_point *Last = Scene->Points + Scene->Count - 1;
+        if((Last->X & ~ZDisableBit) == X && Last->Y == Y) {
+            return true;
+        }
+    }
+
+    text_point *Point = Scene->Points + Scene->Count++;
+    Point->X = X | (*Blank ? ZDisableBit : 0);
+    Point->Y = Y;
+    *Blank = false;
+    return true;
+}
+
+// NOTE(nox): Bresenham, without the first point, which the previous segment already has
+static bool sceneLine(scene_points *Scene, s32 X0, s32 Y0, s32 X1, s32 Y1, bool *Blank) {
+    s32 DX = abs(X1 - X0), SX = X0 < X1 ? 1 : -1;
+    s32 DY = -abs(Y1 - Y0), SY = Y0 < Y1 ? 1 : -1;
+    s32 Error = DX + DY;
+    while(X0 != X1 || Y0 != Y1) {
+        s32 Error2 = 2*Error;
+        if(Error2 >= DY) {
+            Error += DY;
+            X0 += SX;
+        }
+        if(Error2 <= DX) {
+            Error += DX;
+            Y0 += SY;
+        }
+        if(!pushScenePoint(Scene, X0, Y0, Blank)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// NOTE(nox): About one point every two cells of circumference, the beam draws the line between them. In
+// 16.16.
+static bool sceneCircle(scene_points *Scene, s32 CX, s32 CY, s32 Radius, bool *Blank) {
+    enum { TwoPi = 411775 };
+    s32 Steps = max((Radius*201) >> 6, 8); // NOTE(nox): 201/64 ~ pi
+    s32 Epsilon = TwoPi / Steps;
+    s32 X = Radius << 16, Y = 0;
+    for(s32 I = 0; I <= Steps; ++I) {
+        if(!pushScenePoint(Scene, CX + ((X + (1<<15)) >> 16), CY + ((Y + (1<<15)) >> 16), Blank)) {
+            return false;
+        }
+        X -= (s32)(((int64_t)Epsilon*Y) >> 16);
+        Y += (s32)(((int64_t)Epsilon*X) >> 16);
+    }
+    return true;
+}
+
+// NOTE(nox): Pkt is past the packet header, Length is the payload size
+static void renderScene(buff *Pkt, u16 Length, text_slot *TextSlots, scene_points *Scene, u8 *Seq, u8 *Flags) {
+    enum { SceneHeaderSize = 3 };
+    Scene->Count = 0;
+    Scene->Status = 0;
+    Scene->Budget = 0;
+    if(Length < SceneHeaderSize) {
+        Scene->Status |= SceneStatus_Malformed;
+        return;
+    }
+
+    u32 End = Pkt->Read + Length;
+    *Seq = readU8(Pkt);
+    Scene->Fps = sceneFps(readU8(Pkt));
+    Scene->Budget = sceneBudget(Scene->Fps);
+    *Flags = readU8(Pkt);
+
+    bool Fits = true;
+    while(Fits && Pkt->Read < End) {
+        u8 Header = readU8(Pkt);
+        u8 Type = Header & ScenePrimMask;
+        bool Blank = Header & SceneBlank;
+        u32 Left = End - Pkt->Read;
+
+        switch(Type) {
+            case ScenePrim_Points:
+            case ScenePrim_Polyline:
+            case ScenePrim_Polygon: {
+                u8 Count = Left >= 1 ? readU8(Pkt) : 0;
+                if(Count == 0 || Left - 1 < 2u*Count) {
+                    Scene->Status |= SceneStatus_Malformed;
+                    return;
+                }
+
+                u8 *Points = Pkt->Data + Pkt->Read;
+                Pkt->Read += 2*Count;
+                Fits = pushScenePoint(Scene, Points[0], Points[1], &Blank);
+                for(u32 I = 1; Fits && I < Count; ++I) {
+                    s32 X = Points[2*I], Y = Points[2*I + 1];
+                    if(Type == ScenePrim_Points) {
+                        Fits = pushScenePoint(Scene, X, Y, &Blank);
+                    }
+                    else {
+                        Fits = sceneLine(Scene, Points[2*I - 2], Points[2*I - 1], X, Y, &Blank);
+                    }
+                }
+                if(Fits && Type == ScenePrim_Polygon) {
+                    Fits = sceneLine(Scene, Points[2*Count - 2], Points[2*Count - 1], Points[0], Points[1], &Blank);
+                }
+            } break;
+
+            case ScenePrim_Circle: {
+                if(Left < 3) {
+                    Scene->Status |= SceneStatus_Malformed;
+                    return;
+                }
+                u8 X = readU8(Pkt);
+                u8 Y = readU8(Pkt);
+                u8 Radius = readU8(Pkt);
+                Fits = sceneCircle(Scene, X, Y, Radius, &Blank);
+            } break;
+
+            case ScenePrim_Text: {
+                u8 Slot = Left >= 1 ? readU8(Pkt) : (u8)MaxTextSlots;
+                if(Slot >= MaxTextSlots) {
+                    Scene->Status |= SceneStatus_Malformed;
+                    return;
+                }
+                text_slot *Text = TextSlots + Slot;
+                for(u32 I = 0; Fits && I < Text->Count; ++I) {
+                    text_point *Point = Text->Points + I;
+                    Blank = Blank || (Point->X & ZDisableBit);
+                    Fits = pushScenePoint(Scene, Point->X & ~ZDisableBit, Point->Y, &Blank);
+                }
+                if(Text->Truncated) {
+                    Scene->Status |= SceneStatus_TextTruncated;
+                }
+            } break;
+
+            default: {
+                Scene->Status |= SceneStatus_Malformed;
+                return;
+            } break;
+        }
+    }
+}
+
+#endif // SCENE_HPP
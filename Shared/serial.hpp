@@ -0,0 +1,190 @@
+#if !defined(SERIAL_HPP)
+#define SERIAL_HPP
+
+// NOTE(nox): Host side of the serial link, shared by the host applications (include protocol.hpp and
+// trace.hpp first)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+// NOTE(nox): The board shows up as DefaultSerialDevice. Another one (e.g. the pty of VirtualDevice) is chosen
+// with --device <path> on the command line or with the OSCILLOSCOPE_DEVICE environment variable.
+static const char *DefaultSerialDevice = "/dev/ttyUSB0";
+
+static const char *serialDevicePath(int ArgCount, char **Args) {
+    for(int I = 1; I+1 < ArgCount; ++I) {
+        if(strcmp(Args[I], "--device") == 0) {
+            return Args[I+1];
+        }
+    }
+
+    const char *Env = getenv("OSCILLOSCOPE_DEVICE");
+    return (Env && Env[0]) ? Env : DefaultSerialDevice;
+}
+
+static int serialConnect(const char *Path) {
+    int Tty = open(Path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if(!isatty(Tty)) {
+        goto connectionError;
+    }
+
+    termios Config;
+    if(tcgetattr(Tty, &Config) < 0) {
+        goto connectionError;
+    }
+
+
+    Config.c_iflag &= ~(INPCK); // NOTE(nox): Disable input parity check
+    Config.c_iflag &= ~(IXON | IXOFF | IXANY); // NOTE(nox): Disable software flow control
+    Config.c_iflag &= ~(IGNBRK | BRKINT | ISTRIP | INLCR | IGNCR | ICRNL); // NOTE(nox): Disable any special handling of received bytes
+
+    Config.c_oflag  = ~(OPOST | ONLCR); // NOTE(nox): Disable output processing
+
+    Config.c_cflag &= ~(PARENB | CRTSCTS);  // NOTE(nox): Disable parity generation and RTS/CTS flow control
+    Config.c_cflag &= ~CSTOPB; // NOTE(nox): Only 1 stop bit
+    Config.c_cflag &= ~CSIZE;
+    Config.c_cflag |=  CS8; // NOTE(nos): Set 8 bits as communication unit
+    Config.c_cflag |=  (CREAD | CLOCAL); // NOTE(nox): Enable receiver and ignore modem lines
+
+    Config.c_lflag &= ~(ICANON | ECHO | ISIG); // NOTE(nox): Disable canonical mode, echos and don't generate signals
+
+    // NOTE(nox): Non blocking, return immediately what is available (ignored due to O_NONBLOCK)
+    Config.c_cc[VMIN]  = 0;
+    Config.c_cc[VTIME] = 0;
+
+    if(cfsetispeed(&Config, B115200) < 0 || cfsetospeed(&Config, B115200) < 0) {
+        goto connectionError;
+    }
+    if(tcsetattr(Tty, TCSAFLUSH, &Config) < 0) {
+        goto connectionError;
+    }
+
+    return Tty;
+
+  connectionError:
+    close(Tty);
+    return -1;
+}
+
+// NOTE(nox): The tty is non-blocking, so a big upload can fill the kernel's output buffer. Wait for it to
+// drain instead of silently dropping the rest of the packet.
+static void writeAll(int Fd, u8 *Data, u32 Size) {
+    while(Size) {
+        ssize_t Written = write(Fd, Data, Size);
+        if(Written > 0) {
+            Data += Written;
+            Size -= Written;
+        }
+        else if(Written < 0 && errno == EAGAIN) {
+            pollfd Poll = {Fd, POLLOUT, 0};
+            poll(&Poll, 1, 100);
+        }
+        else if(Written < 0 && errno != EINTR) {
+            break;
+        }
+    }
+}
+
+// NOTE(nox): Returns the number of bytes that went on the wire
+static u32 sendBuffer(buff *Buffer, int SerialTTY) {
+    assert(SerialTTY >= 0);
+
+    buff Encoded = {};
+    finalizePacket(Buffer, &Encoded);
+    if(ActiveTrace) {
+        tracePacket(ActiveTrace, Trace_ToDevice, Buffer->Data, Buffer->Write);
+    }
+    u8 Delimiter = 0;
+    writeAll(SerialTTY, &Delimiter, 1);
+    writeAll(SerialTTY, Encoded.Data, Encoded.Write);
+    return 1 + Encoded.Write;
+}
+
+// NOTE(nox): Packets coming from the device, unstuffed as the bytes arrive like the firmware does in
+// decodeRx. Data holds the decoded bytes of the packet so far.
+typedef struct {
+    bool InPacket;
+    u8 Code;   // NOTE(nox): Of the current COBS group
+    u8 Copy;   // NOTE(nox): Bytes left in the current group, 0 when the next one is a code
+    buff Data;
+} packet_reader;
+
+typedef void packet_handler(void *User, buff *Pkt, u8 Command, u16 Length);
+
+static inline void resetPacketReader(packet_reader *Reader) {
+    Reader->InPacket = false;
+    resetBuff(&Reader->Data);
+}
+
+// NOTE(nox): Adds a decoded byte and hands the packet to Handler once it is complete. Returns whether the
+// packet is done with, complete or not a packet at all.
+static bool pushPacketByte(packet_reader *Reader, u8 Byte, packet_handler *Handler, void *User) {
+    buff *Pkt = &Reader->Data;
+    if(Pkt->Write >= arrayCount(Pkt->Data)) {
+        return true;
+    }
+    Pkt->Data[Pkt->Write++] = Byte;
+
+    if((Pkt->Data[0] & MagicMask) != MagicNumber) {
+        return true;
+    }
+
+    u8 Command;
+    u16 Length;
+    if(!readPacketHeader(Pkt, &Command, &Length)) {
+        return false;
+    }
+    if(ActiveTrace) {
+        tracePacket(ActiveTrace, Trace_FromDevice, Pkt->Data, 1+2 + Length);
+    }
+    Handler(User, Pkt, Command, Length);
+    return true;
+}
+
+// NOTE(nox): Reads whatever has arrived, waiting up to TimeoutMs for something to. Packets are handed to
+// Handler as soon as they are complete. Anything outside of a packet is a debug message from the PIC32,
+// which goes to stdout.
+static void readPackets(int Fd, packet_reader *Reader, int TimeoutMs, packet_handler *Handler, void *User) {
+    pollfd Poll = {Fd, POLLIN, 0};
+    if(TimeoutMs && poll(&Poll, 1, TimeoutMs) <= 0) {
+        return;
+    }
+
+    u8 Data[256];
+    ssize_t N;
+    while((N = read(Fd, Data, sizeof(Data))) > 0) {
+        for(ssize_t I = 0; I < N; ++I) {
+            u8 Byte = Data[I];
+            if(Byte == 0) {
+                Reader->InPacket = true;
+                Reader->Code = 0xFF;
+                Reader->Copy = 0;
+                resetBuff(&Reader->Data);
+            }
+            else if(!Reader->InPacket) {
+                putchar(Byte);
+            }
+            else if(Reader->Copy == 0) {
+                // NOTE(nox): The zero that ended the last group, see unstuffBytes
+                bool Done = Reader->Code != 0xFF && pushPacketByte(Reader, 0, Handler, User);
+                Reader->Code = Byte;
+                Reader->Copy = Byte - 1;
+                Reader->InPacket = !Done;
+            }
+            else {
+                --Reader->Copy;
+                Reader->InPacket = !pushPacketByte(Reader, Byte, Handler, User);
+            }
+        }
+        fflush(stdout);
+    }
+}
+
+#endif // SERIAL_HPP
@@ -0,0 +1,209 @@
+#if !defined(TRACE_HPP)
+#define TRACE_HPP
+
+// NOTE(nox): Packet traces, for reproducing what happened on the link (include protocol.hpp first and this
+// before serial.hpp)
+//
+// While a trace is active, every packet that goes through sendBuffer or readPackets is appended to it
+// unstuffed, header included, with the time since the previous one and its direction. The threads that
+// send only copy the packet into a ring, under a lock that is held just for the copy, and a writer thread
+// empties the ring into the file every TraceFlushMs, so a slow disk never stalls the UI or the tick
+// thread. If the ring is full the packet is only counted in Dropped.
+//
+// The file is a trace_header followed by a trace_record and Size bytes of packet for each packet.
+// TraceReplay prints them or sends them to a device again.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+    TraceVersion = 1,
+    TraceRingSize = 1<<20,
+    TraceFlushMs = 10,
+
+    TraceFlag_Pong = 1<<0, // NOTE(nox): The commands are pong_command
+};
+
+typedef enum : u8 {
+    Trace_ToDevice,
+    Trace_FromDevice,
+} trace_direction;
+
+static const u8 TraceMagic[4] = {'P', 'T', 'R', 'C'};
+
+typedef struct {
+    u8 Magic[4];
+    u32 Version;
+    u32 Flags;
+} trace_header;
+
+typedef struct {
+    u32 DeltaUs;  // NOTE(nox): Since the previous packet, in either direction
+    u16 Size;
+    u8 Direction; // NOTE(nox): trace_direction
+    u8 Reserved;
+} trace_record;
+
+typedef struct {
+    FILE *File;
+    pthread_t Thread;
+    bool Running;
+
+    pthread_mutex_t Lock; // NOTE(nox): Between the threads that add packets
+    u64 LastUs;
+    u32 Write;            // NOTE(nox): Only moved by the threads that add packets, with Lock held
+    u32 Read;             // NOTE(nox): Only moved by the writer thread
+    u32 Dropped;
+    u8 Ring[TraceRingSize];
+} packet_trace;
+
+static packet_trace *ActiveTrace;
+
+static inline u64 traceTimeUs() {
+    timespec Spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &Spec);
+    return Spec.tv_sec*1000000 + Spec.tv_nsec / 1000;
+}
+
+static void copyToRing(packet_trace *Trace, u32 *Write, const void *Data, u32 Size) {
+    u32 First = min((s32)Size, (s32)(TraceRingSize - *Write));
+    memcpy(Trace->Ring + *Write, Data, First);
+    memcpy(Trace->Ring, (const u8 *)Data + First, Size - First);
+    *Write = (*Write + Size) & (TraceRingSize - 1);
+}
+
+static void tracePacket(packet_trace *Trace, trace_direction Direction, const u8 *Data, u32 Size) {
+    trace_record Record = {};
+    Record.Size = Size;
+    Record.Direction = Direction;
+
+    pthread_mutex_lock(&Trace->Lock);
+    u32 Read = __atomic_load_n(&Trace->Read, __ATOMIC_ACQUIRE);
+    u32 Free = (Read - Trace->Write - 1) & (TraceRingSize - 1);
+    if(Free >= sizeof(Record) + Size) {
+        u64 Now = traceTimeUs();
+        Record.DeltaUs = (u32)min(Now - Trace->LastUs, (u64)UINT32_MAX);
+        Trace->LastUs = Now;
+
+        u32 Write = Trace->Write;
+        copyToRing(Trace, &Write, &Record, sizeof(Record));
+        copyToRing(Trace, &Write, Data, Size);
+        __atomic_store_n(&Trace->Write, Write, __ATOMIC_RELEASE);
+    }
+    else {
+        __atomic_fetch_add(&Trace->Dropped, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&Trace->Lock);
+}
+
+static void flushTrace(packet_trace *Trace) {
+    u32 Write = __atomic_load_n(&Trace->Write, __ATOMIC_ACQUIRE);
+    u32 Read = Trace->Read;
+    if(Write < Read) {
+        fwrite(Trace->Ring + Read, 1, TraceRingSize - Read, Trace->File);
+        Read = 0;
+    }
+    fwrite(Trace->Ring + Read, 1, Write - Read, Trace->File);
+    fflush(Trace->File);
+    __atomic_store_n(&Trace->Read, Write, __ATOMIC_RELEASE);
+}
+
+static void *traceWriterThread(void *Data) {
+    packet_trace *Trace = (packet_trace *)Data;
+    timespec Sleep = {0, TraceFlushMs*1000000};
+    while(__atomic_load_n(&Trace->Running, __ATOMIC_ACQUIRE)) {
+        nanosleep(&Sleep, 0);
+        flushTrace(Trace);
+    }
+    return 0;
+}
+
+static void stopActiveTrace() {
+    packet_trace *Trace = ActiveTrace;
+    if(!Trace) {
+        return;
+    }
+
+    ActiveTrace = 0;
+    __atomic_store_n(&Trace->Running, false, __ATOMIC_RELEASE);
+    pthread_join(Trace->Thread, 0);
+    flushTrace(Trace);
+    fclose(Trace->File);
+    if(Trace->Dropped) {
+        fprintf(stderr, "The packet trace lost %d packets, the disk could not keep up\n", Trace->Dropped);
+    }
+    free(Trace);
+}
+
+// NOTE(nox): The trace stops and is flushed when the program exits
+static bool startActiveTrace(const char *Path, u32 Flags) {
+    packet_trace *Trace = (packet_trace *)calloc(1, sizeof(packet_trace));
+    Trace->File = fopen(Path, "wb");
+    if(!Trace->File) {
+        free(Trace);
+        return false;
+    }
+
+    trace_header Header = {};
+    memcpy(Header.Magic, TraceMagic, sizeof(TraceMagic));
+    Header.Version = TraceVersion;
+    Header.Flags = Flags;
+    fwrite(&Header, sizeof(Header), 1, Trace->File);
+
+    pthread_mutex_init(&Trace->Lock, 0);
+    Trace->LastUs = traceTimeUs();
+    Trace->Running = true;
+    if(pthread_create(&Trace->Thread, 0, traceWriterThread, Trace) != 0) {
+        fclose(Trace->File);
+        free(Trace);
+        return false;
+    }
+
+    ActiveTrace = Trace;
+    atexit(stopActiveTrace);
+    return true;
+}
+
+// NOTE(nox): With --trace <path> on the command line or the OSCILLOSCOPE_TRACE environment variable
+static const char *traceFilePath(int ArgCount, char **Args) {
+    for(int I = 1; I+1 < ArgCount; ++I) {
+        if(strcmp(Args[I], "--trace") == 0) {
+            return Args[I+1];
+        }
+    }
+
+    const char *Env = getenv("OSCILLOSCOPE_TRACE");
+    return (Env && Env[0]) ? Env : 0;
+}
+
+static void startTraceFromArgs(int ArgCount, char **Args, u32 Flags) {
+    const char *Path = traceFilePath(ArgCount, Args);
+    if(Path && !startActiveTrace(Path, Flags)) {
+        fprintf(stderr, "Could not write the packet trace to %s\n", Path);
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Reading
+static FILE *openTrace(const char *Path, trace_header *Header) {
+    FILE *File = fopen(Path, "rb");
+    if(File && (fread(Header, sizeof(*Header), 1, File) != 1 ||
+                memcmp(Header->Magic, TraceMagic, sizeof(TraceMagic)) != 0 || Header->Version != TraceVersion))
+    {
+        fclose(File);
+        File = 0;
+    }
+    return File;
+}
+
+// NOTE(nox): Data must hold MaxPacketSize bytes. Returns false at the end of the file or if the record is
+// cut short (e.g. the program was killed before the last flush).
+static bool readTraceRecord(FILE *File, trace_record *Record, u8 *Data) {
+    return (fread(Record, sizeof(*Record), 1, File) == 1 && Record->Size <= MaxPacketSize &&
+            fread(Data, 1, Record->Size, File) == Record->Size);
+}
+
+#endif // TRACE_HPP
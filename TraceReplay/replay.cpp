@@ -0,0 +1,185 @@
+// NOTE(nox): Prints packet traces (see trace.hpp) or sends what the host sent in one to a device again,
+// either at the pace it was recorded or as fast as the link takes it. The first gives a bug report that
+// anyone can run against their board or VirtualDevice, the second a load test that is the same every time.
+// The device's answers are counted per command and compared with the ones in the trace.
+//
+//     ControlApp --trace show.trace
+//     TraceReplay --dump show.trace
+//     TraceReplay --device /tmp/ttyVirtual0 [--fast] show.trace
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <common.h>
+#include <protocol.hpp>
+#include <trace.hpp>
+#include <serial.hpp>
+#include <latency.hpp>
+
+typedef struct {
+    u64 Recorded[CommandMask+1]; // NOTE(nox): Device packets in the trace
+    u64 Received[CommandMask+1]; // NOTE(nox): Device packets during the replay
+    u64 LastUs;
+} answer_counts;
+
+static void countAnswer(void *User, buff *, u8 Command, u16) {
+    answer_counts *Counts = (answer_counts *)User;
+    ++Counts->Received[Command];
+    Counts->LastUs = getTimeUs();
+}
+
+static const char *printableName(u8 Command, bool Pong) {
+    const char *Name = commandName(Command, Pong);
+    return Name ? Name : "Unknown";
+}
+
+static void dumpTrace(FILE *File, trace_header *Header) {
+    bool Pong = Header->Flags & TraceFlag_Pong;
+    static u8 Data[MaxPacketSize];
+    trace_record Record;
+    u64 TimeUs = 0;
+    while(readTraceRecord(File, &Record, Data)) {
+        TimeUs += Record.DeltaUs;
+        if(Record.Size < 1+2) {
+            continue;
+        }
+
+        printf("%12.3f ms %s %-18s %5d B", TimeUs / 1000.0, Record.Direction == Trace_ToDevice ? "->" : "<-",
+               printableName(Data[0] & CommandMask, Pong), Record.Size - (1+2));
+        for(u32 I = 1+2; I < Record.Size && I < 1+2 + 16; ++I) {
+            printf(" %02X", Data[I]);
+        }
+        printf("%s\n", Record.Size > 1+2 + 16 ? " ..." : "");
+    }
+}
+
+static int replayTrace(FILE *File, trace_header *Header, const char *DevicePath, bool Fast) {
+    int Tty = serialConnect(DevicePath);
+    if(Tty < 0) {
+        fprintf(stderr, "Could not open %s as a serial port\n", DevicePath);
+        return 1;
+    }
+
+    static answer_counts Counts;
+    static packet_reader Reader;
+    static buff Packet;
+    trace_record Record;
+    u64 Sent = 0, WireBytes = 0, TraceUs = 0;
+    u64 StartUs = getTimeUs();
+    while(readTraceRecord(File, &Record, Packet.Data)) {
+        TraceUs += Record.DeltaUs;
+        if(Record.Size < 1+2) {
+            continue;
+        }
+        if(Record.Direction == Trace_FromDevice) {
+            ++Counts.Recorded[Packet.Data[0] & CommandMask];
+            continue;
+        }
+
+        // NOTE(nox): Answers are read while waiting, so the device never blocks on a full output buffer
+        u64 SendUs = Fast ? 0 : StartUs + TraceUs;
+        readPackets(Tty, &Reader, 0, countAnswer, &Counts);
+        for(u64 Now = getTimeUs(); Now < SendUs; Now = getTimeUs()) {
+            readPackets(Tty, &Reader, (SendUs - Now + 999)/1000, countAnswer, &Counts);
+        }
+
+        Packet.Read = 0;
+        Packet.Write = Record.Size;
+        WireBytes += sendBuffer(&Packet, Tty);
+        ++Sent;
+    }
+    tcdrain(Tty);
+    u64 ElapsedUs = getTimeUs() - StartUs;
+
+    // NOTE(nox): The answers to the last packets
+    for(u64 End = getTimeUs() + 500*1000, Now = getTimeUs(); Now < End; Now = getTimeUs()) {
+        readPackets(Tty, &Reader, (End - Now + 999)/1000, countAnswer, &Counts);
+    }
+    close(Tty);
+
+    printf("Sent %llu packets (%llu bytes) in %.3f s, %.0f bytes/s, the trace took %.3f s\n",
+           (unsigned long long)Sent, (unsigned long long)WireBytes, ElapsedUs / 1e6,
+           WireBytes*1e6 / (ElapsedUs ? ElapsedUs : 1), TraceUs / 1e6);
+    // NOTE(nox): A pty (or a USB adapter with a big buffer) takes the bytes long before the device has them,
+    // the last answer tells when it was done with them
+    if(Counts.LastUs) {
+        printf("The last answer came after %.3f s\n", (Counts.LastUs - StartUs) / 1e6);
+    }
+
+    int Result = 0;
+    bool Pong = Header->Flags & TraceFlag_Pong;
+    printf("\n%-20s %10s %10s\n", "Answer", "Recorded", "Received");
+    for(u32 I = 0; I <= CommandMask; ++I) {
+        if(Counts.Recorded[I] || Counts.Received[I]) {
+            bool Differ = Counts.Recorded[I] != Counts.Received[I];
+            printf("%-20s %10llu %10llu%s\n", printableName(I, Pong), (unsigned long long)Counts.Recorded[I],
+                   (unsigned long long)Counts.Received[I], Differ ? "  <" : "");
+            Result = Differ ? 2 : Result;
+        }
+    }
+    return Result;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: TraceReplay --dump <trace>\n"
+            "       TraceReplay [--device <tty>] [--fast] <trace>\n"
+            "\n"
+            "--dump prints every packet in the trace. Otherwise the packets the host sent are sent to the\n"
+            "device again (see serialDevicePath for the default), at the recorded times or with --fast as\n"
+            "fast as possible. The exit code is 2 when the device answered differently than in the trace.\n");
+}
+
+int main(int ArgCount, char **Args) {
+    const char *DevicePath = serialDevicePath(ArgCount, Args);
+    const char *Path = 0;
+    bool Dump = false;
+    bool Fast = false;
+    for(int I = 1; I < ArgCount; ++I) {
+        if(strcmp(Args[I], "--dump") == 0) {
+            Dump = true;
+        }
+        else if(strcmp(Args[I], "--fast") == 0) {
+            Fast = true;
+        }
+        else if(strcmp(Args[I], "--device") == 0 && I+1 < ArgCount) {
+            ++I;
+        }
+        else if(!Path && Args[I][0] != '-') {
+            Path = Args[I];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if(!Path) {
+        usage();
+        return 1;
+    }
+
+    trace_header Header;
+    FILE *File = openTrace(Path, &Header);
+    if(!File) {
+        fprintf(stderr, "%s is not a packet trace\n", Path);
+        return 1;
+    }
+
+    int Result = 0;
+    if(Dump) {
+        dumpTrace(File, &Header);
+    }
+    else {
+        Result = replayTrace(File, &Header, DevicePath, Fast);
+    }
+    fclose(File);
+    return Result;
+}
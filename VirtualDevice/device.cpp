@@ -0,0 +1,717 @@
+// NOTE(nox): Stand-in for the board, for working on the host applications without one. It opens a
+// pseudo-terminal pair and behaves like the AnimPlayer (or Pong) firmware on the other end:
+//
+//  - Bytes go through at the rate of a UART at the chosen baud rate, in both directions, so uploads take
+//    as long as they would on the board.
+//  - Received bytes go through the firmware's RX ring and its packet decoder (Link.h, the same code), and
+//    drawing a frame keeps the device from reading them for as long as the real one would, so the ring
+//    overflows when it would on the board.
+//  - Frame uploads, frame hashes, slots, playlists, pings and text are handled like the firmware does, so
+//    connecting, uploading, syncing and the latency probe all work.
+//
+// Faults can be injected: dropped bytes, cut packets and stalls long enough to overflow the RX ring.
+//
+//     VirtualDevice --baud 115200 --link /tmp/ttyVirtual0 &
+//     ControlApp --device /tmp/ttyVirtual0
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <common.h>
+#include <protocol.hpp>
+#include <playlist.hpp>
+#include <glyphs.hpp>
+
+static inline u64 getTimeUs() {
+    timespec Spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &Spec);
+    return Spec.tv_sec*1000000 + Spec.tv_nsec / 1000;
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Device -> host. Link.h sends through U1TXREG, here every write to it goes to TxQueue, which
+// is drained into the pty at the baud rate.
+typedef struct {
+    u8 Data[1<<16];
+    u32 Read;
+    u32 Write;
+    enum { Mask = (sizeof(Data) - 1) };
+} byte_queue;
+
+static byte_queue TxQueue;
+
+static inline u32 queueCount(byte_queue *Queue) {
+    return (Queue->Write - Queue->Read) & Queue->Mask;
+}
+
+static struct {
+    u32 UTXBF; // NOTE(nox): The queue is never full for the firmware
+} U1STAbits;
+
+static struct {
+    void operator=(u8 Byte) {
+        if(((TxQueue.Write + 1) & TxQueue.Mask) != TxQueue.Read) {
+            TxQueue.Data[TxQueue.Write] = Byte;
+            TxQueue.Write = (TxQueue.Write + 1) & TxQueue.Mask;
+        }
+    }
+} U1TXREG;
+
+#include "../MCU/src/Link.h"
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Device state
+enum {
+    Firmware_AnimPlayer,
+    Firmware_Pong,
+};
+
+enum {
+    VirtualAnimCount = AnimSlotCount, // NOTE(nox): AnimCount of Animations.h
+    MaxPointsPerFrame = 300, // NOTE(nox): As in AnimPlayer.cpp
+    FrameHeaderSize = 2+2+2,
+};
+
+// NOTE(nox): What the firmware stores for a frame, in the order it hashes it (see hashFrame)
+typedef struct {
+    u8 Format;
+    u32 Size;
+    u8 Data[FrameHeaderSize + 2*MaxPointsPerFrame + TweenSize]; // NOTE(nox): The tween only if it has frames
+    u16 TweenCount;
+} virtual_frame;
+
+typedef struct {
+    u32 FrameCount;
+    virtual_frame Frames[MaxFrames];
+} virtual_animation;
+
+typedef struct {
+    u64 RxBytes;
+    u64 DroppedBytes;    // NOTE(nox): By the --drop fault
+    u64 TruncatedBytes;  // NOTE(nox): By the --truncate fault
+    u64 OverflowBytes;   // NOTE(nox): Did not fit in the RX ring
+    u32 TruncatedPackets;
+    u32 MaxRxFill;
+    u32 Packets;
+    u32 Unknown;         // NOTE(nox): Packets with a command the firmware ignores
+    u64 TxBytes;
+} device_stats;
+
+typedef struct {
+    const char *LinkPath;
+    u32 Baud;
+    u32 Firmware;
+    u32 PointUs;     // NOTE(nox): Time the firmware takes to draw a point
+    u32 DropOneIn;   // NOTE(nox): 0 is never
+    u32 TruncateOneIn;
+    u32 StallMs;     // NOTE(nox): Once a second
+    u32 StatsSeconds;
+    u32 Seed;
+} device_options;
+
+static device_options Options;
+static device_stats Stats;
+
+static u64 BootUs;
+static bool InfoLed;
+static bool Drawing;
+static u32 SelectedAnimation;
+static u32 UploadSlot;
+static playlist Playlist;
+static u32 SelectedFrame;
+static u32 FrameRepeatCount;
+static u32 TweenStep;
+static u32 FrameStartUs;
+static u32 FramePeriodUs;
+static u64 NextFrameUs;
+static u64 BusyUntilUs;
+static virtual_animation Animations[VirtualAnimCount];
+static text_slot TextSlots[MaxTextSlots];
+
+static inline u32 micros() {
+    return (u32)(getTimeUs() - BootUs);
+}
+
+static inline u16 frameField(virtual_frame *Frame, u32 Offset) {
+    return Frame->Data[Offset] | (Frame->Data[Offset+1] << 8);
+}
+
+static u32 hashFrame(virtual_frame *Frame) {
+    return hashBytes(frameHashSeed(Frame->Format), Frame->Data, Frame->Size);
+}
+
+static void initAnimations() {
+    for(u32 Anim = 0; Anim < VirtualAnimCount; ++Anim) {
+        Animations[Anim].FrameCount = 1;
+        for(u32 I = 0; I < MaxFrames; ++I) {
+            Animations[Anim].Frames[I].Size = FrameHeaderSize;
+        }
+    }
+}
+
+static void selectFrame(u8 FrameIdx) {
+    virtual_animation *Animation = Animations + SelectedAnimation;
+    if(FrameIdx < Animation->FrameCount) {
+        FrameRepeatCount = 0;
+        TweenStep = 0;
+        SelectedFrame = FrameIdx;
+        u16 Fps = max(frameField(Animation->Frames + FrameIdx, 0), MinFps);
+        FramePeriodUs = 1000000 / Fps;
+    }
+}
+
+static void selectSlot(u32 Slot) {
+    SelectedAnimation = Slot;
+    UploadSlot = Slot;
+    clearPlaylist(&Playlist);
+    selectFrame(0);
+}
+
+static void setInfoLed(bool On) {
+    if(InfoLed != On) {
+        printf("Info LED %s\n", On ? "on" : "off");
+        InfoLed = On;
+    }
+}
+
+static void storeFrame(u8 Format, u16 Length, u32 PointBytes) {
+    enum { CmdHeaderSize = 1+2+2+2 };
+    u8 FrameIdx = readU8(&Pkt);
+    u16 Fps = readU16(&Pkt);
+    u16 RepeatCount = readU16(&Pkt);
+    u16 PointCount = readU16(&Pkt);
+
+    u32 MaxCount = Format == FrameFormat_HighRes ? (u32)MaxHighResPoints : (u32)MaxPointsPerFrame;
+    u32 Size = Format == FrameFormat_HighRes ? highResFrameSize(PointCount) : PointBytes*PointCount;
+    if((u32)(Length - CmdHeaderSize) < Size || FrameIdx >= MaxFrames || PointCount > MaxCount) {
+        return;
+    }
+
+    virtual_frame *Frame = Animations[UploadSlot].Frames + FrameIdx;
+    Fps = max(Fps, MinFps);
+    u8 Header[FrameHeaderSize] = {(u8)Fps, (u8)(Fps >> 8), (u8)RepeatCount, (u8)(RepeatCount >> 8),
+                                  (u8)PointCount, (u8)(PointCount >> 8)};
+    memcpy(Frame->Data, Header, sizeof(Header));
+    memcpy(Frame->Data + FrameHeaderSize, Pkt.Data + Pkt.Read, Size);
+    Frame->Size = FrameHeaderSize + Size;
+    Frame->Format = Format;
+
+    Frame->TweenCount = 0;
+    if((u32)(Length - CmdHeaderSize) - Size >= TweenSize) {
+        Pkt.Read += Size;
+        Frame->TweenCount = readU16(&Pkt);
+        if(Frame->TweenCount) {
+            memcpy(Frame->Data + Frame->Size, Pkt.Data + Pkt.Read - 2, TweenSize);
+            Frame->Size += TweenSize;
+        }
+    }
+
+    if(UploadSlot == SelectedAnimation && SelectedFrame == FrameIdx) {
+        selectFrame(FrameIdx);
+    }
+}
+
+static void sendEcho(u32 Now) {
+    echo_info Echo = {};
+    Echo.Seq = readU32(&Pkt);
+    Echo.HostTimeUs = readU32(&Pkt);
+    Echo.DeviceRxUs = Now;
+    Echo.SinceFrameUs = Now - FrameStartUs;
+    Echo.FramePeriodUs = FramePeriodUs;
+    Echo.State = Drawing ? DeviceState_Drawing : 0;
+
+    resetBuff(&Pkt);
+    Echo.DeviceTxUs = micros();
+    writeEcho(&Pkt, &Echo);
+    uartSend(&Pkt);
+}
+
+// NOTE(nox): Only the link side of the Pong firmware, the game itself is not simulated
+static void handlePongPacket(u8 Command, u16 Length) {
+    switch((pong_command)Command) {
+        case PongCmd_InfoLedOn: {
+            setInfoLed(true);
+        } break;
+
+        case PongCmd_InfoLedOff: {
+            setInfoLed(false);
+        } break;
+
+        case PongCmd_Ping: {
+            if(Length >= 4+4) {
+                sendEcho(micros());
+            }
+        } break;
+
+        case PongCmd_DrawText: {
+            handleDrawText(&Pkt, Length, TextSlots);
+        } break;
+
+        case PongCmd_Update:
+        case PongCmd_SetScore:
+        case PongCmd_Input:
+        case PongCmd_Reset: {} break;
+
+        default: {
+            ++Stats.Unknown;
+        } break;
+    }
+}
+
+static void handlePacket(u8 Command, u16 Length) {
+    ++Stats.Packets;
+    if(Options.Firmware == Firmware_Pong) {
+        handlePongPacket(Command, Length);
+        return;
+    }
+
+    switch((command)Command) {
+        case Command_InfoLedOn: {
+            setInfoLed(true);
+        } break;
+
+        case Command_InfoLedOff: {
+            setInfoLed(false);
+        } break;
+
+        case Command_PowerOn: {
+            selectFrame(0);
+            NextFrameUs = getTimeUs();
+            Drawing = true;
+        } break;
+
+        case Command_PowerOff: {
+            Drawing = false;
+        } break;
+
+        case Command_Select0:
+        case Command_Select1: {
+            selectSlot(Command == Command_Select1);
+        } break;
+
+        case Command_SelectSlot: {
+            if(Length < 1) {
+                break;
+            }
+            u8 Slot = readU8(&Pkt);
+            if(Slot < VirtualAnimCount) {
+                selectSlot(Slot);
+            }
+        } break;
+
+        case Command_UploadSlot: {
+            if(Length < 1) {
+                break;
+            }
+            u8 Slot = readU8(&Pkt);
+            if(Slot < VirtualAnimCount) {
+                UploadSlot = Slot;
+            }
+        } break;
+
+        case Command_SetPlaylist: {
+            playlist_entry Entries[MaxPlaylistEntries];
+            u32 Count;
+            if(readPlaylist(&Pkt, Length, VirtualAnimCount, Entries, &Count)) {
+                setPlaylist(&Playlist, Entries, Count);
+            }
+        } break;
+
+        case Command_QueryPlaylist: {
+            playlist_status Status;
+            playlistStatus(&Playlist, SelectedAnimation, UploadSlot, &Status);
+            resetBuff(&Pkt);
+            writePlaylistStatus(&Pkt, &Status);
+            uartSend(&Pkt);
+        } break;
+
+        case Command_UpdateFrame: {
+            if(Length >= 1+2+2+2) {
+                storeFrame(FrameFormat_Grid, Length, sizeof(u8)*2);
+            }
+        } break;
+
+        case Command_UpdateFrameHighRes: {
+            if(Length >= 1+2+2+2) {
+                storeFrame(FrameFormat_HighRes, Length, 0);
+            }
+        } break;
+
+        case Command_UpdateFrameCount: {
+            u8 FrameCount = readU8(&Pkt);
+            Animations[UploadSlot].FrameCount = clamp(1, (s32)FrameCount, (s32)MaxFrames);
+            if(UploadSlot == SelectedAnimation) {
+                selectFrame(0);
+            }
+        } break;
+
+        case Command_QueryFrameHashes: {
+            u8 Anim = readU8(&Pkt);
+            if(Anim >= VirtualAnimCount) {
+                break;
+            }
+
+            virtual_animation *Animation = Animations + Anim;
+            u32 Hashes[MaxFrames];
+            for(u32 I = 0; I < MaxFrames; ++I) {
+                Hashes[I] = hashFrame(Animation->Frames + I);
+            }
+
+            resetBuff(&Pkt);
+            writeFrameHashes(&Pkt, Anim, Animation->FrameCount, Hashes);
+            uartSend(&Pkt);
+        } break;
+
+        case Command_Ping: {
+            if(Length >= 4+4) {
+                sendEcho(micros());
+            }
+        } break;
+
+        case Command_DrawText: {
+            handleDrawText(&Pkt, Length, TextSlots);
+        } break;
+
+        case Command_SetTo0:
+        case Command_DontSetTo0:
+        case Command_SetIntensity: {} break;
+
+        default: {
+            ++Stats.Unknown;
+        } break;
+    }
+}
+
+static inline void busyUntil(u64 Us) {
+    if(Us > BusyUntilUs) {
+        BusyUntilUs = Us;
+    }
+}
+
+// NOTE(nox): The firmware reads the RX ring only between frames, so while a frame is drawn the device is
+// busy for as long as its points take
+static void stepFrames(u64 Now) {
+    if(!Drawing || Now < NextFrameUs) {
+        return;
+    }
+
+    virtual_animation *Animation = Animations + SelectedAnimation;
+    virtual_frame *Frame = Animation->Frames + SelectedFrame;
+    u32 PointCount = frameField(Frame, 4);
+    for(u32 Slot = 0; Slot < MaxTextSlots; ++Slot) {
+        PointCount += TextSlots[Slot].Count;
+    }
+
+    FrameStartUs = (u32)(Now - BootUs);
+    busyUntil(Now + (u64)PointCount*Options.PointUs);
+    NextFrameUs += FramePeriodUs;
+    if(NextFrameUs < Now) {
+        NextFrameUs = Now; // NOTE(nox): The frame took longer than its period, the next one starts right away
+    }
+
+    // NOTE(nox): The tween frames take as long as the ones of the firmware, the points don't matter here
+    ++FrameRepeatCount;
+    if(FrameRepeatCount >= frameField(Frame, 2)) {
+        // NOTE(nox): The playlist advances like in the firmware, see loop in AnimPlayer.cpp
+        bool EndOfPass = SelectedFrame + 1 >= Animation->FrameCount;
+        playlist_entry *NextEntry = EndOfPass ? nextPlaylistEntry(&Playlist) : 0;
+        u32 NextIdx = EndOfPass ? 0 : SelectedFrame + 1;
+        virtual_frame *Next = Animations[NextEntry ? NextEntry->Slot : SelectedAnimation].Frames + NextIdx;
+        bool CanTween = (frameField(Next, 4) == frameField(Frame, 4) &&
+                         (!NextEntry || NextEntry->Transition == Transition_Tween));
+        if(TweenStep < Frame->TweenCount && CanTween) {
+            ++TweenStep;
+        }
+        else {
+            if(EndOfPass && endPlaylistPass(&Playlist)) {
+                SelectedAnimation = NextEntry->Slot;
+            }
+            selectFrame(NextIdx);
+        }
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Host -> device
+static u32 RandomState;
+
+static u32 deviceRandom() {
+    u32 X = RandomState;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    return RandomState = X;
+}
+
+static inline bool oneIn(u32 N) {
+    return N && deviceRandom() % N == 0;
+}
+
+// NOTE(nox): What the UART ISR does with a byte, after the faults had their go at it
+static void receiveByte(u8 Byte) {
+    static u32 TruncateLeft; // NOTE(nox): Bytes of the current packet that still go through, 0 is all
+    static bool Truncating;
+
+    ++Stats.RxBytes;
+    if(oneIn(Options.DropOneIn)) {
+        ++Stats.DroppedBytes;
+        return;
+    }
+
+    if(Byte == 0) {
+        Truncating = false;
+        TruncateLeft = 0;
+        if(oneIn(Options.TruncateOneIn)) {
+            TruncateLeft = 1 + deviceRandom() % 32;
+        }
+    }
+    else if(Truncating) {
+        ++Stats.TruncatedBytes;
+        return;
+    }
+    else if(TruncateLeft && --TruncateLeft == 0) {
+        Truncating = true;
+        ++Stats.TruncatedPackets; // NOTE(nox): Packets shorter than TruncateLeft get through whole
+    }
+
+    u32 NextWrite = (Rx.Write + 1) & Rx.Mask;
+    if(NextWrite != Rx.Read) {
+        Rx.Data[Rx.Write] = Byte;
+        Rx.Write = NextWrite;
+        if(Byte == 0) {
+            Rx.NewPacketCount++;
+        }
+        Stats.MaxRxFill = max(Stats.MaxRxFill, (Rx.Write - Rx.Read) & Rx.Mask);
+    }
+    else {
+        ++Stats.OverflowBytes;
+        setInfoLed(true);
+    }
+}
+
+
+// ------------------------------------------------------------------------------------------
+// NOTE(nox): Link
+// A UART sends a byte every 10 bit times (8N1). Bytes are let through as the time for them passes, with
+// up to a couple of ms worth at once, which is also about what a USB serial adapter does.
+typedef struct {
+    double BytesPerUs;
+    double Burst;
+    double Budget;
+    u64 LastUs;
+} link_throttle;
+
+static void initThrottle(link_throttle *Throttle, u32 Baud, u64 Now) {
+    Throttle->BytesPerUs = Baud / 10.0 / 1e6;
+    // NOTE(nox): The budget saved up while waiting in poll is at most one loop period worth, more would let
+    // bytes arrive faster than the wire could carry them
+    Throttle->Burst = Throttle->BytesPerUs*1000 + 1;
+    Throttle->Budget = 0;
+    Throttle->LastUs = Now;
+}
+
+static u32 availableBytes(link_throttle *Throttle, u64 Now) {
+    Throttle->Budget += (Now - Throttle->LastUs)*Throttle->BytesPerUs;
+    if(Throttle->Budget > Throttle->Burst) {
+        Throttle->Budget = Throttle->Burst;
+    }
+    Throttle->LastUs = Now;
+    return (u32)Throttle->Budget;
+}
+
+static int openPty(const char *LinkPath, int *Slave) {
+    int Master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(Master < 0 || grantpt(Master) < 0 || unlockpt(Master) < 0) {
+        return -1;
+    }
+
+    // NOTE(nox): Keeping the slave open means reads on the master wait instead of failing while no
+    // application has the device open, and it starts raw so nothing is echoed before one configures it
+    const char *SlavePath = ptsname(Master);
+    *Slave = SlavePath ? open(SlavePath, O_RDWR | O_NOCTTY) : -1;
+    if(*Slave < 0) {
+        close(Master);
+        return -1;
+    }
+
+    termios Config;
+    tcgetattr(*Slave, &Config);
+    cfmakeraw(&Config);
+    tcsetattr(*Slave, TCSANOW, &Config);
+    fcntl(Master, F_SETFL, fcntl(Master, F_GETFL) | O_NONBLOCK);
+
+    unlink(LinkPath);
+    if(symlink(SlavePath, LinkPath) < 0) {
+        fprintf(stderr, "Could not create %s, use %s directly\n", LinkPath, SlavePath);
+    }
+    printf("Virtual device on %s (%s), %d baud\n", LinkPath, SlavePath, Options.Baud);
+    return Master;
+}
+
+static void printStats() {
+    printf("rx %llu B (%llu dropped, %llu cut from %u packets, %llu overflowed, max ring fill %u/%u), "
+           "%u packets (%u ignored), tx %llu B\n",
+           (unsigned long long)Stats.RxBytes, (unsigned long long)Stats.DroppedBytes,
+           (unsigned long long)Stats.TruncatedBytes, Stats.TruncatedPackets,
+           (unsigned long long)Stats.OverflowBytes, Stats.MaxRxFill, (u32)sizeof(Rx.Data) - 1,
+           Stats.Packets, Stats.Unknown, (unsigned long long)Stats.TxBytes);
+    fflush(stdout);
+}
+
+static volatile sig_atomic_t Running = 1;
+
+static void stopRunning(int) {
+    Running = 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: VirtualDevice [options]\n"
+            "\n"
+            "Options:\n"
+            "  --link <path>       Symlink to the pty for the applications (default /tmp/ttyVirtual0)\n"
+            "  --baud <rate>       Link speed (default %d)\n"
+            "  --firmware <name>   anim or pong (default anim)\n"
+            "  --point-us <us>     Time to draw a point (default 100)\n"
+            "  --drop <n>          Drop one in n received bytes\n"
+            "  --truncate <n>      Cut one in n received packets short\n"
+            "  --stall <ms>        Stop reading the RX ring for ms once a second\n"
+            "  --stats <seconds>   Print the counters this often, 0 only at exit (default 5)\n"
+            "  --seed <n>          Seed of the faults (default 1)\n", BaudRate);
+}
+
+int main(int ArgCount, char **Args) {
+    Options.LinkPath = "/tmp/ttyVirtual0";
+    Options.Baud = BaudRate;
+    Options.Firmware = Firmware_AnimPlayer;
+    Options.PointUs = 100;
+    Options.StatsSeconds = 5;
+    Options.Seed = 1;
+    for(int I = 1; I < ArgCount; ++I) {
+        if(I+1 >= ArgCount) {
+            usage();
+            return 1;
+        }
+
+        const char *Arg = Args[I];
+        const char *Value = Args[++I];
+        if(strcmp(Arg, "--link") == 0) {
+            Options.LinkPath = Value;
+        }
+        else if(strcmp(Arg, "--baud") == 0) {
+            Options.Baud = max(atoi(Value), 300);
+        }
+        else if(strcmp(Arg, "--firmware") == 0) {
+            Options.Firmware = strcmp(Value, "pong") == 0 ? Firmware_Pong : Firmware_AnimPlayer;
+        }
+        else if(strcmp(Arg, "--point-us") == 0) {
+            Options.PointUs = atoi(Value);
+        }
+        else if(strcmp(Arg, "--drop") == 0) {
+            Options.DropOneIn = atoi(Value);
+        }
+        else if(strcmp(Arg, "--truncate") == 0) {
+            Options.TruncateOneIn = atoi(Value);
+        }
+        else if(strcmp(Arg, "--stall") == 0) {
+            Options.StallMs = atoi(Value);
+        }
+        else if(strcmp(Arg, "--stats") == 0) {
+            Options.StatsSeconds = atoi(Value);
+        }
+        else if(strcmp(Arg, "--seed") == 0) {
+            Options.Seed = strtoul(Value, 0, 0);
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    RandomState = Options.Seed ? Options.Seed : 1;
+
+    int Slave;
+    int Master = openPty(Options.LinkPath, &Slave);
+    if(Master < 0) {
+        fprintf(stderr, "Could not open a pseudo-terminal\n");
+        return 1;
+    }
+
+    signal(SIGINT, stopRunning);
+    signal(SIGTERM, stopRunning);
+
+    BootUs = getTimeUs();
+    initAnimations();
+    selectFrame(0);
+    NextFrameUs = BootUs;
+    Drawing = true; // NOTE(nox): Like the firmware at the end of setup, before any PowerOn
+    SkipPacket = true; // NOTE(nox): Nothing counts until the first delimiter
+
+    link_throttle HostToDevice, DeviceToHost;
+    initThrottle(&HostToDevice, Options.Baud, BootUs);
+    initThrottle(&DeviceToHost, Options.Baud, BootUs);
+    u64 NextStallUs = BootUs + 1000000;
+    u64 NextStatsUs = BootUs + Options.StatsSeconds*1000000ull;
+
+    while(Running) {
+        u64 Now = getTimeUs();
+
+        u32 Allowed = availableBytes(&HostToDevice, Now);
+        if(Allowed) {
+            u8 Data[4096];
+            ssize_t N = read(Master, Data, min((u64)Allowed, sizeof(Data)));
+            for(ssize_t I = 0; I < N; ++I) {
+                receiveByte(Data[I]);
+            }
+            if(N > 0) {
+                HostToDevice.Budget -= N;
+            }
+        }
+
+        if(Options.StallMs && Now >= NextStallUs) {
+            busyUntil(Now + Options.StallMs*1000ull);
+            NextStallUs += 1000000;
+        }
+        if(Now >= BusyUntilUs) {
+            processRx();
+            stepFrames(Now);
+        }
+
+        // NOTE(nox): The queue may wrap, the rest goes next time around
+        u64 Pending = min((u64)availableBytes(&DeviceToHost, Now), queueCount(&TxQueue));
+        Pending = min(Pending, sizeof(TxQueue.Data) - TxQueue.Read);
+        if(Pending) {
+            ssize_t N = write(Master, TxQueue.Data + TxQueue.Read, Pending);
+            if(N > 0) {
+                TxQueue.Read = (TxQueue.Read + N) & TxQueue.Mask;
+                DeviceToHost.Budget -= N;
+                Stats.TxBytes += N;
+            }
+        }
+
+        if(Options.StatsSeconds && Now >= NextStatsUs) {
+            printStats();
+            NextStatsUs += Options.StatsSeconds*1000000ull;
+        }
+
+        pollfd Poll = {Master, (short)(HostToDevice.Budget >= 1 ? POLLIN : 0), 0};
+        poll(&Poll, 1, 1);
+    }
+
+    printStats();
+    unlink(Options.LinkPath);
+    close(Slave);
+    close(Master);
+    return 0;
+}